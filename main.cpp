@@ -36,10 +36,35 @@
  * .\rubik.exe
  * 
  * Compilation command (Linux):
- * g++ -std=c++98 -Wall -Wextra -O2 main.cpp -lglut -lGLU -lGL -lm -o rubik
+ * g++ -std=c++98 -Wall -Wextra -O2 -pthread main.cpp -lglut -lGLU -lGL -lm -o rubik
+ * 
+ * Headless batch thumbnails (no window / no GPU, software GL):
+ * g++ -std=c++98 -Wall -Wextra -O2 -DRUBIK_ENABLE_EGL main.cpp -lglut -lGLU -lGL -lEGL -lm -o rubik
+ * g++ -std=c++98 -Wall -Wextra -O2 -DRUBIK_ENABLE_OSMESA main.cpp -lglut -lGLU -lOSMesa -lm -o rubik
+ * ./rubik --render-batch jobs.txt --size 256x256
+ * ./rubik --cube 5 --render-batch jobs.txt   (any NxNxN, N = 2..256)
+ * ./rubik --cube 256 --threads 8             (worker threads for big-cube moves)
+ * ./rubik --play moves.txt                    (animate a move script, any length)
+ * ./rubik --instant --play scramble.txt       (apply it in one frame, timer armed; 'I' toggles)
+ * ./rubik --record session.rbki              (log every input event for bug reports)
+ * ./rubik --replay session.rbki              (re-run it headless, verify the final state key)
+ * ./rubik --solve-stats rubik_solves.rbks    (summarize the binary solve log)
+ * ./rubik --enumerate-2x2 pocket.bin         (all 3,674,160 2x2x2 states, parallel BFS)
  */
 
+#ifdef _WIN32
+#include <windows.h> // for QueryPerformanceCounter, worker threads
+#else
+#include <pthread.h> // worker threads for big-cube moves
+#include <unistd.h>  // for sysconf
+#include <fcntl.h>     // open() for mapped solve logs
+#include <sys/mman.h>  // mmap() for mapped solve logs
+#include <sys/stat.h>  // fstat()
+#endif
 #include <GL/glut.h>
+#ifdef FREEGLUT
+#include <GL/freeglut_ext.h> // for glutGetProcAddress
+#endif
 #include <cmath>
 #include <iostream>
 #include <cstdlib> // for system("pause")
@@ -47,19 +72,43 @@
 #include <ctime>   // for timestamp
 #include <cstring> // for memcpy
 #include <cctype>  // for toupper
+#include <vector>
+#include <string>
+#include <set>   // order statistics for rolling averages
+#include <map>   // Zobrist key tables per cube size
+#include <deque>
+#include <algorithm> // for std::sort
+
+// Headless (window-less) rendering backends - opt in with -DRUBIK_ENABLE_OSMESA or -DRUBIK_ENABLE_EGL
+#if defined(RUBIK_ENABLE_OSMESA)
+#include <GL/osmesa.h>
+#elif defined(RUBIK_ENABLE_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
 #if defined(_MSC_VER) && !defined(snprintf)
 #define snprintf _snprintf
 #endif
 
+// Full memory barrier for the lock-free move queue (C++98 has no <atomic>)
+// ATOMIC_CAS32 swaps a 32-bit word if it still holds `expected`, returning what it held;
+// ATOMIC_INC32 returns the incremented value
+#if defined(_MSC_VER)
+#define MEMORY_BARRIER() MemoryBarrier()
+#define ATOMIC_CAS32(ptr, expected, desired) \
+    ((unsigned int)InterlockedCompareExchange((volatile LONG*)(ptr), (LONG)(desired), (LONG)(expected)))
+#define ATOMIC_INC32(ptr) ((unsigned int)InterlockedIncrement((volatile LONG*)(ptr)))
+#else
+#define MEMORY_BARRIER() __sync_synchronize()
+#define ATOMIC_CAS32(ptr, expected, desired) __sync_val_compare_and_swap((ptr), (expected), (desired))
+#define ATOMIC_INC32(ptr) __sync_add_and_fetch((ptr), 1u)
+#endif
+
 // Window dimensions
 int windowWidth = 800;
 int windowHeight = 600;
 
-// Camera rotation angles (degrees) - accumulate rotations
-float cameraAngleX = 0.0f;
-float cameraAngleY = 0.0f;
-
 // Mouse tracking for arcball camera control
 bool isDragging = false;
 int lastMouseX = 0;
@@ -67,7 +116,9 @@ int lastMouseY = 0;
 
 // Debug log file
 FILE* g_logFile = NULL;
-clock_t g_logStartClock = 0; // used to compute relative timestamps
+typedef long long TimeNs;     // monotonic clock reading, nanoseconds
+typedef long long TimeUs;     // durations kept by the speed timer, microseconds
+TimeNs g_logStartNs = 0;      // used to compute relative timestamps
 
 // Rotation sensitivity (adjust for smooth control)
 const float ROTATION_SENSITIVITY = 0.3f;
@@ -79,9 +130,15 @@ const float KEYBOARD_ROTATION_SPEED = 5.0f;
 const float CAMERA_DISTANCE = 8.0f;
 
 // Rubik's Cube constants
-const float PIECE_SIZE = 0.9f;  // Size of each cube piece
+const float PIECE_SIZE = 0.9f;  // Size of each cube piece (3x3x3; scaled by 3/N for other sizes)
 const float GAP_SIZE = 0.1f;    // Gap between pieces
 
+// Cube dimension N (NxNxN)
+const int DEFAULT_CUBE_SIZE = 3;
+const int MIN_CUBE_SIZE = 2;
+const int MAX_CUBE_SIZE = 256;
+const int MAX_SPECIALIZED_CUBE_SIZE = 7;  // 2..7 use precomputed per-size move tables
+
 // Standard Rubik's Cube colors
 // Face indices: 0=Front, 1=Back, 2=Left, 3=Right, 4=Up, 5=Down
 const float COLOR_WHITE[] = {1.0f, 1.0f, 1.0f};   // Up
@@ -92,16 +149,48 @@ const float COLOR_GREEN[] = {0.0f, 1.0f, 0.0f};   // Right
 const float COLOR_BLUE[] = {0.0f, 0.0f, 1.0f};    // Left
 const float COLOR_BLACK[] = {0.1f, 0.1f, 0.1f};   // Hidden faces
 
-// CubePiece structure - represents one piece of the Rubik's Cube
+// Sticker color id -> RGB; a solved face holds the color id equal to its face index
+const float* const STICKER_COLORS[6] = {
+    COLOR_RED, COLOR_ORANGE, COLOR_BLUE, COLOR_GREEN, COLOR_WHITE, COLOR_YELLOW
+};
+
+// CubePiece structure - render-side view of one piece, colors derived from the stickers
 struct CubePiece {
-    int position[3];        // Grid position: x,y,z in {-1, 0, +1}
+    int position[3];        // Grid position: x,y,z in {0..N-1} (Left/Down/Back = 0)
     float colors[6][3];    // 6 faces RGB: [0=Front,1=Back,2=Left,3=Right,4=Up,5=Down]
-    bool isVisible;         // Whether this piece is visible (all pieces visible in Phase 2)
+    bool isVisible;         // Whether this piece is visible
+};
+
+// CubeState structure - sticker-level NxNxN state, the engine's source of truth
+// stickers[(face * n + v) * n + u] holds a color id 0..5 (face-local u,v: see stickerUV())
+// faceRotation[f] is a lazy quarter-turn offset of face f's block: logical (u,v) is read
+// from the slot remapFaceUV() gives, so outer turns on big cubes skip the N x N copy
+// orientation[a] = +-(p + 1): logical axis a (what moves and rendering use) lies along
+// physical storage axis p, so whole-cube rotations only relabel axes
+// zobrist[f] is face block f's share of the state key at lazy offset 0 (see cubeStateKey())
+// and zobristSpin the orbit steps one offset step rotates it by
+// Storage rows / columns of a face block changed since the renderer last looked
+// (empty while maxRow < 0)
+struct StickerDirtyRect {
+    int minRow;
+    int maxRow;
+    int minCol;
+    int maxCol;
 };
 
-// RubikCube structure - contains all 27 pieces
+struct CubeState {
+    int n;
+    std::vector<unsigned char> stickers;
+    unsigned char faceRotation[6];
+    signed char orientation[3];
+    unsigned long long zobrist[6];
+    unsigned char zobristSpin;
+    StickerDirtyRect dirty[6];  // grown by the move paths, cleared by syncStickerTextures()
+};
+
+// RubikCube structure - engine state + render dimensions
 struct RubikCube {
-    CubePiece pieces[27];  // Fixed array 3x3x3 = 27 pieces
+    CubeState state;
     float pieceSize;        // Size of each piece
     float gapSize;         // Gap between pieces
 };
@@ -109,6 +198,7 @@ struct RubikCube {
 
 // Global Rubik's Cube instance
 RubikCube g_rubikCube;
+int g_cubeSize = DEFAULT_CUBE_SIZE;
 
 // Animation state (for future use)
 // Face orientation enum
@@ -122,42 +212,110 @@ enum Face {
 };
 
 const float ROTATION_SPEED_DEG_PER_SEC = 360.0f;
-const int MOVE_QUEUE_CAPACITY = 20;
+const float ANIMATION_MAX_LAG_SEC = 0.4f;        // queued turns speed up to finish within this
+const float ANIMATION_MAX_SPEEDUP = 12.0f;       // ...but never beyond this multiple of the base speed
+const int MAX_CONCURRENT_ANIMATIONS = 4;        // disjoint same-axis turns animating at once
+const int MOVE_QUEUE_CHUNK_SIZE = 64;  // moves per queue chunk; chunks are chained, so the queue never fills
 
-struct RotationAnimation {
-    bool isActive;
+// Every move turns a contiguous range of layers in the direction of its face
+enum MoveKind {
+    MOVE_FACE,      // outer layer only (F, R', U...)
+    MOVE_WIDE,      // depth layers from the face (Rw = 2 layers, 3Rw = 3)
+    MOVE_SLICE,     // every inner layer (M turns like L, E like D, S like F)
+    MOVE_ROTATION   // whole cube (x turns like R, y like U, z like F), a relabeling only
+};
+
+// Single quarter-turn move, as parsed from notation (F, R', Rw, 3Uw, M, x...) or queued
+struct MoveToken {
     Face face;
     bool clockwise;
+    MoveKind kind;
+    int depth;      // layers turned by MOVE_WIDE
+};
+
+// Keyboard arrival time of a move, carried with it until its first visible frame
+struct InputLatencyStamp {
+    TimeNs arrivalNs;       // 0 = not from the keyboard (scramble, script, drag)
+    int queuedBehind;       // moves already waiting in the queue when it arrived
+};
+
+struct RotationAnimation {
+    bool isActive;
+    MoveToken move;
     bool isScrambleMove;
     float currentAngle;
     float targetAngle;
     float speed;
     float displayAngle;
-    int affectedIndices[9];
+    float previousDisplayAngle; // displayAngle one simulation step earlier (frames interpolate)
+    int axis;               // turning axis (0=x, 1=y, 2=z)
+    int quarterTurns;       // clockwise quarter turns about +axis (1, 2 or 3)
+    int moveRepeats;        // times `move` is committed at the end (2 for a merged half turn)
+    int mergedMoves;        // queued quarter turns folded into this animation
+    unsigned char layerMask[MAX_CUBE_SIZE]; // layerMask[c] => pieces with coord c on axis turn (built once per move)
+    int traceId;            // async slice id in the Chrome trace
+    InputLatencyStamp input;
+    TimeNs startNs;         // when the animation began (end of the queue wait)
 };
 
-struct MoveQueue {
-    int moves[MOVE_QUEUE_CAPACITY];
-    bool dirs[MOVE_QUEUE_CAPACITY];
-    bool scrambleFlags[MOVE_QUEUE_CAPACITY];
-    int count;
-    int head;
+struct QueuedMove {
+    MoveToken move;
+    bool isScrambleMove;
+    double enqueuedMs;      // start of the "queued" slice in the Chrome trace
+    InputLatencyStamp input;
+    unsigned int sequence;  // posting order across both queues
+    unsigned int generation; // queue generation it was posted in (older ones were cancelled)
 };
 
-RotationAnimation g_animation = {
-    false,
-    FRONT,
-    true,
-    false,
-    0.0f,
-    90.0f,
-    ROTATION_SPEED_DEG_PER_SEC,
-    0.0f,
-    {-1, -1, -1, -1, -1, -1, -1, -1, -1}
+// Single-producer / single-consumer queue without locks: the producer only writes the
+// tail chunk (entries, then `written`, then `next` once full), the consumer only reads
+// and frees chunks behind it. Barriers order entry writes before their publication.
+struct MoveQueueChunk {
+    QueuedMove entries[MOVE_QUEUE_CHUNK_SIZE];
+    volatile int written;           // entries published by the producer
+    MoveQueueChunk* volatile next;  // linked by the producer once this chunk is full
 };
 
-MoveQueue g_moveQueue = {{0}, {false}, {false}, 0, 0};
-int g_lastTimeMs = 0;
+struct MoveQueue {
+    MoveQueueChunk* head;     // consumer: chunk being drained
+    int read;                 // consumer: next entry in head
+    MoveQueueChunk* tail;     // producer: chunk being filled
+    volatile long produced;   // written only by the producer
+    volatile long consumed;   // written only by the consumer
+    unsigned int generation;  // stamped on the producer's posts; fixed while it runs
+};
+
+// Animation slots: every active slot turns the same axis and their layer masks are
+// disjoint, so the turns commute and each commits on its own when it finishes
+RotationAnimation g_animations[MAX_CONCURRENT_ANIMATIONS];
+int g_activeAnimationCount = 0;
+
+MoveQueue createMoveQueue() {
+    MoveQueueChunk* chunk = new MoveQueueChunk();
+    chunk->written = 0;
+    chunk->next = NULL;
+    MoveQueue queue = {chunk, 0, chunk, 0, 0, 0};
+    return queue;
+}
+
+// One queue per producer thread keeps each one single-producer
+MoveQueue g_moveQueue = createMoveQueue();        // GLUT input, scrambles (main thread)
+MoveQueue g_scriptMoveQueue = createMoveQueue();  // --play script thread
+// Shared posting counter, so the consumer can interleave the two queues in order, and
+// the current generation: cancelAnimationAndQueue() bumps it, after which the consumer
+// drops whatever a producer still posts under the old one and the script thread stops
+volatile unsigned int g_moveSequence = 0;
+volatile unsigned int g_queueGeneration = 0;
+// Fixed-step simulation: idle() runs updateAnimation() in whole steps of real time and
+// the frame is drawn between the last two steps, so playback does not depend on frame rate
+const int SIMULATION_STEPS_PER_SEC = 120;
+const TimeNs SIMULATION_STEP_NS = 1000000000LL / SIMULATION_STEPS_PER_SEC;
+const int MAX_SIMULATION_STEPS_PER_FRAME = 12;   // after a stall, drop anything older (0.1 s)
+TimeNs g_lastFrameNs = 0;
+TimeNs g_simulationLagNs = 0;   // real time not yet simulated (< one step after idle())
+float g_renderAlpha = 1.0f;     // g_simulationLagNs as a fraction of a step
+unsigned long g_simulationStep = 0;  // steps run so far (input recordings are keyed on it)
+unsigned int g_randomSeed = 0;       // srand() seed, so shuffles can be replayed
 bool g_keyHeld[256] = {false};
 
 enum TimerState {
@@ -167,37 +325,48 @@ enum TimerState {
     TIMER_STOPPED
 };
 
+// Times are integer microseconds on the monotonic clock: no float drift in long sessions
 struct SpeedTimer {
     TimerState state;
-    float startTime;
-    float endTime;
+    TimeUs startUs;
+    TimeUs endUs;       // solve time once stopped
     int moveCount;
-    float currentTime;
+    TimeUs currentUs;   // elapsed while running
     float tps;
-    float lastSampleTime;
+    TimeUs lastSampleUs;
 };
 
-SpeedTimer g_timer = {TIMER_IDLE, 0.0f, 0.0f, 0, 0.0f, 0.0f, 0.0f};
+SpeedTimer g_timer = {TIMER_IDLE, 0, 0, 0, 0, 0.0f, 0};
 int g_scrambleMovesPending = 0;
+std::vector<MoveToken> g_lastScramble;  // moves of the current scramble, for the solve log
+bool g_instantMoves = false;  // 'I' / --instant: scrambles and --play scripts apply in one frame, unanimated
+
+void beginSolveRecord();
+void discardSolveRecord();
+void resetMoveHistory();
+void reloadSessionHistory();
 
 void resetTimerState() {
+    discardSolveRecord();
     g_timer.state = TIMER_IDLE;
-    g_timer.startTime = 0.0f;
-    g_timer.endTime = 0.0f;
+    g_timer.startUs = 0;
+    g_timer.endUs = 0;
     g_timer.moveCount = 0;
-    g_timer.currentTime = 0.0f;
+    g_timer.currentUs = 0;
     g_timer.tps = 0.0f;
-    g_timer.lastSampleTime = 0.0f;
+    g_timer.lastSampleUs = 0;
 }
 
 void armTimerForSolve() {
+    beginSolveRecord();
+    resetMoveHistory();
     g_timer.state = TIMER_READY;
-    g_timer.startTime = 0.0f;
-    g_timer.endTime = 0.0f;
+    g_timer.startUs = 0;
+    g_timer.endUs = 0;
     g_timer.moveCount = 0;
-    g_timer.currentTime = 0.0f;
+    g_timer.currentUs = 0;
     g_timer.tps = 0.0f;
-    g_timer.lastSampleTime = 0.0f;
+    g_timer.lastSampleUs = 0;
 }
 
 void handleScrambleMoveCompletion(bool wasScrambleMove) {
@@ -214,10 +383,37 @@ void handleScrambleMoveCompletion(bool wasScrambleMove) {
 Face currentFrontFace = FRONT;
 
 // Dynamic rotation axes based on current front face
-// These are 3D vectors (x, y, z)
+// These are 3D vectors (x, y, z); they only give meaning to the pitch/yaw angles of
+// render-batch jobs now, interactive input turns the quaternion camera directly
 float verticalAxis[3];    // Axis for UP/DOWN rotation
 float horizontalAxis[3];   // Axis for LEFT/RIGHT rotation
 
+// Monotonic clock in nanoseconds (unlike clock(), which is CPU time)
+TimeNs getMonotonicTimeNs() {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    static bool frequencyReady = false;
+    LARGE_INTEGER counter;
+    if (!frequencyReady) {
+        QueryPerformanceFrequency(&frequency);
+        frequencyReady = true;
+    }
+    QueryPerformanceCounter(&counter);
+    // Split so the multiply can't overflow
+    TimeNs seconds = counter.QuadPart / frequency.QuadPart;
+    TimeNs remainder = counter.QuadPart % frequency.QuadPart;
+    return seconds * 1000000000LL + remainder * 1000000000LL / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TimeNs)ts.tv_sec * 1000000000LL + (TimeNs)ts.tv_nsec;
+#endif
+}
+
+TimeUs getMonotonicTimeUs() {
+    return getMonotonicTimeNs() / 1000;
+}
+
 // Initialize log file
 void initLogFile() {
     g_logFile = fopen("rubik_debug.log", "w");
@@ -225,7 +421,7 @@ void initLogFile() {
         std::cerr << "Warning: Cannot open log file rubik_debug.log" << std::endl;
         return;
     }
-    g_logStartClock = clock();
+    g_logStartNs = getMonotonicTimeNs();
     
     // Write header with timestamp
     time_t rawTime;
@@ -243,11 +439,10 @@ void initLogFile() {
 }
 
 double getLogTimestampMs() {
-    if (g_logStartClock == 0) {
+    if (g_logStartNs == 0) {
         return 0.0;
     }
-    clock_t current = clock();
-    return (double)(current - g_logStartClock) * 1000.0 / CLOCKS_PER_SEC;
+    return (double)(getMonotonicTimeNs() - g_logStartNs) / 1000000.0;
 }
 
 // Close log file
@@ -259,6 +454,455 @@ void closeLogFile() {
     }
 }
 
+// ========================================================================
+// Frame-time profiler: per-stage CPU timings, GPU timer query, rolling percentiles
+// ========================================================================
+
+// Set while rendering through the headless (EGL/OSMesa) context instead of a GLUT window
+bool g_headlessActive = false;
+
+typedef void (*GenericGLProc)();
+
+// Post-1.1 GL entry points are not exported by opengl32.dll, load them from the current context
+GenericGLProc loadGLProcAddress(const char* name) {
+#if defined(RUBIK_ENABLE_OSMESA)
+    if (g_headlessActive) {
+        return (GenericGLProc)OSMesaGetProcAddress(name);
+    }
+#elif defined(RUBIK_ENABLE_EGL)
+    if (g_headlessActive) {
+        return (GenericGLProc)eglGetProcAddress(name);
+    }
+#endif
+#ifdef FREEGLUT
+    return (GenericGLProc)glutGetProcAddress(name);
+#else
+    (void)name;
+    return NULL; // no portable loader without freeglut: optional features stay off
+#endif
+}
+
+// GL 1.5 query objects / ARB_timer_query
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+typedef unsigned long long GpuTimeNs;
+typedef void (APIENTRY *ProfGenQueriesProc)(GLsizei n, GLuint* ids);
+typedef void (APIENTRY *ProfBeginQueryProc)(GLenum target, GLuint id);
+typedef void (APIENTRY *ProfEndQueryProc)(GLenum target);
+typedef void (APIENTRY *ProfGetQueryObjectuivProc)(GLuint id, GLenum pname, GLuint* params);
+typedef void (APIENTRY *ProfGetQueryObjectui64vProc)(GLuint id, GLenum pname, GpuTimeNs* params);
+
+enum ProfileStage {
+    PROFILE_FRAME = 0,         // display-to-display interval
+    PROFILE_IDLE,
+    PROFILE_UPDATE_ANIMATION,
+    PROFILE_UPDATE_TIMER,
+    PROFILE_DRAW_CUBE,
+    PROFILE_OVERLAY,
+    PROFILE_SWAP,
+    PROFILE_GPU_DRAW,          // drawRubikCube() on the GPU (timer query)
+    PROFILE_STAGE_COUNT
+};
+
+const int PROFILE_WINDOW = 240;     // rolling window: ~4 s at 60 fps
+const int PROFILE_GPU_QUERIES = 3;  // results are read back a few frames late to avoid stalls
+
+struct StageSamples {
+    float samples[PROFILE_WINDOW];  // milliseconds, ring buffer
+    int count;
+    int head;
+    double totalMs;
+    long totalCount;
+    float maxMs;
+};
+
+struct FrameProfiler {
+    bool overlayVisible;
+    StageSamples stages[PROFILE_STAGE_COUNT];
+    double lastFrameStartMs;
+    bool gpuTimerAvailable;
+    GLuint gpuQueries[PROFILE_GPU_QUERIES];
+    bool gpuQueryPending[PROFILE_GPU_QUERIES];
+    int gpuQueryIndex;
+    ProfGenQueriesProc genQueries;
+    ProfBeginQueryProc beginQuery;
+    ProfEndQueryProc endQuery;
+    ProfGetQueryObjectuivProc getQueryObjectuiv;
+    ProfGetQueryObjectui64vProc getQueryObjectui64v;
+};
+
+FrameProfiler g_profiler;
+
+const char* PROFILE_STAGE_NAMES[PROFILE_STAGE_COUNT] = {
+    "frame", "idle", "updateAnimation", "updateTimer",
+    "drawRubikCube", "timerOverlay", "swapBuffers", "gpu:drawRubikCube"
+};
+
+// Monotonic high-resolution wall clock in milliseconds (profiler and trace timestamps)
+double getHighResTimeMs() {
+    return (double)getMonotonicTimeNs() / 1000000.0;
+}
+
+void resetProfiler() {
+    for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+        StageSamples& stage = g_profiler.stages[s];
+        stage.count = 0;
+        stage.head = 0;
+        stage.totalMs = 0.0;
+        stage.totalCount = 0;
+        stage.maxMs = 0.0f;
+    }
+    g_profiler.lastFrameStartMs = 0.0;
+}
+
+void recordProfileSample(ProfileStage stageId, double elapsedMs) {
+    StageSamples& stage = g_profiler.stages[stageId];
+    int idx = (stage.head + stage.count) % PROFILE_WINDOW;
+    if (stage.count == PROFILE_WINDOW) {
+        idx = stage.head;
+        stage.head = (stage.head + 1) % PROFILE_WINDOW;
+    } else {
+        stage.count++;
+    }
+    stage.samples[idx] = (float)elapsedMs;
+    stage.totalMs += elapsedMs;
+    stage.totalCount++;
+    if ((float)elapsedMs > stage.maxMs) {
+        stage.maxMs = (float)elapsedMs;
+    }
+}
+
+// Percentiles over the rolling window (nearest-rank on a sorted copy, at most PROFILE_WINDOW floats)
+void computeStagePercentiles(const StageSamples& stage, float& p50, float& p95, float& p99) {
+    float sorted[PROFILE_WINDOW];
+    p50 = p95 = p99 = 0.0f;
+    if (stage.count == 0) {
+        return;
+    }
+    for (int i = 0; i < stage.count; i++) {
+        sorted[i] = stage.samples[i];
+    }
+    std::sort(sorted, sorted + stage.count);
+    p50 = sorted[(int)(0.50f * (float)(stage.count - 1) + 0.5f)];
+    p95 = sorted[(int)(0.95f * (float)(stage.count - 1) + 0.5f)];
+    p99 = sorted[(int)(0.99f * (float)(stage.count - 1) + 0.5f)];
+}
+
+// Needs a current GL context; silently leaves GPU timing off when unsupported
+void initGpuTimerQueries() {
+    g_profiler.gpuTimerAvailable = false;
+    g_profiler.gpuQueryIndex = 0;
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int major = 0;
+    int minor = 0;
+    if (version != NULL) {
+        sscanf(version, "%d.%d", &major, &minor);
+    }
+    bool hasTimerQuery = (major > 3 || (major == 3 && minor >= 3)) ||
+        (extensions != NULL && (strstr(extensions, "GL_ARB_timer_query") != NULL ||
+                                strstr(extensions, "GL_EXT_timer_query") != NULL));
+    if (!hasTimerQuery) {
+        return;
+    }
+    g_profiler.genQueries = (ProfGenQueriesProc)loadGLProcAddress("glGenQueries");
+    g_profiler.beginQuery = (ProfBeginQueryProc)loadGLProcAddress("glBeginQuery");
+    g_profiler.endQuery = (ProfEndQueryProc)loadGLProcAddress("glEndQuery");
+    g_profiler.getQueryObjectuiv = (ProfGetQueryObjectuivProc)loadGLProcAddress("glGetQueryObjectuiv");
+    g_profiler.getQueryObjectui64v = (ProfGetQueryObjectui64vProc)loadGLProcAddress("glGetQueryObjectui64v");
+    if (g_profiler.getQueryObjectui64v == NULL) {
+        g_profiler.getQueryObjectui64v = (ProfGetQueryObjectui64vProc)loadGLProcAddress("glGetQueryObjectui64vEXT");
+    }
+    if (g_profiler.genQueries == NULL || g_profiler.beginQuery == NULL || g_profiler.endQuery == NULL ||
+        g_profiler.getQueryObjectuiv == NULL || g_profiler.getQueryObjectui64v == NULL) {
+        return;
+    }
+    g_profiler.genQueries(PROFILE_GPU_QUERIES, g_profiler.gpuQueries);
+    for (int i = 0; i < PROFILE_GPU_QUERIES; i++) {
+        g_profiler.gpuQueryPending[i] = false;
+    }
+    g_profiler.gpuTimerAvailable = true;
+}
+
+// Collect finished GPU timings without blocking, then open the query for this frame
+void beginGpuDrawTiming() {
+    if (!g_profiler.gpuTimerAvailable) {
+        return;
+    }
+    for (int i = 0; i < PROFILE_GPU_QUERIES; i++) {
+        if (!g_profiler.gpuQueryPending[i]) {
+            continue;
+        }
+        GLuint available = 0;
+        g_profiler.getQueryObjectuiv(g_profiler.gpuQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GpuTimeNs elapsedNs = 0;
+            g_profiler.getQueryObjectui64v(g_profiler.gpuQueries[i], GL_QUERY_RESULT, &elapsedNs);
+            recordProfileSample(PROFILE_GPU_DRAW, (double)elapsedNs / 1000000.0);
+            g_profiler.gpuQueryPending[i] = false;
+        }
+    }
+    if (g_profiler.gpuQueryPending[g_profiler.gpuQueryIndex]) {
+        return; // every query still in flight: skip this frame instead of stalling
+    }
+    g_profiler.beginQuery(GL_TIME_ELAPSED, g_profiler.gpuQueries[g_profiler.gpuQueryIndex]);
+    g_profiler.gpuQueryPending[g_profiler.gpuQueryIndex] = true;
+}
+
+void endGpuDrawTiming() {
+    if (!g_profiler.gpuTimerAvailable || !g_profiler.gpuQueryPending[g_profiler.gpuQueryIndex]) {
+        return;
+    }
+    g_profiler.endQuery(GL_TIME_ELAPSED);
+    g_profiler.gpuQueryIndex = (g_profiler.gpuQueryIndex + 1) % PROFILE_GPU_QUERIES;
+}
+
+// Write summary + raw rolling window for offline comparison between builds/machines
+bool dumpProfilerReport(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    time_t rawTime;
+    char timeStr[80];
+    time(&rawTime);
+    strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", localtime(&rawTime));
+    fprintf(file, "# Rubik frame profile %s (window=%d frames, times in ms)\n", timeStr, PROFILE_WINDOW);
+    fprintf(file, "# gpu_timer=%s renderer=%s\n", g_profiler.gpuTimerAvailable ? "yes" : "no",
+            (const char*)glGetString(GL_RENDERER));
+    fprintf(file, "stage,samples,mean,p50,p95,p99,max\n");
+    for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+        const StageSamples& stage = g_profiler.stages[s];
+        float p50, p95, p99;
+        computeStagePercentiles(stage, p50, p95, p99);
+        double mean = stage.totalCount > 0 ? stage.totalMs / (double)stage.totalCount : 0.0;
+        fprintf(file, "%s,%ld,%.4f,%.4f,%.4f,%.4f,%.4f\n", PROFILE_STAGE_NAMES[s],
+                stage.totalCount, mean, p50, p95, p99, stage.maxMs);
+    }
+    fprintf(file, "\n# raw window (oldest first)\n");
+    for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+        const StageSamples& stage = g_profiler.stages[s];
+        fprintf(file, "%s", PROFILE_STAGE_NAMES[s]);
+        for (int i = 0; i < stage.count; i++) {
+            fprintf(file, ",%.4f", stage.samples[(stage.head + i) % PROFILE_WINDOW]);
+        }
+        fprintf(file, "\n");
+    }
+    fclose(file);
+    return true;
+}
+
+// ========================================================================
+// Chrome Trace Event export (chrome://tracing, ui.perfetto.dev)
+// ========================================================================
+
+const size_t TRACE_MAX_EVENTS = 1000000;  // ~60 MB of JSON, stops recording beyond that
+
+// One Trace Event Format record; names/categories must be string literals
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    char phase;          // 'X' complete, 'i' instant, 'b'/'e' async, 'C' counter
+    double tsUs;         // microseconds since recording started (wall clock)
+    double durUs;        // 'X' only
+    int id;              // 'b'/'e' only
+    const char* argName; // optional single integer argument
+    int argValue;
+};
+
+struct TraceRecorder {
+    bool recording;
+    double originMs;
+    int nextId;
+    std::vector<TraceEvent> events;
+    std::string outputPath;
+};
+
+TraceRecorder g_trace = {false, 0.0, 1, std::vector<TraceEvent>(), "rubik_trace.json"};
+
+// Move names for trace slices, indexed [face][clockwise]
+const char* TRACE_MOVE_NAMES[6][2] = {
+    {"F'", "F"}, {"B'", "B"}, {"L'", "L"}, {"R'", "R"}, {"U'", "U"}, {"D'", "D"}
+};
+const char* TRACE_WIDE_MOVE_NAMES[6][2] = {
+    {"Fw'", "Fw"}, {"Bw'", "Bw"}, {"Lw'", "Lw"}, {"Rw'", "Rw"}, {"Uw'", "Uw"}, {"Dw'", "Dw"}
+};
+// Slices and rotations are indexed by the face they turn like (M = L, M' = R, ...)
+const char* TRACE_SLICE_MOVE_NAMES[6][2] = {
+    {"S'", "S"}, {"S", "S'"}, {"M'", "M"}, {"M", "M'"}, {"E", "E'"}, {"E'", "E"}
+};
+const char* TRACE_ROTATION_MOVE_NAMES[6][2] = {
+    {"z'", "z"}, {"z", "z'"}, {"x", "x'"}, {"x'", "x"}, {"y'", "y"}, {"y", "y'"}
+};
+
+// Notation of a move; static strings, so trace events can keep the pointer
+const char* moveNotation(const MoveToken& move) {
+    int dir = move.clockwise ? 1 : 0;
+    switch (move.kind) {
+        case MOVE_WIDE: return TRACE_WIDE_MOVE_NAMES[move.face][dir];
+        case MOVE_SLICE: return TRACE_SLICE_MOVE_NAMES[move.face][dir];
+        case MOVE_ROTATION: return TRACE_ROTATION_MOVE_NAMES[move.face][dir];
+        default: return TRACE_MOVE_NAMES[move.face][dir];
+    }
+}
+
+void traceEmit(const char* name, const char* category, char phase, double startMs, double durMs,
+               int id, const char* argName, int argValue) {
+    if (!g_trace.recording) {
+        return;
+    }
+    if (g_trace.events.size() >= TRACE_MAX_EVENTS) {
+        g_trace.recording = false;
+        if (g_logFile != NULL) {
+            fprintf(g_logFile, "TRACE: event cap %d reached, recording stopped\n", (int)TRACE_MAX_EVENTS);
+            fflush(g_logFile);
+        }
+        return;
+    }
+    TraceEvent ev;
+    ev.name = name;
+    ev.category = category;
+    ev.phase = phase;
+    ev.tsUs = (startMs - g_trace.originMs) * 1000.0;
+    ev.durUs = durMs * 1000.0;
+    ev.id = id;
+    ev.argName = argName;
+    ev.argValue = argValue;
+    g_trace.events.push_back(ev);
+}
+
+void traceComplete(const char* name, const char* category, double startMs, double endMs) {
+    traceEmit(name, category, 'X', startMs, endMs - startMs, 0, NULL, 0);
+}
+
+void traceInstant(const char* name, const char* category, const char* argName, int argValue) {
+    traceEmit(name, category, 'i', getHighResTimeMs(), 0.0, 0, argName, argValue);
+}
+
+void traceCounter(const char* name, int value) {
+    traceEmit(name, "queue", 'C', getHighResTimeMs(), 0.0, 0, "depth", value);
+}
+
+// Async slices may overlap on one thread (queued moves, in-flight animation)
+int traceAsyncBegin(const char* name, const char* category) {
+    if (!g_trace.recording) {
+        return 0;
+    }
+    int id = g_trace.nextId++;
+    traceEmit(name, category, 'b', getHighResTimeMs(), 0.0, id, NULL, 0);
+    return id;
+}
+
+// Async slice with known endpoints, emitted at once (e.g. when a queued move is dequeued)
+void traceAsyncSpan(const char* name, const char* category, double startMs, double endMs) {
+    if (!g_trace.recording) {
+        return;
+    }
+    int id = g_trace.nextId++;
+    traceEmit(name, category, 'b', startMs, 0.0, id, NULL, 0);
+    traceEmit(name, category, 'e', endMs, 0.0, id, NULL, 0);
+}
+
+void traceAsyncEnd(const char* name, const char* category, int id) {
+    if (id != 0) {
+        traceEmit(name, category, 'e', getHighResTimeMs(), 0.0, id, NULL, 0);
+    }
+}
+
+// Emits an 'X' event covering the enclosing C++ scope
+struct TraceScope {
+    const char* name;
+    const char* category;
+    double startMs;
+    TraceScope(const char* scopeName, const char* scopeCategory)
+        : name(scopeName), category(scopeCategory), startMs(g_trace.recording ? getHighResTimeMs() : 0.0) {}
+    ~TraceScope() {
+        if (g_trace.recording) {
+            traceComplete(name, category, startMs, getHighResTimeMs());
+        }
+    }
+};
+
+bool writeTraceFile(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"rubik\"}},\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"glut main loop\"}}");
+    for (size_t i = 0; i < g_trace.events.size(); i++) {
+        const TraceEvent& ev = g_trace.events[i];
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":1,\"ts\":%.3f",
+                ev.name, ev.category, ev.phase, ev.tsUs);
+        if (ev.phase == 'X') {
+            fprintf(file, ",\"dur\":%.3f", ev.durUs);
+        } else if (ev.phase == 'b' || ev.phase == 'e') {
+            fprintf(file, ",\"id\":%d", ev.id);
+        } else if (ev.phase == 'i') {
+            fprintf(file, ",\"s\":\"t\"");
+        }
+        if (ev.argName != NULL) {
+            fprintf(file, ",\"args\":{\"%s\":%d}", ev.argName, ev.argValue);
+        }
+        fprintf(file, "}");
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
+
+void startTraceRecording() {
+    g_trace.events.clear();
+    g_trace.events.reserve(65536);
+    g_trace.originMs = getHighResTimeMs();
+    g_trace.nextId = 1;
+    g_trace.recording = true;
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "TRACE: recording started -> %s\n", g_trace.outputPath.c_str());
+        fflush(g_logFile);
+    }
+}
+
+void stopTraceRecording() {
+    if (!g_trace.recording && g_trace.events.empty()) {
+        return;
+    }
+    g_trace.recording = false;
+    bool ok = writeTraceFile(g_trace.outputPath.c_str());
+    std::cout << (ok ? "Trace written to " : "Error: cannot write trace ") << g_trace.outputPath
+              << " (" << g_trace.events.size() << " events)" << std::endl;
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "TRACE: recording stopped, %d events %s\n", (int)g_trace.events.size(), ok ? "written" : "FAILED");
+        fflush(g_logFile);
+    }
+    g_trace.events.clear();
+}
+
+// glutMainLoop() exits the process directly, so flush an active trace from atexit()
+void flushTraceAtExit() {
+    if (g_trace.recording) {
+        stopTraceRecording();
+    }
+}
+
+// Profiler sample + matching trace slice for one frame phase
+void recordStageTiming(ProfileStage stageId, double startMs, double endMs) {
+    recordProfileSample(stageId, endMs - startMs);
+    traceComplete(PROFILE_STAGE_NAMES[stageId], "frame", startMs, endMs);
+}
+
 // Clamp angle between min and max
 float clampAngle(float angle, float minAngle, float maxAngle) {
     if (angle < minAngle) {
@@ -332,6 +976,133 @@ void rotateVectorAroundAxis(const float axis[3], float angleDegrees,
     z = rz;
 }
 
+// ========================================================================
+// Camera orientation: quaternion arcball
+// ========================================================================
+// The camera is one unit quaternion taking cube space to view space. Drags and arrow
+// keys pre-multiply a small rotation about a screen axis, so there are no unbounded
+// Euler angles to lose precision in, and the result is renormalized every few updates.
+// The view matrix is rebuilt once per change; the revision counter tells cached
+// derived data (the snapped face mapping) that it is stale.
+
+const int CAMERA_RENORMALIZE_INTERVAL = 32;
+
+struct Quaternion {
+    float w;
+    float x;
+    float y;
+    float z;
+};
+
+struct CameraState {
+    Quaternion orientation;
+    float matrix[16];           // column-major rotation for glMultMatrixf
+    int updatesSinceNormalize;
+    unsigned long revision;
+};
+
+CameraState g_camera = {{1.0f, 0.0f, 0.0f, 0.0f},
+                        {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                         0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f},
+                        0, 0};
+
+Quaternion quaternionFromAxisAngle(const float axis[3], float angleDegrees) {
+    float length = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    Quaternion q = {1.0f, 0.0f, 0.0f, 0.0f};
+    if (length < 0.0001f) {
+        return q;
+    }
+    float halfRad = angleDegrees * 3.14159265f / 360.0f;
+    float s = sin(halfRad) / length;
+    q.w = cos(halfRad);
+    q.x = axis[0] * s;
+    q.y = axis[1] * s;
+    q.z = axis[2] * s;
+    return q;
+}
+
+// a * b: rotate by b first, then by a
+Quaternion quaternionMultiply(const Quaternion& a, const Quaternion& b) {
+    Quaternion r;
+    r.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+    r.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+    r.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+    r.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+    return r;
+}
+
+void normalizeQuaternion(Quaternion& q) {
+    float length = sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    if (length < 0.0001f) {
+        q.w = 1.0f;
+        q.x = q.y = q.z = 0.0f;
+        return;
+    }
+    q.w /= length;
+    q.x /= length;
+    q.y /= length;
+    q.z /= length;
+}
+
+// v' = q v q*, expanded: t = 2 (q.xyz x v), v' = v + w t + q.xyz x t
+void rotateVectorByQuaternion(const Quaternion& q, float& x, float& y, float& z) {
+    float tx = 2.0f * (q.y * z - q.z * y);
+    float ty = 2.0f * (q.z * x - q.x * z);
+    float tz = 2.0f * (q.x * y - q.y * x);
+    float rx = x + q.w * tx + (q.y * tz - q.z * ty);
+    float ry = y + q.w * ty + (q.z * tx - q.x * tz);
+    float rz = z + q.w * tz + (q.x * ty - q.y * tx);
+    x = rx;
+    y = ry;
+    z = rz;
+}
+
+void quaternionToMatrix(const Quaternion& q, float m[16]) {
+    m[0] = 1.0f - 2.0f * (q.y * q.y + q.z * q.z);
+    m[1] = 2.0f * (q.x * q.y + q.w * q.z);
+    m[2] = 2.0f * (q.x * q.z - q.w * q.y);
+    m[3] = 0.0f;
+    m[4] = 2.0f * (q.x * q.y - q.w * q.z);
+    m[5] = 1.0f - 2.0f * (q.x * q.x + q.z * q.z);
+    m[6] = 2.0f * (q.y * q.z + q.w * q.x);
+    m[7] = 0.0f;
+    m[8] = 2.0f * (q.x * q.z + q.w * q.y);
+    m[9] = 2.0f * (q.y * q.z - q.w * q.x);
+    m[10] = 1.0f - 2.0f * (q.x * q.x + q.y * q.y);
+    m[11] = 0.0f;
+    m[12] = 0.0f;
+    m[13] = 0.0f;
+    m[14] = 0.0f;
+    m[15] = 1.0f;
+}
+
+void setCameraOrientation(const Quaternion& orientation) {
+    g_camera.orientation = orientation;
+    normalizeQuaternion(g_camera.orientation);
+    g_camera.updatesSinceNormalize = 0;
+    quaternionToMatrix(g_camera.orientation, g_camera.matrix);
+    g_camera.revision++;
+}
+
+// Incremental arcball step about an axis fixed on screen (view space)
+void rotateCamera(const float viewAxis[3], float angleDegrees) {
+    g_camera.orientation = quaternionMultiply(quaternionFromAxisAngle(viewAxis, angleDegrees),
+                                              g_camera.orientation);
+    if (++g_camera.updatesSinceNormalize >= CAMERA_RENORMALIZE_INTERVAL) {
+        normalizeQuaternion(g_camera.orientation);
+        g_camera.updatesSinceNormalize = 0;
+    }
+    quaternionToMatrix(g_camera.orientation, g_camera.matrix);
+    g_camera.revision++;
+}
+
+// Legacy pitch/yaw about the front face's axes (render-batch jobs are described this
+// way): the same rotation display() used to build from two glRotatef calls
+void setCameraFromAngles(float angleX, float angleY) {
+    setCameraOrientation(quaternionMultiply(quaternionFromAxisAngle(horizontalAxis, angleY),
+                                            quaternionFromAxisAngle(verticalAxis, angleX)));
+}
+
 Face getOppositeFace(Face face) {
     switch (face) {
         case FRONT: return BACK;
@@ -351,105 +1122,133 @@ struct ViewFaceMapping {
     Face right;
     Face up;
     Face down;
+    Face relative[6];   // indexed like the face keys: F, U, R, L, D, B
 };
 
 void applyCurrentViewRotation(float& x, float& y, float& z) {
-    // Apply rotations in the same *effect* order as display() to match OpenGL's right-to-left matrix multiply
-    rotateVectorAroundAxis(verticalAxis, cameraAngleX, x, y, z);   // display()'s second glRotate executes first on geometry
-    rotateVectorAroundAxis(horizontalAxis, cameraAngleY, x, y, z); // then yaw around the horizontal axis
-}
-
-void computeViewFaceMapping(ViewFaceMapping& mapping) {
-    const float normals[6][3] = {
-        {0.0f, 0.0f, 1.0f},   // FRONT
-        {0.0f, 0.0f, -1.0f},  // BACK
-        {-1.0f, 0.0f, 0.0f},  // LEFT
-        {1.0f, 0.0f, 0.0f},   // RIGHT
-        {0.0f, 1.0f, 0.0f},   // UP
-        {0.0f, -1.0f, 0.0f}   // DOWN
-    };
-    const Face faces[6] = {FRONT, BACK, LEFT, RIGHT, UP, DOWN};
-    float rotated[6][3];
-    for (int i = 0; i < 6; i++) {
-        rotated[i][0] = normals[i][0];
-        rotated[i][1] = normals[i][1];
-        rotated[i][2] = normals[i][2];
-        applyCurrentViewRotation(rotated[i][0], rotated[i][1], rotated[i][2]);
+    rotateVectorByQuaternion(g_camera.orientation, x, y, z);
+}
+
+// View space back to cube space: rotate by the conjugate
+void applyInverseViewRotation(float& x, float& y, float& z) {
+    Quaternion inverse = g_camera.orientation;
+    inverse.x = -inverse.x;
+    inverse.y = -inverse.y;
+    inverse.z = -inverse.z;
+    rotateVectorByQuaternion(inverse, x, y, z);
+}
+
+// The view always snaps to one of the 24 cube orientations, named by the faces nearest
+// the screen's front and up. Their relative-to-absolute tables are built once; the snap
+// is cached on the camera revision and only redone, on the next face key, after the
+// camera has moved. A keypress is then a single table index.
+const float VIEW_FACE_NORMALS[6][3] = {
+    {0.0f, 0.0f, 1.0f},   // FRONT
+    {0.0f, 0.0f, -1.0f},  // BACK
+    {-1.0f, 0.0f, 0.0f},  // LEFT
+    {1.0f, 0.0f, 0.0f},   // RIGHT
+    {0.0f, 1.0f, 0.0f},   // UP
+    {0.0f, -1.0f, 0.0f}   // DOWN
+};
+
+struct ViewOrientationCache {
+    bool valid;
+    unsigned long revision;
+    const ViewFaceMapping* mapping;
+};
+
+ViewFaceMapping g_viewOrientations[6][6];  // [front][up]; the 24 pairs on different axes are used
+bool g_viewOrientationsBuilt = false;
+ViewOrientationCache g_viewCache = {false, 0, NULL};
+
+void buildViewOrientations() {
+    for (int f = 0; f < 6; f++) {
+        for (int u = 0; u < 6; u++) {
+            if (u / 2 == f / 2) {
+                continue;
+            }
+            // right = up x front keeps the basis right-handed
+            const float* up = VIEW_FACE_NORMALS[u];
+            const float* front = VIEW_FACE_NORMALS[f];
+            const float right[3] = {
+                up[1] * front[2] - up[2] * front[1],
+                up[2] * front[0] - up[0] * front[2],
+                up[0] * front[1] - up[1] * front[0]
+            };
+            int r = 0;
+            while (VIEW_FACE_NORMALS[r][0] != right[0] || VIEW_FACE_NORMALS[r][1] != right[1] ||
+                   VIEW_FACE_NORMALS[r][2] != right[2]) {
+                r++;
+            }
+            ViewFaceMapping& mapping = g_viewOrientations[f][u];
+            mapping.front = static_cast<Face>(f);
+            mapping.back = getOppositeFace(mapping.front);
+            mapping.up = static_cast<Face>(u);
+            mapping.down = getOppositeFace(mapping.up);
+            mapping.right = static_cast<Face>(r);
+            mapping.left = getOppositeFace(mapping.right);
+            const Face relative[6] = {mapping.front, mapping.up, mapping.right, mapping.left, mapping.down, mapping.back};
+            memcpy(mapping.relative, relative, sizeof(relative));
+        }
     }
-    float bestFrontDot = -1000.0f;
-    float bestUpDot = -1000.0f;
+    g_viewOrientationsBuilt = true;
+}
+
+// Snap the camera: bring the screen's front and up back into cube space (two vectors,
+// not six normals) and take the face each one points at most directly
+const ViewFaceMapping& snapViewOrientation() {
+    if (!g_viewOrientationsBuilt) {
+        buildViewOrientations();
+    }
+    float viewFront[3] = {0.0f, 0.0f, 1.0f};
+    float viewUp[3] = {0.0f, 1.0f, 0.0f};
+    applyInverseViewRotation(viewFront[0], viewFront[1], viewFront[2]);
+    applyInverseViewRotation(viewUp[0], viewUp[1], viewUp[2]);
     int frontIdx = 0;
-    int upIdx = 4;
-    const float viewFront[3] = {0.0f, 0.0f, 1.0f};
-    const float viewUp[3] = {0.0f, 1.0f, 0.0f};
+    float bestFrontDot = -1000.0f;
     for (int i = 0; i < 6; i++) {
-        float dotFront = rotated[i][0] * viewFront[0] + rotated[i][1] * viewFront[1] + rotated[i][2] * viewFront[2];
-        if (dotFront > bestFrontDot) {
-            bestFrontDot = dotFront;
+        const float* normal = VIEW_FACE_NORMALS[i];
+        float dot = normal[0] * viewFront[0] + normal[1] * viewFront[1] + normal[2] * viewFront[2];
+        if (dot > bestFrontDot) {
+            bestFrontDot = dot;
             frontIdx = i;
         }
     }
+    int upIdx = 4;
+    float bestUpDot = -1000.0f;
     for (int i = 0; i < 6; i++) {
-        if (i == frontIdx || faces[i] == getOppositeFace(faces[frontIdx])) {
+        if (i / 2 == frontIdx / 2) {
             continue;
         }
-        float dotUp = rotated[i][0] * viewUp[0] + rotated[i][1] * viewUp[1] + rotated[i][2] * viewUp[2];
-        if (dotUp > bestUpDot) {
-            bestUpDot = dotUp;
+        const float* normal = VIEW_FACE_NORMALS[i];
+        float dot = normal[0] * viewUp[0] + normal[1] * viewUp[1] + normal[2] * viewUp[2];
+        if (dot > bestUpDot) {
+            bestUpDot = dot;
             upIdx = i;
         }
     }
-    float frontVec[3] = {rotated[frontIdx][0], rotated[frontIdx][1], rotated[frontIdx][2]};
-    float upVec[3] = {rotated[upIdx][0], rotated[upIdx][1], rotated[upIdx][2]};
-    // Ensure upVec is orthogonal to frontVec
-    float frontDotUp = frontVec[0] * upVec[0] + frontVec[1] * upVec[1] + frontVec[2] * upVec[2];
-    if (fabs(frontDotUp) > 0.9f) {
-        // Choose another candidate for up
-        bestUpDot = -1000.0f;
-        for (int i = 0; i < 6; i++) {
-            if (i == frontIdx || faces[i] == getOppositeFace(faces[frontIdx])) {
-                continue;
-            }
-            float dotUp = rotated[i][0] * viewUp[0] + rotated[i][1] * viewUp[1] + rotated[i][2] * viewUp[2];
-            if (dotUp > bestUpDot && fabs(rotated[i][0] * frontVec[0] + rotated[i][1] * frontVec[1] + rotated[i][2] * frontVec[2]) < 0.1f) {
-                bestUpDot = dotUp;
-                upIdx = i;
-                upVec[0] = rotated[i][0];
-                upVec[1] = rotated[i][1];
-                upVec[2] = rotated[i][2];
-            }
-        }
-    }
-    // Compute right vector via cross product (up × front) to maintain a right-handed basis
-    float rightVec[3];
-    rightVec[0] = upVec[1] * frontVec[2] - upVec[2] * frontVec[1];
-    rightVec[1] = upVec[2] * frontVec[0] - upVec[0] * frontVec[2];
-    rightVec[2] = upVec[0] * frontVec[1] - upVec[1] * frontVec[0];
-    float rightLen = sqrt(rightVec[0] * rightVec[0] + rightVec[1] * rightVec[1] + rightVec[2] * rightVec[2]);
-    if (rightLen > 0.0001f) {
-        rightVec[0] /= rightLen;
-        rightVec[1] /= rightLen;
-        rightVec[2] /= rightLen;
-    } else {
-        rightVec[0] = 1.0f;
-        rightVec[1] = 0.0f;
-        rightVec[2] = 0.0f;
+    return g_viewOrientations[frontIdx][upIdx];
+}
+
+const ViewFaceMapping& currentViewMapping() {
+    if (g_viewCache.valid && g_viewCache.revision == g_camera.revision) {
+        return *g_viewCache.mapping;
     }
-    int rightIdx = 3;
-    float bestRightDot = -1000.0f;
-    for (int i = 0; i < 6; i++) {
-        float dotRight = rotated[i][0] * rightVec[0] + rotated[i][1] * rightVec[1] + rotated[i][2] * rightVec[2];
-        if (dotRight > bestRightDot) {
-            bestRightDot = dotRight;
-            rightIdx = i;
-        }
+    const ViewFaceMapping* previous = g_viewCache.valid ? g_viewCache.mapping : NULL;
+    g_viewCache.mapping = &snapViewOrientation();
+    g_viewCache.valid = true;
+    g_viewCache.revision = g_camera.revision;
+    if (g_viewCache.mapping != previous && g_logFile != NULL) {
+        const char* faceNames[] = {"FRONT", "BACK", "LEFT", "RIGHT", "UP", "DOWN"};
+        fprintf(g_logFile, "VIEW SNAP: front=%s up=%s right=%s camera=(%.3f,%.3f,%.3f,%.3f)\n",
+                faceNames[g_viewCache.mapping->front],
+                faceNames[g_viewCache.mapping->up],
+                faceNames[g_viewCache.mapping->right],
+                g_camera.orientation.w, g_camera.orientation.x,
+                g_camera.orientation.y, g_camera.orientation.z);
+        fflush(g_logFile);
     }
-    mapping.front = faces[frontIdx];
-    mapping.back = getOppositeFace(mapping.front);
-    mapping.up = faces[upIdx];
-    mapping.down = getOppositeFace(mapping.up);
-    mapping.right = faces[rightIdx];
-    mapping.left = getOppositeFace(mapping.right);
+    return *g_viewCache.mapping;
 }
 
 // Update rotation axes based on current front face
@@ -541,1350 +1340,4803 @@ void updateRotationAxes() {
     }
 }
 
-// Rotate around arbitrary axis using glRotatef
-void rotateAroundAxis(const float axis[3], float angle) {
-    // Normalize axis vector
-    float length = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
-    if (length > 0.0001f) {
-        float nx = axis[0] / length;
-        float ny = axis[1] / length;
-        float nz = axis[2] / length;
-        
-        // Apply rotation using glRotatef
-        glRotatef(angle, nx, ny, nz);
-    }
-}
+// Headless replay runs the input handlers without a window: nothing to redraw then
+bool g_headlessReplay = false;
 
-// Reset rotation angles
-void resetRotationAngles() {
-    cameraAngleX = 0.0f;
-    cameraAngleY = 0.0f;
+void requestRedisplay() {
+    if (!g_headlessReplay) {
+        glutPostRedisplay();
+    }
 }
 
 // Forward declarations
 void initRubikCube();
-void rotatePieceOrientation(int pieceIndex, int axis, bool clockwise);
 Face getAbsoluteFace(int relativeFace);
 void rotateFace(int face, bool clockwise);
 void startRotation(Face face, bool clockwise, bool isScrambleMove = false);
+void startMove(const MoveToken& move, bool isScrambleMove = false);
+void beginMoveAnimation(const MoveToken& move, bool isScrambleMove, const InputLatencyStamp* input = NULL);
+void performMove(const MoveToken& move);
+void invalidateStickerTextures();
+void applyMovesInstantly(const std::vector<MoveToken>& moves, const char* source);
+void recordSolveTurn(const MoveToken& move);
+void recordSolvePhase(int phase);
+void finishSolveRecord(TimeUs totalUs);
 void updateAnimation(float deltaTime);
-bool isPieceInAnimation(int pieceIndex);
+bool isAnimationActive();
+bool isPieceInAnimation(const int position[3]);
 float easeInOutCubic(float t);
 void idle();
 void cancelAnimationAndQueue();
+int getMoveQueueCount();
+void keyboard(unsigned char key, int x, int y);
 void keyboardUp(unsigned char key, int x, int y);
+void keyboardSpecial(int key, int x, int y);
+void mouse(int button, int state, int x, int y);
+void motion(int x, int y);
+void reshape(int w, int h);
 void onMoveStarted();
 bool isCubeSolved();
 void updateTimer();
+void stopTimerIfSolved();
 void resetTimerState();
 void armTimerForSolve();
 void handleScrambleMoveCompletion(bool wasScrambleMove);
 void renderBitmapString(float x, float y, void* font, const char* string);
 void displayTimerOverlay();
+void displayProfilerOverlay();
 
-// Convert position (i,j,k) to array index
-// Loop order: k=1,0,-1; j=-1,0,1; i=-1,0,1
-int positionToIndex(int i, int j, int k) {
-    // k=1: indices 0-8, k=0: indices 9-17, k=-1: indices 18-26
-    int kOffset = (k == 1) ? 0 : (k == 0) ? 9 : 18;
-    int jOffset = (j + 1) * 3;
-    int iOffset = (i + 1);
-    return kOffset + jOffset + iOffset;
-}
+// ========================================================================
+// Session statistics: best, mean and WCA trimmed averages over the solve history
+// ========================================================================
+// An aoN drops the fastest and slowest ceil(5%) of the last N solves (1 each for ao5
+// and ao12) and averages the rest. Each window keeps its values split into three
+// ordered sets, trimmed-low / counted / trimmed-high, with a running sum of the
+// counted middle, so adding a solve (and evicting the oldest) is O(log N).
+// Only solves of the current cube size count; changing the size reloads the history.
 
-// Get 9 indices of pieces on a face
-void getFaceIndices(int face, int indices[9]) {
-    int idx = 0;
-    int i, j, k;
-    
-    switch (face) {
-        case FRONT: // Z = 1
-            k = 1;
-            for (j = -1; j <= 1; j++) {
-                for (i = -1; i <= 1; i++) {
-                    indices[idx++] = positionToIndex(i, j, k);
-                }
-            }
-            break;
-            
-        case BACK: // Z = -1
-            k = -1;
-            for (j = -1; j <= 1; j++) {
-                for (i = -1; i <= 1; i++) {
-                    indices[idx++] = positionToIndex(i, j, k);
-                }
-            }
-            break;
-            
-        case LEFT: // X = -1
-            i = -1;
-            for (j = -1; j <= 1; j++) {
-                for (k = 1; k >= -1; k--) {
-                    indices[idx++] = positionToIndex(i, j, k);
-                }
-            }
-            break;
-            
-        case RIGHT: // X = 1
-            i = 1;
-            for (j = -1; j <= 1; j++) {
-                for (k = 1; k >= -1; k--) {
-                    indices[idx++] = positionToIndex(i, j, k);
-                }
-            }
-            break;
-            
-        case UP: // Y = 1
-            j = 1;
-            for (k = 1; k >= -1; k--) {
-                for (i = -1; i <= 1; i++) {
-                    indices[idx++] = positionToIndex(i, j, k);
-                }
-            }
-            break;
-            
-        case DOWN: // Y = -1
-            j = -1;
-            for (k = 1; k >= -1; k--) {
-                for (i = -1; i <= 1; i++) {
-                    indices[idx++] = positionToIndex(i, j, k);
-                }
-            }
-            break;
-    }
-}
+const int STATS_WINDOW_COUNT = 4;
+const int STATS_WINDOW_SIZES[STATS_WINDOW_COUNT] = {5, 12, 100, 1000};
+
+struct TrimmedWindow {
+    int size;
+    int trim;
+    std::deque<TimeUs> order;          // oldest first
+    std::multiset<TimeUs> low;         // the `trim` fastest
+    std::multiset<TimeUs> mid;
+    std::multiset<TimeUs> high;        // the `trim` slowest
+    TimeUs midSum;
+    TimeUs best;                       // best complete average so far, 0 = none yet
+};
+
+struct SessionStats {
+    int cubeSize;                      // solves of other sizes are skipped
+    long solves;
+    TimeUs totalUs;
+    TimeUs bestUs;
+    TrimmedWindow windows[STATS_WINDOW_COUNT];
+};
 
-int encodePositionKey(int x, int y, int z) {
-    return (x + 1) * 9 + (y + 1) * 3 + (z + 1);
+SessionStats g_sessionStats;
+
+void initTrimmedWindow(TrimmedWindow& window, int size) {
+    window.size = size;
+    window.trim = (size * 5 + 99) / 100;
+    window.order.clear();
+    window.low.clear();
+    window.mid.clear();
+    window.high.clear();
+    window.midSum = 0;
+    window.best = 0;
 }
 
-void rotateCoordinates(int axis, int axisSign, bool clockwise,
-                       int x, int y, int z,
-                       int& rx, int& ry, int& rz) {
-    int angleSign = clockwise ? -1 : 1;  // -90 for CW, +90 for CCW when looking along +axis
-    angleSign *= axisSign;               // adjust for faces whose normal points opposite
-    switch (axis) {
-        case 0: // X-axis
-            rx = x;
-            if (angleSign > 0) {
-                ry = -z;
-                rz = y;
-            } else {
-                ry = z;
-                rz = -y;
-            }
-            break;
-        case 1: // Y-axis
-            ry = y;
-            if (angleSign > 0) {
-                rz = -x;
-                rx = z;
-            } else {
-                rz = x;
-                rx = -z;
-            }
-            break;
-        case 2: // Z-axis
-            rz = z;
-            if (angleSign > 0) {
-                rx = -y;
-                ry = x;
-            } else {
-                rx = y;
-                ry = -x;
-            }
-            break;
-        default:
-            rx = x;
-            ry = y;
-            rz = z;
-            break;
+void initSessionStats(int cubeSize) {
+    g_sessionStats.cubeSize = cubeSize;
+    g_sessionStats.solves = 0;
+    g_sessionStats.totalUs = 0;
+    g_sessionStats.bestUs = 0;
+    for (int w = 0; w < STATS_WINDOW_COUNT; w++) {
+        initTrimmedWindow(g_sessionStats.windows[w], STATS_WINDOW_SIZES[w]);
     }
 }
 
-
-// Rotate positions of 9 pieces on a face (clockwise 90°)
-// CRITICAL: Only swap colors, NEVER swap position (position is fixed grid coords)
-// FIXED: Only rotate orientation of pieces that ACTUALLY MOVE (mapping[i] != i)
-void rotatePositions(int face, bool clockwise) {
-    int indices[9];
-    getFaceIndices(face, indices);
-    
-    // Backup ONLY colors (6 faces × 3 RGB per piece)
-    float backupColors[9][6][3];
-    int i, f, c;
-    for (i = 0; i < 9; i++) {
-        for (f = 0; f < 6; f++) {
-            for (c = 0; c < 3; c++) {
-                backupColors[i][f][c] = g_rubikCube.pieces[indices[i]].colors[f][c];
-            }
-        }
+// Restore low <= mid <= high with exactly `trim` values in each outer set
+void rebalanceTrimmedWindow(TrimmedWindow& window) {
+    while ((int)window.low.size() > window.trim) {
+        std::multiset<TimeUs>::iterator it = --window.low.end();
+        window.midSum += *it;
+        window.mid.insert(*it);
+        window.low.erase(it);
     }
-    
-    // Determine rotation axis and sign based on face
-    int rotationAxis;
-    int axisSign = 1;
-    switch (face) {
-        case FRONT:
-        case BACK:
-            rotationAxis = 2;  // Z-axis
-            axisSign = (face == FRONT) ? 1 : -1;
-            break;
-        case LEFT:
-        case RIGHT:
-            rotationAxis = 0;  // X-axis
-            axisSign = (face == RIGHT) ? 1 : -1;
-            break;
-        case UP:
-        case DOWN:
-            rotationAxis = 1;  // Y-axis
-            axisSign = (face == UP) ? 1 : -1;
-            break;
-        default:
-            rotationAxis = 2;  // Default to Z-axis
-            break;
+    while ((int)window.high.size() > window.trim) {
+        std::multiset<TimeUs>::iterator it = window.high.begin();
+        window.midSum += *it;
+        window.mid.insert(*it);
+        window.high.erase(it);
     }
-    
-    // Calculate mapping FIRST to know which pieces actually move
-    int mapping[9];
-    int keyToSlot[27];
-    for (i = 0; i < 27; i++) {
-        keyToSlot[i] = -1;
-    }
-    for (i = 0; i < 9; i++) {
-        const CubePiece& piece = g_rubikCube.pieces[indices[i]];
-        int key = encodePositionKey(piece.position[0], piece.position[1], piece.position[2]);
-        keyToSlot[key] = i;
-    }
-    for (i = 0; i < 9; i++) {
-        const CubePiece& piece = g_rubikCube.pieces[indices[i]];
-        int rx, ry, rz;
-        rotateCoordinates(rotationAxis, axisSign, clockwise,
-                          piece.position[0], piece.position[1], piece.position[2],
-                          rx, ry, rz);
-        int key = encodePositionKey(rx, ry, rz);
-        int destSlot = keyToSlot[key];
-        mapping[destSlot] = i;
-    }
-    
-    // Apply rotation: for each destination, copy SOURCE piece and rotate its orientation
-    // CRITICAL: All pieces except center (slot 4) need orientation rotation when face rotates
-    int j;
-    int srcIdx;
-    float temp[3];
-    
-    for (i = 0; i < 9; i++) {
-        srcIdx = mapping[i];  // Source piece that will move to destination slot i
-        
-        // Copy colors from source to destination
-        for (f = 0; f < 6; f++) {
-            for (c = 0; c < 3; c++) {
-                g_rubikCube.pieces[indices[i]].colors[f][c] = backupColors[srcIdx][f][c];
-            }
-        }
-        
-        // Rotate orientation for all pieces EXCEPT center piece (slot 4)
-        // Even if piece stays in same slot (srcIdx == i), it still rotates with the face
-        if (i != 4) {
-            // Rotate orientation of the DESTINATION piece (which now has SOURCE colors)
-            CubePiece* p = &g_rubikCube.pieces[indices[i]];
-            bool orientationClockwise = clockwise;
-            if (axisSign < 0) {
-                orientationClockwise = !orientationClockwise;
-            }
-            
-            if (orientationClockwise) {
-                if (rotationAxis == 2) {  // Z-axis (FRONT/BACK)
-                    // U→R→D→L→U (clockwise around Z)
-                    for (j = 0; j < 3; j++) temp[j] = p->colors[4][j];
-                    for (j = 0; j < 3; j++) p->colors[4][j] = p->colors[2][j];  // L→U
-                    for (j = 0; j < 3; j++) p->colors[2][j] = p->colors[5][j];  // D→L
-                    for (j = 0; j < 3; j++) p->colors[5][j] = p->colors[3][j];  // R→D
-                    for (j = 0; j < 3; j++) p->colors[3][j] = temp[j];  // U→R
-                } else if (rotationAxis == 0) {  // X-axis (LEFT/RIGHT)
-                    // F→U→B→D→F (clockwise around X)
-                    for (j = 0; j < 3; j++) temp[j] = p->colors[0][j];
-                    for (j = 0; j < 3; j++) p->colors[0][j] = p->colors[5][j];  // D→F
-                    for (j = 0; j < 3; j++) p->colors[5][j] = p->colors[1][j];  // B→D
-                    for (j = 0; j < 3; j++) p->colors[1][j] = p->colors[4][j];  // U→B
-                    for (j = 0; j < 3; j++) p->colors[4][j] = temp[j];  // F→U
-                } else if (rotationAxis == 1) {  // Y-axis (UP/DOWN)
-                    // R→F, B→R, L→B, F→L (clockwise around Y)
-                    for (j = 0; j < 3; j++) temp[j] = p->colors[0][j];
-                    for (j = 0; j < 3; j++) p->colors[0][j] = p->colors[3][j];  // R→F
-                    for (j = 0; j < 3; j++) p->colors[3][j] = p->colors[1][j];  // B→R
-                    for (j = 0; j < 3; j++) p->colors[1][j] = p->colors[2][j];  // L→B
-                    for (j = 0; j < 3; j++) p->colors[2][j] = temp[j];  // F→L
-                }
-            } else {
-                if (rotationAxis == 2) {  // Z-axis (FRONT/BACK)
-                    // U→L→D→R→U (counter-clockwise around Z)
-                    for (j = 0; j < 3; j++) temp[j] = p->colors[4][j];
-                    for (j = 0; j < 3; j++) p->colors[4][j] = p->colors[3][j];  // R→U
-                    for (j = 0; j < 3; j++) p->colors[3][j] = p->colors[5][j];  // D→R
-                    for (j = 0; j < 3; j++) p->colors[5][j] = p->colors[2][j];  // L→D
-                    for (j = 0; j < 3; j++) p->colors[2][j] = temp[j];  // U→L
-                } else if (rotationAxis == 0) {  // X-axis (LEFT/RIGHT)
-                    // F→D→B→U→F (counter-clockwise around X)
-                    for (j = 0; j < 3; j++) temp[j] = p->colors[0][j];
-                    for (j = 0; j < 3; j++) p->colors[0][j] = p->colors[4][j];  // U→F
-                    for (j = 0; j < 3; j++) p->colors[4][j] = p->colors[1][j];  // B→U
-                    for (j = 0; j < 3; j++) p->colors[1][j] = p->colors[5][j];  // D→B
-                    for (j = 0; j < 3; j++) p->colors[5][j] = temp[j];  // F→D
-                } else if (rotationAxis == 1) {  // Y-axis (UP/DOWN)
-                    // L→F, B→L, R→B, F→R (counter-clockwise around Y)
-                    for (j = 0; j < 3; j++) temp[j] = p->colors[0][j];
-                    for (j = 0; j < 3; j++) p->colors[0][j] = p->colors[2][j];  // L→F
-                    for (j = 0; j < 3; j++) p->colors[2][j] = p->colors[1][j];  // B→L
-                    for (j = 0; j < 3; j++) p->colors[1][j] = p->colors[3][j];  // R→B
-                    for (j = 0; j < 3; j++) p->colors[3][j] = temp[j];  // F→R
-                }
-            }
-        }
-        // position[] stays at original grid coords - NEVER MODIFIED
+    while ((int)window.low.size() < window.trim && !window.mid.empty()) {
+        std::multiset<TimeUs>::iterator it = window.mid.begin();
+        window.midSum -= *it;
+        window.low.insert(*it);
+        window.mid.erase(it);
     }
-    
-    // Log rotation
-    if (g_logFile != NULL) {
-        const char* faceNames[] = {"FRONT", "BACK", "LEFT", "RIGHT", "UP", "DOWN"};
-        fprintf(g_logFile, "ROTATE %s %s: colors swapped, positions preserved\n",
-                faceNames[face], clockwise ? "CW" : "CCW");
-        fflush(g_logFile);
+    while ((int)window.high.size() < window.trim && !window.mid.empty()) {
+        std::multiset<TimeUs>::iterator it = --window.mid.end();
+        window.midSum -= *it;
+        window.high.insert(*it);
+        window.mid.erase(it);
     }
 }
 
-// Rotate piece orientation (rotate colors around axis when piece moves)
-// This simulates real Rubik's Cube physics: when piece moves, its colors rotate
-void rotatePieceOrientation(int pieceIndex, int axis, bool clockwise) {
-    CubePiece* p = &g_rubikCube.pieces[pieceIndex];
-    float temp[3];
-    int i;
-    
-    // Face indices: 0=Front, 1=Back, 2=Left, 3=Right, 4=Up, 5=Down
-    if (axis == 2) {  // Z-axis (FRONT/BACK rotation)
-        if (clockwise) {
-            // Clockwise around Z: U(4)→R(3)→D(5)→L(2)→U(4)
-            // Backup U
-            for (i = 0; i < 3; i++) {
-                temp[i] = p->colors[4][i];
-            }
-            // L→U
-            for (i = 0; i < 3; i++) {
-                p->colors[4][i] = p->colors[2][i];
-            }
-            // D→L
-            for (i = 0; i < 3; i++) {
-                p->colors[2][i] = p->colors[5][i];
-            }
-            // R→D
-            for (i = 0; i < 3; i++) {
-                p->colors[5][i] = p->colors[3][i];
-            }
-            // U→R
-            for (i = 0; i < 3; i++) {
-                p->colors[3][i] = temp[i];
-            }
-        } else {
-            // Counter-clockwise around Z: U(4)→L(2)→D(5)→R(3)→U(4)
-            // Backup U
-            for (i = 0; i < 3; i++) {
-                temp[i] = p->colors[4][i];
-            }
-            // R→U
-            for (i = 0; i < 3; i++) {
-                p->colors[4][i] = p->colors[3][i];
-            }
-            // D→R
-            for (i = 0; i < 3; i++) {
-                p->colors[3][i] = p->colors[5][i];
-            }
-            // L→D
-            for (i = 0; i < 3; i++) {
-                p->colors[5][i] = p->colors[2][i];
-            }
-            // U→L
-            for (i = 0; i < 3; i++) {
-                p->colors[2][i] = temp[i];
-            }
-        }
-    } else if (axis == 0) {  // X-axis (LEFT/RIGHT rotation)
-        if (clockwise) {
-            // Clockwise around X: F(0)→U(4)→B(1)→D(5)→F(0)
-            // Backup F
-            for (i = 0; i < 3; i++) {
-                temp[i] = p->colors[0][i];
-            }
-            // D→F
-            for (i = 0; i < 3; i++) {
-                p->colors[0][i] = p->colors[5][i];
-            }
-            // B→D
-            for (i = 0; i < 3; i++) {
-                p->colors[5][i] = p->colors[1][i];
-            }
-            // U→B
-            for (i = 0; i < 3; i++) {
-                p->colors[1][i] = p->colors[4][i];
-            }
-            // F→U
-            for (i = 0; i < 3; i++) {
-                p->colors[4][i] = temp[i];
-            }
-        } else {
-            // Counter-clockwise around X: F(0)→D(5)→B(1)→U(4)→F(0)
-            // Backup F
-            for (i = 0; i < 3; i++) {
-                temp[i] = p->colors[0][i];
-            }
-            // U→F
-            for (i = 0; i < 3; i++) {
-                p->colors[0][i] = p->colors[4][i];
-            }
-            // B→U
-            for (i = 0; i < 3; i++) {
-                p->colors[4][i] = p->colors[1][i];
-            }
-            // D→B
-            for (i = 0; i < 3; i++) {
-                p->colors[1][i] = p->colors[5][i];
-            }
-            // F→D
-            for (i = 0; i < 3; i++) {
-                p->colors[5][i] = temp[i];
-            }
-        }
-    } else if (axis == 1) {  // Y-axis (UP/DOWN rotation)
-        if (clockwise) {
-            // Clockwise around Y: F(0)→R(3)→B(1)→L(2)→F(0)
-            // Backup F
-            for (i = 0; i < 3; i++) {
-                temp[i] = p->colors[0][i];
-            }
-            // L→F
-            for (i = 0; i < 3; i++) {
-                p->colors[0][i] = p->colors[2][i];
-            }
-            // B→L
-            for (i = 0; i < 3; i++) {
-                p->colors[2][i] = p->colors[1][i];
-            }
-            // R→B
-            for (i = 0; i < 3; i++) {
-                p->colors[1][i] = p->colors[3][i];
-            }
-            // F→R
-            for (i = 0; i < 3; i++) {
-                p->colors[3][i] = temp[i];
-            }
+void pushTrimmedWindow(TrimmedWindow& window, TimeUs value) {
+    window.order.push_back(value);
+    if (!window.low.empty() && value < *window.low.rbegin()) {
+        window.low.insert(value);
+    } else if (!window.high.empty() && value > *window.high.begin()) {
+        window.high.insert(value);
+    } else {
+        window.mid.insert(value);
+        window.midSum += value;
+    }
+    if ((int)window.order.size() > window.size) {
+        TimeUs oldest = window.order.front();
+        window.order.pop_front();
+        std::multiset<TimeUs>::iterator it;
+        if (!window.low.empty() && oldest <= *window.low.rbegin()) {
+            window.low.erase(window.low.find(oldest));
+        } else if (!window.high.empty() && oldest >= *window.high.begin()) {
+            window.high.erase(window.high.find(oldest));
         } else {
-            // Counter-clockwise around Y: F(0)→L(2)→B(1)→R(3)→F(0)
-            // Backup F
-            for (i = 0; i < 3; i++) {
-                temp[i] = p->colors[0][i];
-            }
-            // R→F
-            for (i = 0; i < 3; i++) {
-                p->colors[0][i] = p->colors[3][i];
-            }
-            // B→R
-            for (i = 0; i < 3; i++) {
-                p->colors[3][i] = p->colors[1][i];
-            }
-            // L→B
-            for (i = 0; i < 3; i++) {
-                p->colors[1][i] = p->colors[2][i];
-            }
-            // F→L
-            for (i = 0; i < 3; i++) {
-                p->colors[2][i] = temp[i];
-            }
+            window.mid.erase(window.mid.find(oldest));
+            window.midSum -= oldest;
         }
     }
+    rebalanceTrimmedWindow(window);
+    TimeUs average = 0;
+    if ((int)window.order.size() == window.size && !window.mid.empty()) {
+        average = window.midSum / (TimeUs)window.mid.size();
+    }
+    if (average > 0 && (window.best == 0 || average < window.best)) {
+        window.best = average;
+    }
 }
 
-// Rotate colors of pieces on a face
-// Note: Colors are rotated along with positions, so this function is now redundant
-// but kept for future color-only rotations if needed
-void rotateColors(int face, bool clockwise) {
-    // Colors are already rotated in rotatePositions() via memcpy of entire CubePiece
-    // This function is kept for compatibility but does nothing
-    (void)face;
-    (void)clockwise;
+// Current aoN, 0 until N solves exist
+TimeUs currentTrimmedAverage(const TrimmedWindow& window) {
+    if ((int)window.order.size() < window.size || window.mid.empty()) {
+        return 0;
+    }
+    return window.midSum / (TimeUs)window.mid.size();
 }
 
-float easeInOutCubic(float t) {
-    if (t < 0.0f) {
-        t = 0.0f;
-    } else if (t > 1.0f) {
-        t = 1.0f;
+void addSessionSolve(int cubeSize, TimeUs solveUs) {
+    SessionStats& stats = g_sessionStats;
+    if (cubeSize != stats.cubeSize) {
+        return;
     }
-    if (t < 0.5f) {
-        return 4.0f * t * t * t;
+    stats.solves++;
+    stats.totalUs += solveUs;
+    if (stats.bestUs == 0 || solveUs < stats.bestUs) {
+        stats.bestUs = solveUs;
+    }
+    for (int w = 0; w < STATS_WINDOW_COUNT; w++) {
+        pushTrimmedWindow(stats.windows[w], solveUs);
     }
-    float f = (2.0f * t) - 2.0f;
-    return 0.5f * f * f * f + 1.0f;
 }
 
-bool isPieceInAnimation(int pieceIndex) {
-    if (!g_animation.isActive) {
-        return false;
+void logSessionStats() {
+    if (g_logFile == NULL) {
+        return;
     }
-    for (int i = 0; i < 9; i++) {
-        if (g_animation.affectedIndices[i] == pieceIndex) {
-            return true;
-        }
+    const SessionStats& stats = g_sessionStats;
+    fprintf(g_logFile, "STATS: %dx%dx%d, %ld solves, best %.3f, mean %.3f", stats.cubeSize, stats.cubeSize,
+            stats.cubeSize, stats.solves, (double)stats.bestUs / 1000000.0,
+            stats.solves > 0 ? (double)stats.totalUs / (double)stats.solves / 1000000.0 : 0.0);
+    for (int w = 0; w < STATS_WINDOW_COUNT; w++) {
+        fprintf(g_logFile, ", ao%d %.3f (best %.3f)", stats.windows[w].size,
+                (double)currentTrimmedAverage(stats.windows[w]) / 1000000.0,
+                (double)stats.windows[w].best / 1000000.0);
     }
-    return false;
+    fprintf(g_logFile, "\n");
+    fflush(g_logFile);
 }
 
-void cancelAnimationAndQueue() {
-    g_animation.isActive = false;
-    g_animation.isScrambleMove = false;
-    g_animation.currentAngle = 0.0f;
-    g_animation.displayAngle = 0.0f;
-    for (int i = 0; i < 9; i++) {
-        g_animation.affectedIndices[i] = -1;
+// ========================================================================
+// Input-to-motion latency (keypress -> first swapped frame that shows the turn)
+// ========================================================================
+// keyboard() stamps g_inputArrivalNs for the duration of the handler; startMove() copies
+// it onto the move, queued or not. display() picks up animations whose drawn angle has
+// left zero (or that finished unseen), and glutSwapBuffers() closes the sample.
+
+const int LATENCY_BUCKETS = 12;         // < 1, 2, 4 ... 1024 ms, then everything slower
+const int LATENCY_MAX_PENDING = 4096;   // samples waiting for a swap (none come headless); more are dropped
+
+enum LatencyMetric {
+    LATENCY_QUEUE_WAIT = 0,   // keypress -> animation start
+    LATENCY_FIRST_FRAME,      // animation start -> swap of the first frame showing motion
+    LATENCY_TOTAL,            // keypress -> that swap
+    LATENCY_METRIC_COUNT
+};
+
+const char* LATENCY_METRIC_NAMES[LATENCY_METRIC_COUNT] = {"queueWait", "firstFrame", "total"};
+
+struct LatencyHistogram {
+    long buckets[LATENCY_BUCKETS];
+    long count;
+    double totalMs;
+    double maxMs;
+};
+
+struct LatencySample {
+    InputLatencyStamp input;
+    TimeNs startNs;
+    const char* name;
+};
+
+struct LatencyStats {
+    LatencyHistogram metrics[LATENCY_METRIC_COUNT];
+    long backlogged;          // inputs that arrived behind queued moves
+    long dropped;             // samples lost because LATENCY_MAX_PENDING were already waiting
+    std::vector<LatencySample> pending;  // waiting for the swap of their first frame
+};
+
+LatencyStats g_latency;
+TimeNs g_inputArrivalNs = 0;
+
+// Marks the moves started while a keyboard handler runs (like TraceScope, one per handler)
+struct InputArrivalScope {
+    InputArrivalScope() {
+        g_inputArrivalNs = getMonotonicTimeNs();
     }
-    g_moveQueue.count = 0;
-    g_moveQueue.head = 0;
-    for (int i = 0; i < MOVE_QUEUE_CAPACITY; i++) {
-        g_moveQueue.scrambleFlags[i] = false;
+    ~InputArrivalScope() {
+        g_inputArrivalNs = 0;
     }
+};
+
+InputLatencyStamp currentInputStamp() {
+    InputLatencyStamp stamp = {g_inputArrivalNs, g_inputArrivalNs != 0 ? getMoveQueueCount() : 0};
+    return stamp;
 }
 
-bool dequeueQueuedMove(Face& face, bool& clockwise, bool& isScrambleMove) {
-    if (g_moveQueue.count == 0) {
-        return false;
+void addLatencySample(LatencyMetric metric, double ms) {
+    LatencyHistogram& histogram = g_latency.metrics[metric];
+    int bucket = 0;
+    double limit = 1.0;
+    while (bucket < LATENCY_BUCKETS - 1 && ms >= limit) {
+        bucket++;
+        limit *= 2.0;
     }
-    int idx = g_moveQueue.head;
-    face = static_cast<Face>(g_moveQueue.moves[idx]);
-    clockwise = g_moveQueue.dirs[idx];
-    isScrambleMove = g_moveQueue.scrambleFlags[idx];
-    g_moveQueue.scrambleFlags[idx] = false;
-    g_moveQueue.head = (g_moveQueue.head + 1) % MOVE_QUEUE_CAPACITY;
-    g_moveQueue.count--;
-    if (g_moveQueue.count == 0) {
-        g_moveQueue.head = 0;
+    histogram.buckets[bucket]++;
+    histogram.count++;
+    histogram.totalMs += ms;
+    if (ms > histogram.maxMs) {
+        histogram.maxMs = ms;
     }
-    return true;
 }
 
-void startRotation(Face face, bool clockwise, bool isScrambleMove) {
-    if (face < FRONT || face > DOWN) {
-        return;
-    }
-    if (g_animation.isActive) {
-        if (g_moveQueue.count >= MOVE_QUEUE_CAPACITY) {
-            if (g_logFile != NULL) {
-                const char* faceNames[] = {"FRONT", "BACK", "LEFT", "RIGHT", "UP", "DOWN"};
-                double tsMs = getLogTimestampMs();
-                fprintf(g_logFile, "[%010.3f ms] QUEUE FULL: drop %s %s\n",
-                        tsMs,
-                        faceNames[face],
-                        clockwise ? "CW" : "CCW");
-                fflush(g_logFile);
-            }
-        } else {
-            int idx = (g_moveQueue.head + g_moveQueue.count) % MOVE_QUEUE_CAPACITY;
-            g_moveQueue.moves[idx] = static_cast<int>(face);
-            g_moveQueue.dirs[idx] = clockwise;
-            g_moveQueue.scrambleFlags[idx] = isScrambleMove;
-            g_moveQueue.count++;
-            if (g_logFile != NULL) {
-                const char* faceNames[] = {"FRONT", "BACK", "LEFT", "RIGHT", "UP", "DOWN"};
-                double tsMs = getLogTimestampMs();
-                fprintf(g_logFile, "[%010.3f ms] ANIM QUEUED %s %s | queue=%d\n",
-                        tsMs,
-                        faceNames[face],
-                        clockwise ? "CW" : "CCW",
-                        g_moveQueue.count);
-                fflush(g_logFile);
-            }
-        }
+// A stamped animation is on screen from the next swap (or was committed before any frame
+// drew it); clears the stamp so each input is sampled once
+void markLatencyMotion(RotationAnimation& animation) {
+    if (animation.input.arrivalNs == 0) {
         return;
     }
-    onMoveStarted();
-    g_animation.isActive = true;
-    g_animation.face = face;
-    g_animation.clockwise = clockwise;
-    g_animation.isScrambleMove = isScrambleMove;
-    g_animation.currentAngle = 0.0f;
-    g_animation.displayAngle = 0.0f;
-    g_animation.targetAngle = 90.0f;
-    g_animation.speed = ROTATION_SPEED_DEG_PER_SEC;
-    getFaceIndices(face, g_animation.affectedIndices);
-    if (g_logFile != NULL) {
-        const char* faceNames[] = {"FRONT", "BACK", "LEFT", "RIGHT", "UP", "DOWN"};
-        double tsMs = getLogTimestampMs();
-        fprintf(g_logFile, "[%010.3f ms] ANIM START %s %s | queue=%d\n",
-                tsMs,
-                faceNames[face],
-                clockwise ? "CW" : "CCW",
-                g_moveQueue.count);
-        fflush(g_logFile);
+    if ((int)g_latency.pending.size() < LATENCY_MAX_PENDING) {
+        LatencySample sample = {animation.input, animation.startNs, moveNotation(animation.move)};
+        g_latency.pending.push_back(sample);
+    } else {
+        g_latency.dropped++;
     }
-    glutPostRedisplay();
+    animation.input.arrivalNs = 0;
 }
 
-void updateAnimation(float deltaTime) {
-    if (!g_animation.isActive) {
-        return;
-    }
-    g_animation.currentAngle += g_animation.speed * deltaTime;
-    if (g_animation.currentAngle > g_animation.targetAngle) {
-        g_animation.currentAngle = g_animation.targetAngle;
-    }
-    float progress = (g_animation.targetAngle > 0.0f)
-        ? (g_animation.currentAngle / g_animation.targetAngle)
-        : 1.0f;
-    if (progress > 1.0f) {
-        progress = 1.0f;
-    }
-    g_animation.displayAngle = easeInOutCubic(progress) * g_animation.targetAngle;
-    if (g_animation.currentAngle >= g_animation.targetAngle - 0.0001f) {
-        Face finishedFace = g_animation.face;
-        bool finishedDir = g_animation.clockwise;
-        bool finishedWasScramble = g_animation.isScrambleMove;
-        rotateFace(finishedFace, finishedDir);
-        g_animation.isActive = false;
-        g_animation.isScrambleMove = false;
-        g_animation.currentAngle = 0.0f;
-        g_animation.displayAngle = 0.0f;
-        for (int i = 0; i < 9; i++) {
-            g_animation.affectedIndices[i] = -1;
+// Right after glutSwapBuffers(): close every sample that frame showed
+void recordLatencyFrame(TimeNs swapNs) {
+    for (size_t i = 0; i < g_latency.pending.size(); i++) {
+        const LatencySample& sample = g_latency.pending[i];
+        double waitMs = (double)(sample.startNs - sample.input.arrivalNs) / 1000000.0;
+        double frameMs = (double)(swapNs - sample.startNs) / 1000000.0;
+        double totalMs = (double)(swapNs - sample.input.arrivalNs) / 1000000.0;
+        addLatencySample(LATENCY_QUEUE_WAIT, waitMs);
+        addLatencySample(LATENCY_FIRST_FRAME, frameMs);
+        addLatencySample(LATENCY_TOTAL, totalMs);
+        if (sample.input.queuedBehind > 0) {
+            g_latency.backlogged++;
         }
         if (g_logFile != NULL) {
-            const char* faceNames[] = {"FRONT", "BACK", "LEFT", "RIGHT", "UP", "DOWN"};
-            double tsMs = getLogTimestampMs();
-            fprintf(g_logFile, "[%010.3f ms] ANIM END %s %s | queue=%d\n",
-                    tsMs,
-                    faceNames[finishedFace],
-                    finishedDir ? "CW" : "CCW",
-                    g_moveQueue.count);
-            fflush(g_logFile);
-        }
-        handleScrambleMoveCompletion(finishedWasScramble);
-        Face nextFace;
-        bool nextDir;
-        bool nextIsScramble = false;
-        if (dequeueQueuedMove(nextFace, nextDir, nextIsScramble)) {
-            startRotation(nextFace, nextDir, nextIsScramble);
+            fprintf(g_logFile, "[%010.3f ms] LATENCY %s: wait=%.2f frame=%.2f total=%.2f ms",
+                    getLogTimestampMs(), sample.name, waitMs, frameMs, totalMs);
+            if (sample.input.queuedBehind > 0) {
+                fprintf(g_logFile, " | BACKLOG: arrived behind %d queued moves", sample.input.queuedBehind);
+            }
+            fprintf(g_logFile, "\n");
         }
     }
-    glutPostRedisplay();
+    if (!g_latency.pending.empty() && g_logFile != NULL) {
+        fflush(g_logFile);
+    }
+    g_latency.pending.clear();
 }
 
-void onMoveStarted() {
-    if (g_timer.state == TIMER_READY) {
-        g_timer.state = TIMER_RUNNING;
-        g_timer.startTime = (float)glutGet(GLUT_ELAPSED_TIME) / 1000.0f;
-        g_timer.lastSampleTime = g_timer.startTime;
-        g_timer.moveCount = 0;
-        g_timer.currentTime = 0.0f;
-        g_timer.tps = 0.0f;
-        if (g_logFile != NULL) {
-            fprintf(g_logFile, "TIMER STARTED\n");
-            fflush(g_logFile);
+bool dumpLatencyReport(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "# Input-to-motion latency (ms), %ld of %ld inputs arrived behind queued moves, "
+            "%ld more dropped (no frame swapped for %d waiting samples)\n",
+            g_latency.backlogged, g_latency.metrics[LATENCY_TOTAL].count, g_latency.dropped, LATENCY_MAX_PENDING);
+    fprintf(file, "metric,samples,mean,max");
+    double limit = 1.0;
+    for (int b = 0; b < LATENCY_BUCKETS - 1; b++) {
+        fprintf(file, ",<%g", limit);
+        limit *= 2.0;
+    }
+    fprintf(file, ",>=%g\n", limit / 2.0);
+    for (int m = 0; m < LATENCY_METRIC_COUNT; m++) {
+        const LatencyHistogram& histogram = g_latency.metrics[m];
+        fprintf(file, "%s,%ld,%.3f,%.3f", LATENCY_METRIC_NAMES[m], histogram.count,
+                histogram.count > 0 ? histogram.totalMs / (double)histogram.count : 0.0, histogram.maxMs);
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            fprintf(file, ",%ld", histogram.buckets[b]);
         }
+        fprintf(file, "\n");
     }
-    if (g_timer.state == TIMER_RUNNING) {
-        g_timer.moveCount++;
+    fclose(file);
+    return true;
+}
+
+// ========================================================================
+// Worker pool (splits the sticker work of big-cube moves across threads)
+// ========================================================================
+// Persistent workers woken per dispatch; chunk i runs on worker i % (threads + 1), where
+// the last slot is the calling thread. Started lazily by the first big enough move.
+
+const int MAX_WORKER_THREADS = 15;       // plus the calling thread
+const int RING_TILE_ORBITS = 64;         // ring chunks are tiles of this many layers x orbits
+const int PARALLEL_MIN_ORBITS = 32768;   // below this a move runs serially (dispatch ~20 us)
+
+typedef void (*ParallelTask)(void* context, int chunk);
+
+struct WorkerPool {
+    bool started;
+    bool shutdown;
+    int threadCount;
+    ParallelTask task;
+    void* context;
+    int chunkCount;
+#ifdef _WIN32
+    HANDLE threads[MAX_WORKER_THREADS];
+    HANDLE wakeEvents[MAX_WORKER_THREADS];
+    HANDLE doneEvent;
+    volatile LONG busy;
+#else
+    pthread_t threads[MAX_WORKER_THREADS];
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    unsigned int generation;
+    int busy;
+#endif
+};
+
+WorkerPool g_workerPool;
+int g_workerIds[MAX_WORKER_THREADS];
+int g_workerThreadRequest = -1;  // --threads N (total, including the caller); -1 = one per hardware thread
+
+int getHardwareThreadCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+void runWorkerChunks(const WorkerPool& pool, int worker) {
+    const int stride = pool.threadCount + 1;
+    for (int chunk = worker; chunk < pool.chunkCount; chunk += stride) {
+        pool.task(pool.context, chunk);
     }
 }
 
-bool isCubeSolved() {
-    const float tolerance = 0.05f;
-    int indices[9];
-    for (int face = 0; face < 6; face++) {
-        getFaceIndices(face, indices);
-        const float* centerColor = g_rubikCube.pieces[indices[4]].colors[face];
-        for (int i = 0; i < 9; i++) {
-            const float* sticker = g_rubikCube.pieces[indices[i]].colors[face];
-            float diff = fabs(sticker[0] - centerColor[0]) +
-                        fabs(sticker[1] - centerColor[1]) +
-                        fabs(sticker[2] - centerColor[2]);
-            if (diff > tolerance) {
-                return false;
-            }
+#ifdef _WIN32
+DWORD WINAPI workerThreadMain(LPVOID param) {
+    const int id = *(int*)param;
+    for (;;) {
+        WaitForSingleObject(g_workerPool.wakeEvents[id], INFINITE);
+        if (g_workerPool.shutdown) {
+            return 0;
+        }
+        runWorkerChunks(g_workerPool, id);
+        if (InterlockedDecrement(&g_workerPool.busy) == 0) {
+            SetEvent(g_workerPool.doneEvent);
         }
     }
-    return true;
 }
+#else
+void* workerThreadMain(void* param) {
+    const int id = *(int*)param;
+    unsigned int seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&g_workerPool.mutex);
+        while (!g_workerPool.shutdown && g_workerPool.generation == seen) {
+            pthread_cond_wait(&g_workerPool.wake, &g_workerPool.mutex);
+        }
+        if (g_workerPool.shutdown) {
+            pthread_mutex_unlock(&g_workerPool.mutex);
+            return NULL;
+        }
+        seen = g_workerPool.generation;
+        pthread_mutex_unlock(&g_workerPool.mutex);
+        runWorkerChunks(g_workerPool, id);
+        pthread_mutex_lock(&g_workerPool.mutex);
+        if (--g_workerPool.busy == 0) {
+            pthread_cond_signal(&g_workerPool.done);
+        }
+        pthread_mutex_unlock(&g_workerPool.mutex);
+    }
+}
+#endif
 
-void updateTimer() {
-    if (g_timer.state != TIMER_RUNNING) {
+void stopWorkerPool() {
+    if (!g_workerPool.started) {
         return;
     }
-    float now = (float)glutGet(GLUT_ELAPSED_TIME) / 1000.0f;
-    g_timer.currentTime = now - g_timer.startTime;
-    g_timer.lastSampleTime = now;
-    if (g_timer.currentTime < 0.0f) {
-        g_timer.currentTime = 0.0f;
+#ifdef _WIN32
+    g_workerPool.shutdown = true;
+    for (int i = 0; i < g_workerPool.threadCount; i++) {
+        SetEvent(g_workerPool.wakeEvents[i]);
     }
-    if (g_timer.currentTime > 0.0f) {
-        g_timer.tps = (float)g_timer.moveCount / g_timer.currentTime;
+    for (int i = 0; i < g_workerPool.threadCount; i++) {
+        WaitForSingleObject(g_workerPool.threads[i], INFINITE);
+        CloseHandle(g_workerPool.threads[i]);
+        CloseHandle(g_workerPool.wakeEvents[i]);
     }
-    if (!g_animation.isActive && isCubeSolved()) {
-        g_timer.state = TIMER_STOPPED;
-        g_timer.endTime = g_timer.currentTime;
-        if (g_logFile != NULL) {
-            fprintf(g_logFile, "========================================\n");
-            fprintf(g_logFile, "CUBE SOLVED!\n");
-            fprintf(g_logFile, "Time: %.2f seconds\n", g_timer.endTime);
-            fprintf(g_logFile, "Moves: %d\n", g_timer.moveCount);
-            fprintf(g_logFile, "TPS: %.2f\n", g_timer.tps);
-            fprintf(g_logFile, "========================================\n");
-            fflush(g_logFile);
-        }
+    CloseHandle(g_workerPool.doneEvent);
+#else
+    pthread_mutex_lock(&g_workerPool.mutex);
+    g_workerPool.shutdown = true;
+    pthread_cond_broadcast(&g_workerPool.wake);
+    pthread_mutex_unlock(&g_workerPool.mutex);
+    for (int i = 0; i < g_workerPool.threadCount; i++) {
+        pthread_join(g_workerPool.threads[i], NULL);
     }
-    glutPostRedisplay();
-}
-
-void idle() {
-    int currentTime = glutGet(GLUT_ELAPSED_TIME);
-    if (g_lastTimeMs == 0) {
-        g_lastTimeMs = currentTime;
-    }
-    float deltaTime = (float)(currentTime - g_lastTimeMs) / 1000.0f;
-    if (deltaTime > 0.1f) {
-        deltaTime = 0.1f;
-    } else if (deltaTime < 0.0f) {
-        deltaTime = 0.0f;
-    }
-    g_lastTimeMs = currentTime;
-    updateAnimation(deltaTime);
-    updateTimer();
-}
-
-bool performRelativeFaceTurn(int relativeFace, bool clockwise) {
-    Face absoluteFace = getAbsoluteFace(relativeFace);
-    startRotation(absoluteFace, clockwise);
-    return true;
+    pthread_mutex_destroy(&g_workerPool.mutex);
+    pthread_cond_destroy(&g_workerPool.wake);
+    pthread_cond_destroy(&g_workerPool.done);
+#endif
+    g_workerPool.started = false;
 }
 
-// Convert relative face (F/U/R/L/D/B) to absolute face based on current front face
-// Relative faces: F=Front, U=Up, R=Right, L=Left, D=Down, B=Back (relative to current view)
-Face getAbsoluteFace(int relativeFace) {
-    ViewFaceMapping mapping;
-    computeViewFaceMapping(mapping);
-    Face selected = mapping.front;
-    switch (relativeFace) {
-        case 0: selected = mapping.front; break;
-        case 1: selected = mapping.up; break;
-        case 2: selected = mapping.right; break;
-        case 3: selected = mapping.left; break;
-        case 4: selected = mapping.down; break;
-        case 5: selected = mapping.back; break;
-        default: selected = mapping.front; break;
+// One worker per extra hardware thread; on a single core the pool stays empty (serial)
+void startWorkerPool() {
+    if (g_workerPool.started) {
+        return;
+    }
+    int count = (g_workerThreadRequest > 0 ? g_workerThreadRequest : getHardwareThreadCount()) - 1;
+    if (count > MAX_WORKER_THREADS) {
+        count = MAX_WORKER_THREADS;
+    }
+    if (count < 0) {
+        count = 0;
+    }
+    g_workerPool.shutdown = false;
+    g_workerPool.threadCount = 0;
+    g_workerPool.chunkCount = 0;
+#ifdef _WIN32
+    g_workerPool.doneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    for (int i = 0; i < count; i++) {
+        g_workerIds[i] = i;
+        g_workerPool.wakeEvents[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+        g_workerPool.threads[i] = CreateThread(NULL, 0, workerThreadMain, &g_workerIds[i], 0, NULL);
+        if (g_workerPool.threads[i] == NULL) {
+            CloseHandle(g_workerPool.wakeEvents[i]);
+            break;
+        }
+        g_workerPool.threadCount++;
+    }
+#else
+    pthread_mutex_init(&g_workerPool.mutex, NULL);
+    pthread_cond_init(&g_workerPool.wake, NULL);
+    pthread_cond_init(&g_workerPool.done, NULL);
+    g_workerPool.generation = 0;
+    g_workerPool.busy = 0;
+    for (int i = 0; i < count; i++) {
+        g_workerIds[i] = i;
+        if (pthread_create(&g_workerPool.threads[i], NULL, workerThreadMain, &g_workerIds[i]) != 0) {
+            break;
+        }
+        g_workerPool.threadCount++;
     }
+#endif
+    g_workerPool.started = true;
+    atexit(stopWorkerPool);
     if (g_logFile != NULL) {
-        const char* faceNames[] = {"FRONT", "BACK", "LEFT", "RIGHT", "UP", "DOWN"};
-        double tsMs = getLogTimestampMs();
-        fprintf(g_logFile,
-            "[%010.3f ms] REL FACE %d -> %s (front=%s up=%s right=%s) angles(X=%.1f,Y=%.1f)\n",
-            tsMs,
-            relativeFace,
-            faceNames[selected],
-            faceNames[mapping.front],
-            faceNames[mapping.up],
-            faceNames[mapping.right],
-            cameraAngleX,
-            cameraAngleY);
+        fprintf(g_logFile, "WORKER POOL: %d worker threads + caller\n", g_workerPool.threadCount);
         fflush(g_logFile);
     }
-    return selected;
 }
 
-// Main face rotation function
-void rotateFace(int face, bool clockwise) {
-    int indices[9];
-    getFaceIndices(face, indices);
-    
-    // Rotate positions (this also rotates colors since we swap entire CubePiece)
-    rotatePositions(face, clockwise);
-    
-    // Log rotation with piece details
-    if (g_logFile != NULL) {
-        const char* faceNames[] = {"FRONT", "BACK", "LEFT", "RIGHT", "UP", "DOWN"};
-        double tsMs = getLogTimestampMs();
-        fprintf(g_logFile, "[%010.3f ms] ROTATE %s %s: pieces [%d,%d,%d,%d,%d,%d,%d,%d,%d]\n", 
-            tsMs,
-            faceNames[face], clockwise ? "CW" : "CCW",
-            indices[0], indices[1], indices[2], indices[3], indices[4],
-            indices[5], indices[6], indices[7], indices[8]);
-        
-        // Log first piece colors after rotation
-        CubePiece& p = g_rubikCube.pieces[indices[0]];
-        fprintf(g_logFile, "[%010.3f ms] Piece %d AFTER: F=[%.1f,%.1f,%.1f] B=[%.1f,%.1f,%.1f] L=[%.1f,%.1f,%.1f] R=[%.1f,%.1f,%.1f] U=[%.1f,%.1f,%.1f] D=[%.1f,%.1f,%.1f]\n",
-            tsMs,
-                indices[0],
-                p.colors[0][0], p.colors[0][1], p.colors[0][2],
-                p.colors[1][0], p.colors[1][1], p.colors[1][2],
-                p.colors[2][0], p.colors[2][1], p.colors[2][2],
-                p.colors[3][0], p.colors[3][1], p.colors[3][2],
-                p.colors[4][0], p.colors[4][1], p.colors[4][2],
-                p.colors[5][0], p.colors[5][1], p.colors[5][2]);
-        fflush(g_logFile);
+// Run task(context, 0..chunkCount-1) on the pool and the calling thread; returns when all are done
+void parallelFor(ParallelTask task, void* context, int chunkCount) {
+    startWorkerPool();
+    if (g_workerPool.threadCount == 0 || chunkCount <= 1) {
+        for (int chunk = 0; chunk < chunkCount; chunk++) {
+            task(context, chunk);
+        }
+        return;
+    }
+    g_workerPool.task = task;
+    g_workerPool.context = context;
+    g_workerPool.chunkCount = chunkCount;
+#ifdef _WIN32
+    g_workerPool.busy = g_workerPool.threadCount;
+    for (int i = 0; i < g_workerPool.threadCount; i++) {
+        SetEvent(g_workerPool.wakeEvents[i]);
     }
+    runWorkerChunks(g_workerPool, g_workerPool.threadCount);
+    WaitForSingleObject(g_workerPool.doneEvent, INFINITE);
+#else
+    pthread_mutex_lock(&g_workerPool.mutex);
+    g_workerPool.busy = g_workerPool.threadCount;
+    g_workerPool.generation++;
+    pthread_cond_broadcast(&g_workerPool.wake);
+    pthread_mutex_unlock(&g_workerPool.mutex);
+    runWorkerChunks(g_workerPool, g_workerPool.threadCount);
+    pthread_mutex_lock(&g_workerPool.mutex);
+    while (g_workerPool.busy > 0) {
+        pthread_cond_wait(&g_workerPool.done, &g_workerPool.mutex);
+    }
+    pthread_mutex_unlock(&g_workerPool.mutex);
+#endif
 }
 
-// Reset cube to solved state
-void resetCube() {
-    cancelAnimationAndQueue();
-    initRubikCube();
-    g_scrambleMovesPending = 0;
-    resetTimerState();
-    if (g_logFile != NULL) {
-        fprintf(g_logFile, "RESET: Cube to solved state\n");
-        fflush(g_logFile);
+// ========================================================================
+// NxNxN sticker engine
+// ========================================================================
+// Grid coordinates x,y,z run 0..N-1 from Left/Down/Back to Right/Up/Front.
+// A layer turn is (axis, layer, quarterTurns) with quarter turns clockwise as
+// seen from the +axis side, i.e. the direction of R, U and F.
+
+// Outward normal of each face, indexed by Face
+const int FACE_NORMALS[6][3] = {
+    {0, 0, 1},   // FRONT
+    {0, 0, -1},  // BACK
+    {-1, 0, 0},  // LEFT
+    {1, 0, 0},   // RIGHT
+    {0, 1, 0},   // UP
+    {0, -1, 0}   // DOWN
+};
+
+Face faceFromAxis(int axis, int sign) {
+    switch (axis) {
+        case 0: return sign > 0 ? RIGHT : LEFT;
+        case 1: return sign > 0 ? UP : DOWN;
+        default: return sign > 0 ? FRONT : BACK;
     }
 }
 
-// Shuffle cube with random moves
-void shuffleCube(int numMoves) {
-    if (numMoves <= 0) {
-        return;
+Face faceFromNormal(const int normal[3]) {
+    for (int a = 0; a < 3; a++) {
+        if (normal[a] != 0) {
+            return faceFromAxis(a, normal[a]);
+        }
     }
-    resetTimerState();
-    g_scrambleMovesPending = numMoves;
-    for (int i = 0; i < numMoves; i++) {
-        Face face = static_cast<Face>(rand() % 6);
-        bool clockwise = (rand() % 2) == 0;
-        startRotation(face, clockwise, true);
+    return FRONT;
+}
+
+// Face-local (u, v) of the sticker at grid position c on the given face
+void stickerUV(int face, const int c[3], int& u, int& v) {
+    switch (face) {
+        case FRONT:
+        case BACK:
+            u = c[0];
+            v = c[1];
+            break;
+        case LEFT:
+        case RIGHT:
+            u = c[2];
+            v = c[1];
+            break;
+        default: // UP, DOWN
+            u = c[0];
+            v = c[2];
+            break;
     }
-    if (g_logFile != NULL) {
-        fprintf(g_logFile, "SHUFFLE: %d random moves queued\n", numMoves);
-        fflush(g_logFile);
+}
+
+// Apply the face block's lazy offset: rotation quarter turns of (u, v) -> (n-1-v, u)
+inline void remapFaceUV(int n, int rotation, int& u, int& v) {
+    int t;
+    switch (rotation & 3) {
+        case 1: t = u; u = n - 1 - v; v = t; break;
+        case 2: u = n - 1 - u; v = n - 1 - v; break;
+        case 3: t = u; u = v; v = n - 1 - t; break;
+        default: break;
     }
 }
 
-// Initialize OpenGL settings
-void initOpenGL() {
-    // Disable face culling to show all 6 faces of each piece
-    glDisable(GL_CULL_FACE);
-    
-    // Enable depth testing for 3D rendering
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
+// Storage slot of the sticker at grid position c on the given face
+// faceRotation == NULL means every face block is stored unrotated
+int stickerIndex(int n, int face, const int c[3], const unsigned char* faceRotation = NULL) {
+    int u, v;
+    stickerUV(face, c, u, v);
+    if (faceRotation != NULL) {
+        remapFaceUV(n, faceRotation[face], u, v);
+    }
+    return (face * n + v) * n + u;
+}
 
-#ifdef GL_MULTISAMPLE
-    glEnable(GL_MULTISAMPLE);
-#endif
-    glEnable(GL_LINE_SMOOTH);
-    glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glLineWidth(1.5f);
-    
-    // Set clear color to dark gray
-    glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
-    
-    // Enable smooth shading
-    glShadeModel(GL_SMOOTH);
-    
-    // Disable OpenGL lighting so cube colors stay flat and matching textures
-    glDisable(GL_LIGHTING);
-    glDisable(GL_LIGHT0);
-    glDisable(GL_COLOR_MATERIAL);
+// How a clockwise quarter turn about +axis spins a face's own (u, v) grid, in units of
+// the remapFaceUV() quarter turn: F/B see (u,v) -> (v,-u), L/R/U/D see (u,v) -> (-v,u)
+const int FACE_TURN_SPIN[6] = {3, 3, 1, 1, 1, 1};
+
+// 90 degrees clockwise about +axis (looking from +axis toward the origin)
+void rotateGridVectorCW(int axis, int v[3]) {
+    int x = v[0];
+    int y = v[1];
+    int z = v[2];
+    switch (axis) {
+        case 0: // X-axis
+            v[1] = z;
+            v[2] = -y;
+            break;
+        case 1: // Y-axis
+            v[2] = x;
+            v[0] = -z;
+            break;
+        default: // Z-axis
+            v[0] = y;
+            v[1] = -x;
+            break;
+    }
 }
 
-// Draw a single cube piece with 6 custom colors
-void drawCubePiece(const CubePiece& piece) {
-    const float size = g_rubikCube.pieceSize * 0.5f; // Half size
-    
-    glBegin(GL_QUADS);
-    
-    // Front face (Z+) - Face 0
-    glColor3fv(piece.colors[0]);
-    glNormal3f(0.0f, 0.0f, 1.0f);
-    glVertex3f(-size, -size, size);
-    glVertex3f(size, -size, size);
-    glVertex3f(size, size, size);
-    glVertex3f(-size, size, size);
-    
-    // Back face (Z-) - Face 1
-    glColor3fv(piece.colors[1]);
-    glNormal3f(0.0f, 0.0f, -1.0f);
-    glVertex3f(size, -size, -size);
-    glVertex3f(-size, -size, -size);
-    glVertex3f(-size, size, -size);
-    glVertex3f(size, size, -size);
-    
-    // Left face (X-) - Face 2
-    glColor3fv(piece.colors[2]);
-    glNormal3f(-1.0f, 0.0f, 0.0f);
-    glVertex3f(-size, -size, -size);
-    glVertex3f(-size, -size, size);
-    glVertex3f(-size, size, size);
-    glVertex3f(-size, size, -size);
-    
-    // Right face (X+) - Face 3
-    glColor3fv(piece.colors[3]);
-    glNormal3f(1.0f, 0.0f, 0.0f);
-    glVertex3f(size, -size, size);
-    glVertex3f(size, -size, -size);
-    glVertex3f(size, size, -size);
-    glVertex3f(size, size, size);
-    
-    // Up face (Y+) - Face 4
-    glColor3fv(piece.colors[4]);
-    glNormal3f(0.0f, 1.0f, 0.0f);
-    glVertex3f(-size, size, size);
-    glVertex3f(size, size, size);
-    glVertex3f(size, size, -size);
-    glVertex3f(-size, size, -size);
-    
-    // Down face (Y-) - Face 5
-    glColor3fv(piece.colors[5]);
-    glNormal3f(0.0f, -1.0f, 0.0f);
-    glVertex3f(-size, -size, -size);
-    glVertex3f(size, -size, -size);
-    glVertex3f(size, -size, size);
-    glVertex3f(-size, -size, size);
-    
-    glEnd();
+// Move one sticker (face + grid position) through a clockwise quarter turn about +axis
+// Positions are doubled and centered so even N stays in integers
+void rotateStickerCW(int n, int axis, int& face, int c[3]) {
+    int p[3];
+    int normal[3];
+    for (int i = 0; i < 3; i++) {
+        p[i] = 2 * c[i] - (n - 1);
+        normal[i] = FACE_NORMALS[face][i];
+    }
+    rotateGridVectorCW(axis, p);
+    rotateGridVectorCW(axis, normal);
+    for (int i = 0; i < 3; i++) {
+        c[i] = (p[i] + n - 1) / 2;
+    }
+    face = faceFromNormal(normal);
 }
 
-// Initialize Rubik's Cube with 27 pieces and standard colors
-void initRubikCube() {
-    // Set cube properties
-    g_rubikCube.pieceSize = PIECE_SIZE;
-    g_rubikCube.gapSize = GAP_SIZE;
-    
-    // Initialize all 27 pieces
-    // Loop order: Front to Back (k: +1 to -1) so Piece 0 has Front face
-    int index = 0;
-    for (int k = 1; k >= -1; k--) {      // Z: Front to Back (k: +1, 0, -1)
-        for (int j = -1; j <= 1; j++) {  // Y: Down to Up
-            for (int i = -1; i <= 1; i++) { // X: Left to Right
-                CubePiece& piece = g_rubikCube.pieces[index];
-                
-                // Set position
-                piece.position[0] = i;
-                piece.position[1] = j;
-                piece.position[2] = k;
-                
-                // All pieces visible in Phase 2
-                piece.isVisible = true;
-                
-                // Initialize all faces to black (hidden) first
-                for (int face = 0; face < 6; face++) {
-                    piece.colors[face][0] = COLOR_BLACK[0];
-                    piece.colors[face][1] = COLOR_BLACK[1];
-                    piece.colors[face][2] = COLOR_BLACK[2];
-                }
-                
-                // Assign colors based on position (Standard Rubik's Cube colors)
-                // Face indices: 0=Front, 1=Back, 2=Left, 3=Right, 4=Up, 5=Down
-                
-                // Front face (Z+ = +1) - RED
-                if (k == 1) {
-                    piece.colors[0][0] = COLOR_RED[0];
-                    piece.colors[0][1] = COLOR_RED[1];
-                    piece.colors[0][2] = COLOR_RED[2];
-                }
-                
-                // Back face (Z- = -1) - ORANGE
-                if (k == -1) {
-                    piece.colors[1][0] = COLOR_ORANGE[0];
-                    piece.colors[1][1] = COLOR_ORANGE[1];
-                    piece.colors[1][2] = COLOR_ORANGE[2];
-                }
-                
-                // Left face (X- = -1) - BLUE
-                if (i == -1) {
-                    piece.colors[2][0] = COLOR_BLUE[0];
-                    piece.colors[2][1] = COLOR_BLUE[1];
-                    piece.colors[2][2] = COLOR_BLUE[2];
-                }
-                
-                // Right face (X+ = +1) - GREEN
-                if (i == 1) {
-                    piece.colors[3][0] = COLOR_GREEN[0];
-                    piece.colors[3][1] = COLOR_GREEN[1];
-                    piece.colors[3][2] = COLOR_GREEN[2];
-                }
-                
-                // Up face (Y+ = +1) - WHITE
-                if (j == 1) {
-                    piece.colors[4][0] = COLOR_WHITE[0];
-                    piece.colors[4][1] = COLOR_WHITE[1];
-                    piece.colors[4][2] = COLOR_WHITE[2];
-                }
-                
-                // Down face (Y- = -1) - YELLOW
-                if (j == -1) {
-                    piece.colors[5][0] = COLOR_YELLOW[0];
-                    piece.colors[5][1] = COLOR_YELLOW[1];
-                    piece.colors[5][2] = COLOR_YELLOW[2];
-                }
-                
-                index++;
-            }
-        }
+// Slot idx[k] moves to idx[k+1] on each clockwise quarter turn
+template <typename T>
+inline void cycleFour(T* stickers, const int idx[4], int quarterTurns) {
+    T tmp;
+    switch (quarterTurns) {
+        case 1:
+            tmp = stickers[idx[3]];
+            stickers[idx[3]] = stickers[idx[2]];
+            stickers[idx[2]] = stickers[idx[1]];
+            stickers[idx[1]] = stickers[idx[0]];
+            stickers[idx[0]] = tmp;
+            break;
+        case 2:
+            tmp = stickers[idx[0]];
+            stickers[idx[0]] = stickers[idx[2]];
+            stickers[idx[2]] = tmp;
+            tmp = stickers[idx[1]];
+            stickers[idx[1]] = stickers[idx[3]];
+            stickers[idx[3]] = tmp;
+            break;
+        case 3:
+            tmp = stickers[idx[0]];
+            stickers[idx[0]] = stickers[idx[1]];
+            stickers[idx[1]] = stickers[idx[2]];
+            stickers[idx[2]] = stickers[idx[3]];
+            stickers[idx[3]] = tmp;
+            break;
+        default:
+            break;
     }
-    
-    // Log initialization - Piece 0 now has Front face (k=+1)
-    if (g_logFile != NULL) {
-        fprintf(g_logFile, "Phase 2: Initialized %d Rubik pieces\n", 27);
-        fprintf(g_logFile, "Piece 0: F=[%.1f,%.1f,%.1f] B=[%.1f,%.1f,%.1f] L=[%.1f,%.1f,%.1f] R=[%.1f,%.1f,%.1f] U=[%.1f,%.1f,%.1f] D=[%.1f,%.1f,%.1f]\n",
-                g_rubikCube.pieces[0].colors[0][0], g_rubikCube.pieces[0].colors[0][1], g_rubikCube.pieces[0].colors[0][2],
-                g_rubikCube.pieces[0].colors[1][0], g_rubikCube.pieces[0].colors[1][1], g_rubikCube.pieces[0].colors[1][2],
-                g_rubikCube.pieces[0].colors[2][0], g_rubikCube.pieces[0].colors[2][1], g_rubikCube.pieces[0].colors[2][2],
-                g_rubikCube.pieces[0].colors[3][0], g_rubikCube.pieces[0].colors[3][1], g_rubikCube.pieces[0].colors[3][2],
-                g_rubikCube.pieces[0].colors[4][0], g_rubikCube.pieces[0].colors[4][1], g_rubikCube.pieces[0].colors[4][2],
-                g_rubikCube.pieces[0].colors[5][0], g_rubikCube.pieces[0].colors[5][1], g_rubikCube.pieces[0].colors[5][2]);
-        fflush(g_logFile);
+}
+
+// Collect the 4 slots of the orbit starting at (face, c) under quarter turns about axis
+void stickerOrbit(int n, int axis, int face, int c[3], int idx[4], const unsigned char* faceRotation) {
+    for (int k = 0; k < 4; k++) {
+        idx[k] = stickerIndex(n, face, c, faceRotation);
+        rotateStickerCW(n, axis, face, c);
     }
 }
 
-// Draw the complete 3x3x3 Rubik's Cube
-void drawRubikCube() {
-    glPushMatrix();
-    
-    // Draw all 27 pieces
-    for (int i = 0; i < 27; i++) {
-        const CubePiece& piece = g_rubikCube.pieces[i];
-        
-        if (!piece.isVisible) {
-            continue;
+// The 4 ring strips of a layer: orbit t is slots first[k] + t * stride[k]
+struct LayerRing {
+    int first[4];
+    int stride[4];
+    int quarterTurns;
+};
+
+// Each ring strip is a straight line of slots, so two orbits fix all four strides
+void computeLayerRing(int n, int axis, int layer, const unsigned char* faceRotation, LayerRing& ring) {
+    const int b = (axis + 1) % 3;
+    const int c = (axis + 2) % 3;
+    int pos[3];
+    int idx[4];
+    pos[axis] = layer;
+    pos[b] = n - 1;
+    pos[c] = 0;
+    stickerOrbit(n, axis, faceFromAxis(b, 1), pos, ring.first, faceRotation);
+    for (int k = 0; k < 4; k++) {
+        ring.stride[k] = 0;
+    }
+    if (n > 1) {
+        pos[axis] = layer;
+        pos[b] = n - 1;
+        pos[c] = 1;
+        stickerOrbit(n, axis, faceFromAxis(b, 1), pos, idx, faceRotation);
+        for (int k = 0; k < 4; k++) {
+            ring.stride[k] = idx[k] - ring.first[k];
         }
-        
-        // Calculate world position based on grid position
-        // Position = grid_pos * (pieceSize + gapSize)
-        float worldX = (float)piece.position[0] * (g_rubikCube.pieceSize + g_rubikCube.gapSize);
-        float worldY = (float)piece.position[1] * (g_rubikCube.pieceSize + g_rubikCube.gapSize);
-        float worldZ = (float)piece.position[2] * (g_rubikCube.pieceSize + g_rubikCube.gapSize);
-        
-        // Save current matrix
-        glPushMatrix();
-        
-        bool pieceAnimating = g_animation.isActive && isPieceInAnimation(i);
-        if (pieceAnimating) {
-            float axisX = 0.0f;
-            float axisY = 0.0f;
-            float axisZ = 0.0f;
-            int axisSign = 1;
-            switch (g_animation.face) {
-                case FRONT:
-                    axisZ = 1.0f;
-                    axisSign = 1;
-                    break;
-                case BACK:
-                    axisZ = 1.0f;
-                    axisSign = -1;
-                    break;
-                case LEFT:
-                    axisX = 1.0f;
-                    axisSign = -1;
-                    break;
-                case RIGHT:
-                    axisX = 1.0f;
-                    axisSign = 1;
-                    break;
-                case UP:
-                    axisY = 1.0f;
-                    axisSign = 1;
-                    break;
-                case DOWN:
-                    axisY = 1.0f;
-                    axisSign = -1;
-                    break;
-            }
-            float angle = g_animation.clockwise ? -g_animation.displayAngle : g_animation.displayAngle;
-            angle *= static_cast<float>(axisSign);
-            glRotatef(angle, axisX, axisY, axisZ);
+    }
+}
+
+// Cycle ring orbits [tBegin, tEnd)
+template <typename T>
+void cycleLayerRing(T* stickers, const LayerRing& ring, int tBegin, int tEnd) {
+    int idx[4];
+    for (int t = tBegin; t < tEnd; t++) {
+        for (int k = 0; k < 4; k++) {
+            idx[k] = ring.first[k] + t * ring.stride[k];
         }
-        
-        // Translate to piece position after optional face rotation so the whole layer pivots together
-        glTranslatef(worldX, worldY, worldZ);
-        
-        // Draw the piece with its colors
-        drawCubePiece(piece);
-        
-        // Restore matrix
-        glPopMatrix();
+        cycleFour(stickers, idx, ring.quarterTurns);
     }
-    
-    glPopMatrix();
 }
 
-void renderBitmapString(float x, float y, void* font, const char* string) {
-    glRasterPos2f(x, y);
-    while (*string != '\0') {
-        glutBitmapCharacter(font, *string);
-        ++string;
+// An outer layer turn rotates its face block: with lazy offsets, by bumping the offset
+void bumpTurnedFaceOffset(unsigned char* faceRotation, int n, int axis, int layer, int quarterTurns) {
+    if (layer != 0 && layer != n - 1) {
+        return;
+    }
+    const Face turnedFace = faceFromAxis(axis, layer == 0 ? -1 : 1);
+    int rotation = faceRotation[turnedFace] - FACE_TURN_SPIN[turnedFace] * quarterTurns;
+    faceRotation[turnedFace] = (unsigned char)(rotation & 3);
+}
+
+void clearStickerDirty(CubeState& state, int face) {
+    state.dirty[face].minRow = state.n;
+    state.dirty[face].maxRow = -1;
+    state.dirty[face].minCol = state.n;
+    state.dirty[face].maxCol = -1;
+}
+
+void markFaceDirty(CubeState& state, int face) {
+    state.dirty[face].minRow = 0;
+    state.dirty[face].maxRow = state.n - 1;
+    state.dirty[face].minCol = 0;
+    state.dirty[face].maxCol = state.n - 1;
+}
+
+// Grow a block's dirty rectangle over storage slots first..last (one block, one line)
+void markStickersDirty(CubeState& state, int first, int last) {
+    const int faceSize = state.n * state.n;
+    StickerDirtyRect& rect = state.dirty[first / faceSize];
+    const int u[2] = {first % state.n, last % state.n};
+    const int v[2] = {(first % faceSize) / state.n, (last % faceSize) / state.n};
+    rect.minRow = std::min(rect.minRow, std::min(v[0], v[1]));
+    rect.maxRow = std::max(rect.maxRow, std::max(v[0], v[1]));
+    rect.minCol = std::min(rect.minCol, std::min(u[0], u[1]));
+    rect.maxCol = std::max(rect.maxCol, std::max(u[0], u[1]));
+}
+
+// A ring is 4 straight strips, one row or column on each side face
+void markLayerRingDirty(CubeState& state, const LayerRing& ring) {
+    for (int k = 0; k < 4; k++) {
+        markStickersDirty(state, ring.first[k], ring.first[k] + (state.n - 1) * ring.stride[k]);
     }
 }
 
-void formatTimerText(float seconds, char* buffer, int bufferSize) {
-    if (seconds < 0.0f) {
-        seconds = 0.0f;
+// Dynamic path for any N: 4 ring strips of N stickers, plus the N x N face when the
+// layer is an outer one. Each orbit is cycled in place, no scratch buffer.
+// With faceRotation the turned face only has its offset bumped, so a turn is O(N).
+template <typename T>
+void turnLayerGeneric(T* stickers, int n, int axis, int layer, int quarterTurns,
+                      unsigned char* faceRotation = NULL) {
+    const int b = (axis + 1) % 3;
+    const int c = (axis + 2) % 3;
+    int pos[3];
+    int idx[4];
+    LayerRing ring;
+    computeLayerRing(n, axis, layer, faceRotation, ring);
+    ring.quarterTurns = quarterTurns;
+    cycleLayerRing(stickers, ring, 0, n);
+    if (layer != 0 && layer != n - 1) {
+        return;
     }
-    int minutes = (int)(seconds / 60.0f);
-    float sec = seconds - minutes * 60.0f;
-    if (bufferSize > 0) {
-        snprintf(buffer, bufferSize, "%02d:%06.3f", minutes, sec);
+    if (faceRotation != NULL) {
+        bumpTurnedFaceOffset(faceRotation, n, axis, layer, quarterTurns);
+        return;
+    }
+    const Face turnedFace = faceFromAxis(axis, layer == 0 ? -1 : 1);
+    for (int i = 0; i < n / 2; i++) {
+        for (int j = 0; j < (n + 1) / 2; j++) {
+            pos[axis] = layer;
+            pos[b] = i;
+            pos[c] = j;
+            stickerOrbit(n, axis, turnedFace, pos, idx, NULL);
+            cycleFour(stickers, idx, quarterTurns);
+        }
     }
 }
 
-void displayTimerOverlay() {
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    gluOrtho2D(0.0f, (float)windowWidth, 0.0f, (float)windowHeight);
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-    GLboolean depthEnabled = glIsEnabled(GL_DEPTH_TEST);
-    GLboolean lightingEnabled = glIsEnabled(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_LIGHTING);
-    char buffer[128];
-    if (g_scrambleMovesPending > 0) {
-        glColor3f(1.0f, 0.6f, 0.0f);
-        snprintf(buffer, sizeof(buffer), "Scrambling... (%d moves left)", g_scrambleMovesPending);
-        renderBitmapString(10.0f, windowHeight - 20.0f, GLUT_BITMAP_HELVETICA_18, buffer);
-        renderBitmapString(10.0f, windowHeight - 40.0f, GLUT_BITMAP_HELVETICA_18,
-                           "Please wait for scramble to finish");
-    } else {
-        switch (g_timer.state) {
-            case TIMER_IDLE:
-                glColor3f(1.0f, 1.0f, 1.0f);
-                renderBitmapString(10.0f, windowHeight - 20.0f, GLUT_BITMAP_HELVETICA_18,
-                                   "Press 'S' to scramble");
-                break;
-            case TIMER_READY:
-                glColor3f(1.0f, 1.0f, 0.2f);
-                renderBitmapString(10.0f, windowHeight - 20.0f, GLUT_BITMAP_HELVETICA_18,
-                                   "READY - Make first move to start");
-                break;
-            case TIMER_RUNNING:
-                glColor3f(0.0f, 1.0f, 0.0f);
-                formatTimerText(g_timer.currentTime, buffer, sizeof(buffer));
-                renderBitmapString(10.0f, windowHeight - 20.0f, GLUT_BITMAP_HELVETICA_18,
-                                   buffer);
-                snprintf(buffer, sizeof(buffer), "Moves: %d", g_timer.moveCount);
-                renderBitmapString(10.0f, windowHeight - 40.0f, GLUT_BITMAP_HELVETICA_18,
-                                   buffer);
-                snprintf(buffer, sizeof(buffer), "TPS: %.2f", g_timer.tps);
-                renderBitmapString(10.0f, windowHeight - 60.0f, GLUT_BITMAP_HELVETICA_18,
-                                   buffer);
-                break;
-            case TIMER_STOPPED:
-                glColor3f(0.2f, 1.0f, 0.2f);
-                snprintf(buffer, sizeof(buffer), "Solved! Time %.2fs | Moves %d | TPS %.2f",
-                         g_timer.endTime, g_timer.moveCount, g_timer.tps);
-                renderBitmapString(windowWidth * 0.2f, windowHeight * 0.5f,
-                                   GLUT_BITMAP_HELVETICA_18, buffer);
-                break;
+// Per-size move tables for small cubes: for every (axis, layer, quarter turns) the list
+// of moved slots, applied as one gather + scatter with compile-time bounds.
+// Built once at startup (C++98 has no constexpr) by running the generic kernel on an
+// identity permutation.
+template <int N>
+struct SpecializedMoveTables {
+    enum { STICKERS = 6 * N * N, MAX_MOVED = 4 * N + N * N };
+    unsigned short src[3][N][3][MAX_MOVED];
+    unsigned short dst[3][N][3][MAX_MOVED];
+    int count[3][N][3];
+};
+
+template <int N>
+const SpecializedMoveTables<N>& getSpecializedMoveTables() {
+    static SpecializedMoveTables<N> tables;
+    static bool built = false;
+    if (!built) {
+        unsigned short slots[SpecializedMoveTables<N>::STICKERS];
+        for (int axis = 0; axis < 3; axis++) {
+            for (int layer = 0; layer < N; layer++) {
+                for (int q = 1; q <= 3; q++) {
+                    for (int i = 0; i < SpecializedMoveTables<N>::STICKERS; i++) {
+                        slots[i] = (unsigned short)i;
+                    }
+                    turnLayerGeneric(slots, N, axis, layer, q);
+                    int count = 0;
+                    for (int i = 0; i < SpecializedMoveTables<N>::STICKERS; i++) {
+                        if (slots[i] != i) {
+                            tables.dst[axis][layer][q - 1][count] = (unsigned short)i;
+                            tables.src[axis][layer][q - 1][count] = slots[i];
+                            count++;
+                        }
+                    }
+                    tables.count[axis][layer][q - 1] = count;
+                }
+            }
         }
+        built = true;
     }
-    if (depthEnabled) {
-        glEnable(GL_DEPTH_TEST);
+    return tables;
+}
+
+template <int N>
+void turnLayerSpecialized(unsigned char* stickers, int axis, int layer, int quarterTurns) {
+    const SpecializedMoveTables<N>& tables = getSpecializedMoveTables<N>();
+    const unsigned short* src = tables.src[axis][layer][quarterTurns - 1];
+    const unsigned short* dst = tables.dst[axis][layer][quarterTurns - 1];
+    const int count = tables.count[axis][layer][quarterTurns - 1];
+    unsigned char moved[SpecializedMoveTables<N>::MAX_MOVED];
+    for (int k = 0; k < count; k++) {
+        moved[k] = stickers[src[k]];
     }
-    if (lightingEnabled) {
-        glEnable(GL_LIGHTING);
+    for (int k = 0; k < count; k++) {
+        stickers[dst[k]] = moved[k];
     }
-    glPopMatrix();
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
 }
 
-// Main display function - renders the scene
-void display() {
-    // Clear color and depth buffers
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    
-    // Reset modelview matrix
-    glLoadIdentity();
-    
-    // DEBUG: Log frame count periodically (every 30 frames to avoid spam)
-    static int frameCount = 0;
-    if (frameCount++ % 30 == 0 && g_logFile != NULL) {
-        fprintf(g_logFile, "DISPLAY: frame=%d\n", frameCount);
-        fflush(g_logFile);
+// Build every specialized table up front so no move pays the one-time cost
+void initMoveTables() {
+    getSpecializedMoveTables<2>();
+    getSpecializedMoveTables<3>();
+    getSpecializedMoveTables<4>();
+    getSpecializedMoveTables<5>();
+    getSpecializedMoveTables<6>();
+    getSpecializedMoveTables<7>();
+}
+
+// ========================================================================
+// Zobrist state key: 64 bits, maintained per move
+// ========================================================================
+// The key is the XOR of one key per (storage slot, color), so a move only swaps the
+// keys of the stickers it changed, plus one key for the whole-cube orientation, which
+// is all a rotation changes. Position keys are tabulated per N; the 6 colors of a slot
+// are rotations of its key. Within a face block, the 4 slots of a quarter-turn orbit
+// get 16-bit rotations of one key, so turning the block rotates its XOR share by 16
+// bits: a lazy outer turn, which only bumps the block's offset, costs nothing here.
+// The key describes the stored state, so the same look reached through a different
+// orientation (x vs R M' L') gets a different key. Tables are built on the main thread
+// and kept for the session (48 * N^2 bytes per size used), since move batches on the
+// worker threads hold pointers into them.
+
+const unsigned long long ZOBRIST_SEED = 0x2545F4914F6CDD1DULL;
+
+struct ZobristKeyTable {
+    int n;
+    std::vector<unsigned long long> keys;  // by storage slot, read at lazy offset 0
+    unsigned char spin;                    // orbit steps one block offset step moves by
+};
+
+std::map<int, ZobristKeyTable> g_zobristTables;  // map nodes never move once built
+
+// splitmix64 finalizer
+inline unsigned long long mixBits64(unsigned long long x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+inline unsigned long long rotateLeft64(unsigned long long x, int shift) {
+    shift &= 63;
+    return shift == 0 ? x : (x << shift) | (x >> (64 - shift));
+}
+
+// The 6 colors of one slot are rotations of its position key (distinct from the
+// orbit's 16-bit steps for every orbit index / color pair)
+inline unsigned long long zobristKey(unsigned long long positionKey, int color) {
+    return rotateLeft64(positionKey, color * 11);
+}
+
+// One key per whole-cube orientation (24 reachable values of orientation[])
+inline unsigned long long zobristOrientationKey(const CubeState& state) {
+    int index = 0;
+    for (int a = 0; a < 3; a++) {
+        index = index * 8 + state.orientation[a] + 4;
     }
-    
-    // Apply camera transformations
-    // Move camera back from origin first
-    glTranslatef(0.0f, 0.0f, -CAMERA_DISTANCE);
-    
-    // Apply accumulated rotation using dynamic axes
-    // Apply horizontal rotation first, then vertical rotation
-    rotateAroundAxis(horizontalAxis, cameraAngleY);
-    rotateAroundAxis(verticalAxis, cameraAngleX);
-    
-    // Draw the complete 3x3x3 Rubik's Cube
-    drawRubikCube();
-    displayTimerOverlay();
-    
-    // Swap buffers to display the rendered frame
-    glutSwapBuffers();
+    return mixBits64(ZOBRIST_SEED ^ ((unsigned long long)index << 32));
 }
 
-// Handle window reshape events
-void reshape(int w, int h) {
-    // Update global window dimensions
-    windowWidth = w;
-    windowHeight = h;
-    
-    // Prevent division by zero
-    if (h == 0) {
-        h = 1;
+// Key of storage slot (u, v) of a face block. quarter receives its index in its orbit.
+unsigned long long zobristPositionKey(int n, int face, int u, int v, int& quarter) {
+    quarter = 0;
+    if ((n & 1) != 0 && u == n / 2 && v == n / 2) {
+        // The center is its own orbit: a key every 16-bit rotation leaves alone
+        unsigned long long low = mixBits64(ZOBRIST_SEED ^ (unsigned long long)(face * n * n)) & 0xFFFFULL;
+        return low * 0x0001000100010001ULL;
     }
-    
-    // Set viewport to entire window
-    glViewport(0, 0, w, h);
-    
-    // Switch to projection matrix mode
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    
-    // Set up perspective projection
-    // FOV = 45 degrees, aspect ratio, near = 0.1, far = 100.0
-    const float fov = 45.0f;
-    const float aspect = (float)w / (float)h;
-    const float nearPlane = 0.1f;
-    const float farPlane = 100.0f;
-    
-    gluPerspective(fov, aspect, nearPlane, farPlane);
-    
-    // Switch back to modelview matrix mode
-    glMatrixMode(GL_MODELVIEW);
+    // Walk back to the orbit's representative in the quarter [0, ceil(n/2)) x [0, floor(n/2))
+    while (!(u < (n + 1) / 2 && v < n / 2)) {
+        int t = u;
+        u = v;
+        v = n - 1 - t;
+        quarter++;
+    }
+    unsigned long long key = mixBits64(ZOBRIST_SEED ^ (unsigned long long)((face * n + v) * n + u));
+    return rotateLeft64(key, 16 * quarter);
 }
 
-// Handle mouse button press/release events
-void mouse(int button, int state, int x, int y) {
-    // DEBUG: Log all mouse button events to file
-    if (g_logFile != NULL) {
-        fprintf(g_logFile, "MOUSE EVENT: button=%d state=%d x=%d y=%d\n", button, state, x, y);
-        fflush(g_logFile);
+// Position keys for the state's size, built on first use
+const ZobristKeyTable& zobristKeyTable(int n) {
+    std::map<int, ZobristKeyTable>::iterator found = g_zobristTables.find(n);
+    if (found != g_zobristTables.end()) {
+        return found->second;
     }
-    
-    // Only handle left mouse button
-    if (button == GLUT_LEFT_BUTTON) {
-        if (state == GLUT_DOWN) {
-            // Start dragging: save initial mouse position
-            if (g_logFile != NULL) {
-                fprintf(g_logFile, "*** DRAG START ***\n");
-                fflush(g_logFile);
+    ZobristKeyTable& table = g_zobristTables[n];
+    table.n = n;
+    table.keys.resize((size_t)6 * n * n);
+    int quarter;
+    for (int face = 0; face < 6; face++) {
+        for (int v = 0; v < n; v++) {
+            for (int u = 0; u < n; u++) {
+                table.keys[((size_t)face * n + v) * n + u] = zobristPositionKey(n, face, u, v, quarter);
             }
-            isDragging = true;
-            lastMouseX = x;
-            lastMouseY = y;
-        } else if (state == GLUT_UP) {
-            // Stop dragging
-            if (g_logFile != NULL) {
-                fprintf(g_logFile, "*** DRAG END ***\n");
-                fflush(g_logFile);
+        }
+    }
+    // A block at offset 1 shows at storage (0, 0) what offset 0 shows at remap^-1(0, 0)
+    int u = 0;
+    int v = 0;
+    int atOffsetZero;
+    int atOffsetOne;
+    zobristPositionKey(n, 0, u, v, atOffsetZero);
+    remapFaceUV(n, 3, u, v);
+    zobristPositionKey(n, 0, u, v, atOffsetOne);
+    table.spin = (unsigned char)((atOffsetOne - atOffsetZero) & 3);
+    return table;
+}
+
+// From scratch, O(N^2)
+void recomputeZobristHash(CubeState& state) {
+    const int n = state.n;
+    const ZobristKeyTable& table = zobristKeyTable(n);
+    const size_t faceSize = (size_t)n * n;
+    for (int face = 0; face < 6; face++) {
+        const unsigned char* block = &state.stickers[face * faceSize];
+        const unsigned long long* keys = &table.keys[face * faceSize];
+        unsigned long long hash = 0;
+        for (size_t i = 0; i < faceSize; i++) {
+            hash ^= zobristKey(keys[i], block[i]);
+        }
+        state.zobrist[face] = hash;
+    }
+    state.zobristSpin = table.spin;
+}
+
+// Slots a move may have changed, with their colors from before it
+void updateZobristSlots(CubeState& state, const int* slots, const unsigned char* before, int count) {
+    const int faceSize = state.n * state.n;
+    const unsigned long long* keys = &zobristKeyTable(state.n).keys[0];
+    for (int k = 0; k < count; k++) {
+        unsigned char after = state.stickers[slots[k]];
+        if (after != before[k]) {
+            unsigned long long positionKey = keys[slots[k]];
+            state.zobrist[slots[k] / faceSize] ^= zobristKey(positionKey, before[k]) ^ zobristKey(positionKey, after);
+        }
+    }
+}
+
+// cycleLayerRing() that also folds each strip's key change into delta[k]
+void cycleLayerRingHashed(unsigned char* stickers, const unsigned long long* keys, const LayerRing& ring,
+                          int tBegin, int tEnd, unsigned long long delta[4]) {
+    int idx[4];
+    unsigned char before[4];
+    for (int t = tBegin; t < tEnd; t++) {
+        for (int k = 0; k < 4; k++) {
+            idx[k] = ring.first[k] + t * ring.stride[k];
+            before[k] = stickers[idx[k]];
+        }
+        cycleFour(stickers, idx, ring.quarterTurns);
+        for (int k = 0; k < 4; k++) {
+            unsigned char after = stickers[idx[k]];
+            if (after != before[k]) {
+                delta[k] ^= zobristKey(keys[idx[k]], before[k]) ^ zobristKey(keys[idx[k]], after);
             }
-            isDragging = false;
         }
     }
-    glutPostRedisplay();
 }
 
-// Handle mouse motion while button is pressed (dragging)
-void motion(int x, int y) {
-    // Only process motion if we're currently dragging
-    if (!isDragging) {
+// The state key in O(1): a face block at lazy offset r has its share rotated r steps
+unsigned long long cubeStateKey(const CubeState& state) {
+    unsigned long long key = mixBits64(ZOBRIST_SEED + (unsigned long long)state.n) ^ zobristOrientationKey(state);
+    for (int face = 0; face < 6; face++) {
+        int steps = (state.zobristSpin * state.faceRotation[face]) & 3;
+        key ^= rotateLeft64(state.zobrist[face], 16 * steps);
+    }
+    return key;
+}
+
+template <int N>
+void turnLayerSpecializedHashed(CubeState& state, int axis, int layer, int quarterTurns) {
+    const SpecializedMoveTables<N>& tables = getSpecializedMoveTables<N>();
+    const unsigned short* dst = tables.dst[axis][layer][quarterTurns - 1];
+    const int count = tables.count[axis][layer][quarterTurns - 1];
+    int slots[SpecializedMoveTables<N>::MAX_MOVED];
+    unsigned char before[SpecializedMoveTables<N>::MAX_MOVED];
+    for (int k = 0; k < count; k++) {
+        slots[k] = dst[k];
+        before[k] = state.stickers[dst[k]];
+        markStickersDirty(state, dst[k], dst[k]);
+    }
+    turnLayerSpecialized<N>(&state.stickers[0], axis, layer, quarterTurns);
+    updateZobristSlots(state, slots, before, count);
+}
+
+// Layer turn in storage coordinates (ignores the whole-cube orientation)
+void applyPhysicalLayerTurn(CubeState& state, int axis, int layer, int quarterTurns) {
+    quarterTurns = ((quarterTurns % 4) + 4) % 4;
+    if (quarterTurns == 0 || axis < 0 || axis > 2 || layer < 0 || layer >= state.n) {
         return;
     }
-    
-    // Calculate mouse movement delta
-    int dx = x - lastMouseX;
-    int dy = y - lastMouseY;
-    
-    // STANDARD ARC-BALL MATHEMATICS:
-    // Mouse coordinate: Y=0 at top, increases DOWNWARD
-    // OpenGL world: Y+ points UPWARD
-    // 
-    // For intuitive control:
-    // - Mouse RIGHT (dx > 0) → Yaw RIGHT (positive)
-    // - Mouse LEFT (dx < 0) → Yaw LEFT (negative)
-    // - Mouse UP (y decreases) → Camera looks UP (pitch DECREASES, negative)
-    // - Mouse DOWN (y increases) → Camera looks DOWN (pitch INCREASES, positive)
-    //
-    // Solution: Use (y - lastMouseY) directly for pitchDelta
-    // When mouse UP: y decreases → (y - lastMouseY) < 0 → pitchDelta negative → angleX decreases → look UP ✓
-    // When mouse DOWN: y increases → (y - lastMouseY) > 0 → pitchDelta positive → angleX increases → look DOWN ✓
-    
-    float yawDelta = (float)dx * ROTATION_SENSITIVITY;           // RIGHT = positive yaw
-    float pitchDelta = (float)(y - lastMouseY) * ROTATION_SENSITIVITY;  // FLIP Y LOGIC: UP = negative pitch (look up)
-    
-    // DEBUG: Log mouse movement and calculated deltas to file
-    if (g_logFile != NULL) {
-        fprintf(g_logFile, "MOUSE: x=%d y=%d | dx=%d dy=%d | yawDelta=%.1f pitchDelta=%.1f\n", 
-                x, y, dx, dy, yawDelta, pitchDelta);
-        fflush(g_logFile);
+    switch (state.n) {
+        case 2: turnLayerSpecializedHashed<2>(state, axis, layer, quarterTurns); return;
+        case 3: turnLayerSpecializedHashed<3>(state, axis, layer, quarterTurns); return;
+        case 4: turnLayerSpecializedHashed<4>(state, axis, layer, quarterTurns); return;
+        case 5: turnLayerSpecializedHashed<5>(state, axis, layer, quarterTurns); return;
+        case 6: turnLayerSpecializedHashed<6>(state, axis, layer, quarterTurns); return;
+        case 7: turnLayerSpecializedHashed<7>(state, axis, layer, quarterTurns); return;
+        default: break;
     }
-    
-    // Apply rotation deltas (accumulate angles)
-    cameraAngleY += yawDelta;   // Yaw: horizontal rotation (left/right)
-    cameraAngleX += pitchDelta; // Pitch: vertical rotation (up/down)
-    
-    // Allow unlimited rotation - no clamping
-    // User can rotate as much as they want in any direction
-    // Note: This allows full 360° rotation in all directions
-    
-    // DEBUG: Log angles after update to file
-    if (g_logFile != NULL) {
-        fprintf(g_logFile, "  → Updated angles: X=%.1f Y=%.1f\n", cameraAngleX, cameraAngleY);
-        fflush(g_logFile);
+    // Only the ring changes stickers; the turned face just has its offset bumped
+    const int n = state.n;
+    LayerRing ring;
+    computeLayerRing(n, axis, layer, state.faceRotation, ring);
+    ring.quarterTurns = quarterTurns;
+    unsigned long long delta[4] = {0, 0, 0, 0};
+    cycleLayerRingHashed(&state.stickers[0], &zobristKeyTable(n).keys[0], ring, 0, n, delta);
+    for (int k = 0; k < 4; k++) {
+        state.zobrist[ring.first[k] / (n * n)] ^= delta[k];
     }
-    
-    // Update last mouse position for next frame
-    lastMouseX = x;
-    lastMouseY = y;
-    
-    // Request redraw to update camera view
-    glutPostRedisplay();
+    markLayerRingDirty(state, ring);
+    bumpTurnedFaceOffset(state.faceRotation, n, axis, layer, quarterTurns);
 }
 
-// Handle regular keyboard input (F/R/B/L/U/D for face selection)
-void keyboard(unsigned char key, int /* x */, int /* y */) {
-    int modifiers = glutGetModifiers();
-    bool shiftDown = (modifiers & GLUT_ACTIVE_SHIFT) != 0;
-    int keyUpper = toupper((unsigned char)key);
-    bool trackKey = false;
-    switch (keyUpper) {
-        case 'F':
-        case 'U':
-        case 'R':
-        case 'L':
-        case 'D':
-        case 'B':
-        case 'S':
-            trackKey = true;
-            break;
-        default:
-            break;
+// Materialize the lazy face offsets so stickers[] reads directly (O(N^2) per rotated face)
+void bakeFaceRotations(CubeState& state) {
+    const int n = state.n;
+    std::vector<unsigned char> face;
+    for (int f = 0; f < 6; f++) {
+        if (state.faceRotation[f] == 0) {
+            continue;
+        }
+        unsigned char* block = &state.stickers[(size_t)f * n * n];
+        face.assign(block, block + (size_t)n * n);
+        for (int v = 0; v < n; v++) {
+            for (int u = 0; u < n; u++) {
+                int su = u;
+                int sv = v;
+                remapFaceUV(n, state.faceRotation[f], su, sv);
+                block[v * n + u] = face[sv * n + su];
+            }
+        }
+        // The block now stores what it showed: its key share is the rotated one
+        state.zobrist[f] = rotateLeft64(state.zobrist[f], 16 * ((state.zobristSpin * state.faceRotation[f]) & 3));
+        state.faceRotation[f] = 0;
+        markFaceDirty(state, f);
     }
-    if (key == ' ') {
-        trackKey = true;
-        keyUpper = ' ';
+}
+
+void logicalToPhysicalAxis(const CubeState& state, int axis, int& physicalAxis, int& sign) {
+    int m = state.orientation[axis];
+    physicalAxis = (m < 0 ? -m : m) - 1;
+    sign = (m < 0) ? -1 : 1;
+}
+
+// Layer turn in logical coordinates: mapped through the orientation onto storage
+void applyLayerTurn(CubeState& state, int axis, int layer, int quarterTurns) {
+    if (axis < 0 || axis > 2 || layer < 0 || layer >= state.n) {
+        return;
     }
-    if (trackKey) {
-        unsigned char idx = (unsigned char)keyUpper;
-        if (g_keyHeld[idx]) {
-            return;
+    int physicalAxis, sign;
+    logicalToPhysicalAxis(state, axis, physicalAxis, sign);
+    if (sign < 0) {
+        // Logical +axis is physical -axis: mirrored layer, opposite turn direction
+        layer = state.n - 1 - layer;
+        quarterTurns = -quarterTurns;
+    }
+    applyPhysicalLayerTurn(state, physicalAxis, layer, quarterTurns);
+}
+
+// Same-axis layer turns commute and touch disjoint ring stickers, so a batch of them
+// (a wide move, a slice move, several queued slices) can be cycled in parallel
+struct LayerTurn {
+    int layer;
+    int quarterTurns;
+};
+
+// Shared by all chunks of one parallel batch. A chunk is a tile of RING_TILE_ORBITS
+// layers x RING_TILE_ORBITS orbits: on every face one coordinate is the layer and the
+// other the orbit, so a tile writes short runs of a few rows, not scattered bytes.
+// Rows aren't cache-line aligned, so neighbouring tiles may share a line at their edges.
+struct ParallelRingBatch {
+    unsigned char* stickers;
+    const unsigned long long* keys;  // Zobrist position keys
+    const LayerRing* rings;          // one per physical layer, quarterTurns 0 = untouched
+    unsigned long long* faceDeltas;  // 6 per chunk: key change of each face block
+    int n;
+    int tilesPerSide;
+};
+
+void runRingChunk(void* context, int chunk) {
+    const ParallelRingBatch& batch = *(const ParallelRingBatch*)context;
+    int layerBegin = (chunk / batch.tilesPerSide) * RING_TILE_ORBITS;
+    int tBegin = (chunk % batch.tilesPerSide) * RING_TILE_ORBITS;
+    int layerEnd = layerBegin + RING_TILE_ORBITS < batch.n ? layerBegin + RING_TILE_ORBITS : batch.n;
+    int tEnd = tBegin + RING_TILE_ORBITS < batch.n ? tBegin + RING_TILE_ORBITS : batch.n;
+    unsigned long long* faceDelta = batch.faceDeltas + (size_t)chunk * 6;
+    for (int layer = layerBegin; layer < layerEnd; layer++) {
+        const LayerRing& ring = batch.rings[layer];
+        if (ring.quarterTurns != 0) {
+            unsigned long long delta[4] = {0, 0, 0, 0};
+            cycleLayerRingHashed(batch.stickers, batch.keys, ring, tBegin, tEnd, delta);
+            for (int k = 0; k < 4; k++) {
+                faceDelta[ring.first[k] / (batch.n * batch.n)] ^= delta[k];
+            }
         }
-        g_keyHeld[idx] = true;
     }
-    Face newFace = currentFrontFace;
-    bool faceChanged = false;
-    
-    switch (keyUpper) {
+}
+
+void applyLayerTurns(CubeState& state, int axis, const LayerTurn* turns, int count) {
+    const int n = state.n;
+    if (axis < 0 || axis > 2 || count <= 0) {
+        return;
+    }
+    int physicalAxis, sign;
+    logicalToPhysicalAxis(state, axis, physicalAxis, sign);
+    // Net quarter turns per physical layer (repeated layers are merged, never raced)
+    std::vector<int> net(n, 0);
+    for (int i = 0; i < count; i++) {
+        if (turns[i].layer < 0 || turns[i].layer >= n) {
+            continue;
+        }
+        int layer = (sign > 0) ? turns[i].layer : n - 1 - turns[i].layer;
+        net[layer] = (((net[layer] + sign * turns[i].quarterTurns) % 4) + 4) % 4;
+    }
+    int layerCount = 0;
+    for (int layer = 0; layer < n; layer++) {
+        if (net[layer] != 0) {
+            layerCount++;
+        }
+    }
+    // Small cubes use their move tables; small batches aren't worth a dispatch
+    if (n <= MAX_SPECIALIZED_CUBE_SIZE || (long)layerCount * n < PARALLEL_MIN_ORBITS) {
+        for (int layer = 0; layer < n; layer++) {
+            applyPhysicalLayerTurn(state, physicalAxis, layer, net[layer]);
+        }
+        return;
+    }
+    // Rings only read side-face offsets, which same-axis turns never change, so every
+    // ring is fixed up front; the outer faces' lazy offsets are bumped afterwards
+    std::vector<LayerRing> rings(n);
+    for (int layer = 0; layer < n; layer++) {
+        rings[layer].quarterTurns = net[layer];
+        if (net[layer] != 0) {
+            computeLayerRing(n, physicalAxis, layer, state.faceRotation, rings[layer]);
+        }
+    }
+    ParallelRingBatch batch;
+    batch.stickers = &state.stickers[0];
+    batch.keys = &zobristKeyTable(n).keys[0];
+    batch.rings = &rings[0];
+    batch.n = n;
+    batch.tilesPerSide = (n + RING_TILE_ORBITS - 1) / RING_TILE_ORBITS;
+    const int chunkCount = batch.tilesPerSide * batch.tilesPerSide;
+    std::vector<unsigned long long> faceDeltas((size_t)chunkCount * 6, 0);
+    batch.faceDeltas = &faceDeltas[0];
+    parallelFor(runRingChunk, &batch, chunkCount);
+    for (size_t i = 0; i < faceDeltas.size(); i++) {
+        state.zobrist[i % 6] ^= faceDeltas[i];
+    }
+    for (int layer = 0; layer < n; layer++) {
+        if (net[layer] != 0) {
+            markLayerRingDirty(state, rings[layer]);
+        }
+    }
+    bumpTurnedFaceOffset(state.faceRotation, n, physicalAxis, 0, net[0]);
+    bumpTurnedFaceOffset(state.faceRotation, n, physicalAxis, n - 1, net[n - 1]);
+}
+
+// Whole-cube rotation, quarterTurns clockwise about logical +axis: no sticker moves,
+// logical e_a now shows what Q^-1 e_a showed before
+void rotateCubeOrientation(CubeState& state, int axis, int quarterTurns) {
+    quarterTurns = ((quarterTurns % 4) + 4) % 4;
+    signed char rotated[3];
+    for (int a = 0; a < 3; a++) {
+        int v[3] = {0, 0, 0};
+        v[a] = 1;
+        for (int k = 0; k < (4 - quarterTurns) % 4; k++) {
+            rotateGridVectorCW(axis, v);
+        }
+        for (int b = 0; b < 3; b++) {
+            if (v[b] != 0) {
+                rotated[a] = (signed char)(v[b] * state.orientation[b]);
+            }
+        }
+    }
+    memcpy(state.orientation, rotated, sizeof(rotated));
+}
+
+// Storage face block and in-block (u, v) of the sticker at logical grid position c on
+// logical face. Affine in c, so positions just outside 0..N-1 extrapolate cleanly.
+void logicalStickerUV(const CubeState& state, int face, const int c[3], int& physicalFace, int& u, int& v) {
+    int p[3];
+    int normal[3];
+    for (int a = 0; a < 3; a++) {
+        int physicalAxis, sign;
+        logicalToPhysicalAxis(state, a, physicalAxis, sign);
+        p[physicalAxis] = (sign > 0) ? c[a] : state.n - 1 - c[a];
+        normal[physicalAxis] = sign * FACE_NORMALS[face][a];
+    }
+    physicalFace = faceFromNormal(normal);
+    stickerUV(physicalFace, p, u, v);
+    remapFaceUV(state.n, state.faceRotation[physicalFace], u, v);
+}
+
+// Storage slot of the sticker at logical grid position c on logical face
+int logicalStickerIndex(const CubeState& state, int face, const int c[3]) {
+    int physicalFace, u, v;
+    logicalStickerUV(state, face, c, physicalFace, u, v);
+    return (physicalFace * state.n + v) * state.n + u;
+}
+
+// Outer face turn -> (axis, layer, clockwise quarter turns about +axis)
+void faceToLayerTurn(int n, int face, bool clockwise, int& axis, int& layer, int& quarterTurns) {
+    switch (face) {
+        case LEFT:
+        case RIGHT:
+            axis = 0;
+            break;
+        case UP:
+        case DOWN:
+            axis = 1;
+            break;
+        default:
+            axis = 2;
+            break;
+    }
+    bool positiveSide = (face == RIGHT || face == UP || face == FRONT);
+    layer = positiveSide ? n - 1 : 0;
+    // Clockwise seen from a negative face is counter-clockwise seen from +axis
+    quarterTurns = (clockwise == positiveSide) ? 1 : 3;
+}
+
+void applyFaceTurn(CubeState& state, int face, bool clockwise) {
+    int axis, layer, quarterTurns;
+    faceToLayerTurn(state.n, face, clockwise, axis, layer, quarterTurns);
+    applyLayerTurn(state, axis, layer, quarterTurns);
+}
+
+MoveToken makeMove(MoveKind kind, Face face, bool clockwise, int depth = 1) {
+    MoveToken move = {face, clockwise, kind, depth};
+    return move;
+}
+
+// Any move -> layers [from, to] on axis, turned quarterTurns clockwise about +axis
+// (an empty range, from > to, for slices on a 2x2x2)
+void moveToLayerRange(int n, const MoveToken& move, int& axis, int& from, int& to, int& quarterTurns) {
+    int layer;
+    faceToLayerTurn(n, move.face, move.clockwise, axis, layer, quarterTurns);
+    int depth = 1;
+    switch (move.kind) {
+        case MOVE_WIDE:
+            depth = move.depth < 1 ? 1 : (move.depth > n ? n : move.depth);
+            break;
+        case MOVE_SLICE:
+            from = 1;
+            to = n - 2;
+            return;
+        case MOVE_ROTATION:
+            from = 0;
+            to = n - 1;
+            return;
+        default:
+            break;
+    }
+    from = (layer == 0) ? 0 : n - depth;
+    to = (layer == 0) ? depth - 1 : n - 1;
+}
+
+// Apply a move list straight to a state. Runs of consecutive same-axis moves commute,
+// so each run goes in as one layer batch (parallel on big cubes).
+void bulkApplyMoves(CubeState& state, const std::vector<MoveToken>& moves) {
+    std::vector<LayerTurn> turns;
+    int batchAxis = -1;
+    for (size_t i = 0; i <= moves.size(); i++) {
+        int axis = -1;
+        int from = 0;
+        int to = -1;
+        int quarterTurns = 0;
+        bool rotation = false;
+        if (i < moves.size()) {
+            moveToLayerRange(state.n, moves[i], axis, from, to, quarterTurns);
+            rotation = moves[i].kind == MOVE_ROTATION;
+        }
+        if (i == moves.size() || rotation || axis != batchAxis) {
+            if (!turns.empty()) {
+                applyLayerTurns(state, batchAxis, &turns[0], (int)turns.size());
+                turns.clear();
+            }
+            batchAxis = rotation ? -1 : axis;
+        }
+        if (i == moves.size()) {
+            break;
+        }
+        if (rotation) {
+            rotateCubeOrientation(state, axis, quarterTurns);
+            continue;
+        }
+        for (int layer = from; layer <= to; layer++) {
+            LayerTurn turn = {layer, quarterTurns};
+            turns.push_back(turn);
+        }
+    }
+}
+
+void applyMove(CubeState& state, const MoveToken& move) {
+    int axis, from, to, quarterTurns;
+    moveToLayerRange(state.n, move, axis, from, to, quarterTurns);
+    if (move.kind == MOVE_ROTATION) {
+        rotateCubeOrientation(state, axis, quarterTurns);
+        return;
+    }
+    if (from == to) {
+        applyLayerTurn(state, axis, from, quarterTurns);
+        return;
+    }
+    std::vector<LayerTurn> turns;
+    for (int layer = from; layer <= to; layer++) {
+        LayerTurn turn = {layer, quarterTurns};
+        turns.push_back(turn);
+    }
+    if (!turns.empty()) {
+        applyLayerTurns(state, axis, &turns[0], (int)turns.size());
+    }
+}
+
+void initCubeState(CubeState& state, int n) {
+    state.n = n;
+    state.stickers.resize((size_t)6 * (size_t)n * (size_t)n);
+    for (int face = 0; face < 6; face++) {
+        memset(&state.stickers[(size_t)face * n * n], face, (size_t)n * n);
+    }
+    memset(state.faceRotation, 0, sizeof(state.faceRotation));
+    state.orientation[0] = 1;
+    state.orientation[1] = 2;
+    state.orientation[2] = 3;
+    recomputeZobristHash(state);
+    for (int face = 0; face < 6; face++) {
+        markFaceDirty(state, face);
+    }
+}
+
+// Solved in any orientation: every face is a single color (lazy offsets and relabeling don't matter)
+bool isCubeStateSolved(const CubeState& state) {
+    const size_t faceSize = (size_t)state.n * (size_t)state.n;
+    for (int face = 0; face < 6; face++) {
+        const unsigned char* f = &state.stickers[face * faceSize];
+        for (size_t i = 1; i < faceSize; i++) {
+            if (f[i] != f[0]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// ========================================================================
+// Solvability check for imported states
+// ========================================================================
+// A state built from moves is always reachable, but one taken from outside (a future
+// sticker import, a solver's input) may not be: a twisted corner, a flipped edge or two
+// swapped pieces would send a solver searching forever. Nothing imports stickers yet,
+// so the render jobs and the replay verdict run it as a check on the move code.
+// validateCubeState() reads the 8 corners, every wing and, on odd cubes, the 12 middle
+// edges and 6 centers: O(N). Odd cubes get the full 3x3x3 test (corner twist sum, edge
+// flip sum, corner/edge/center permutation parity). Wings can't flip in place, so each
+// orbit must hold every wing exactly once with its own handedness; any permutation of
+// them is reachable, so that is the whole wing condition. Inner centers are NOT checked:
+// a center orbit is valid when it holds 4 of each color, which costs O(N^2) to count.
+
+enum CubeStateError {
+    CUBE_STATE_VALID = 0,
+    CUBE_STATE_BAD_SIZE,            // n out of range or the sticker array doesn't match it
+    CUBE_STATE_BAD_COLOR,           // a sticker value outside the 6 colors
+    CUBE_STATE_BAD_CENTERS,         // odd n: centers aren't a rotation of the color scheme
+    CUBE_STATE_BAD_CORNER,          // corner colors no real corner has (or a mirrored one)
+    CUBE_STATE_BAD_EDGE,            // edge colors no real edge has
+    CUBE_STATE_DUPLICATE_PIECE,     // the same corner or edge appears twice
+    CUBE_STATE_CORNER_TWIST,        // corner twists don't sum to 0 mod 3
+    CUBE_STATE_EDGE_FLIP,           // an odd number of flipped edges
+    CUBE_STATE_PERMUTATION_PARITY,  // corner, edge and center parities don't agree
+    CUBE_STATE_WING_FLIP            // n >= 4: a wing flipped in place (or a mirrored one)
+};
+
+struct CubeStateCheck {
+    CubeStateError error;
+    int piece;                // corner (x | y << 1 | z << 2), edge (axis * 4 + signs) or wing
+                              // (24 * (orbit - 1) + edge, + 12 on the edge's high half), -1 if none
+    std::string message;
+};
+
+const char* const CUBE_STATE_ERROR_NAMES[] = {
+    "valid", "bad size", "bad color", "bad centers", "bad corner", "bad edge",
+    "duplicate piece", "corner twist", "edge flip", "permutation parity", "wing flip"
+};
+
+inline int colorAxis(int color) {
+    return (color == LEFT || color == RIGHT) ? 0 : ((color == UP || color == DOWN) ? 1 : 2);
+}
+
+inline int colorSide(int color) {
+    return FACE_NORMALS[color][colorAxis(color)] > 0 ? 1 : 0;
+}
+
+// Faces around corner x | y << 1 | z << 2, clockwise seen from outside, U/D one first
+void cornerFaceOrder(int corner, Face order[3]) {
+    const int x = corner & 1;
+    const int y = (corner >> 1) & 1;
+    const int z = (corner >> 2) & 1;
+    Face xFace = x ? RIGHT : LEFT;
+    Face yFace = y ? UP : DOWN;
+    Face zFace = z ? FRONT : BACK;
+    // y -> x -> z is clockwise where an even number of the outward normals are negative
+    bool evenNegatives = ((3 - x - y - z) & 1) == 0;
+    order[0] = yFace;
+    order[1] = evenNegatives ? xFace : zFace;
+    order[2] = evenNegatives ? zFace : xFace;
+}
+
+// Edge axis * 4 + s1 + 2 * s2 runs along axis, on the s1 side of the next axis and the
+// s2 side of the last; faces in orientation priority order (U/D, then F/B, then L/R)
+void edgeFaceOrder(int edge, Face order[2]) {
+    const int along = edge / 4;
+    const int a = (along + 1) % 3;
+    const int b = (along + 2) % 3;
+    const Face sides[3][2] = {{LEFT, RIGHT}, {DOWN, UP}, {BACK, FRONT}};
+    Face first = sides[a][edge & 1];
+    Face second = sides[b][(edge >> 1) & 1];
+    // Priority y > z > x
+    const int priority[3] = {0, 2, 1};
+    bool swap = priority[a] < priority[b];
+    order[0] = swap ? second : first;
+    order[1] = swap ? first : second;
+}
+
+int edgeIndexOf(int axisA, int sideA, int axisB, int sideB) {
+    int along = 3 - axisA - axisB;
+    if ((along + 1) % 3 != axisA) {
+        int t = sideA;
+        sideA = sideB;
+        sideB = t;
+    }
+    return along * 4 + sideA + 2 * sideB;
+}
+
+// Odd permutation of 0..count-1?
+bool permutationIsOdd(const int* perm, int count) {
+    bool odd = false;
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            odd ^= perm[j] < perm[i];
+        }
+    }
+    return odd;
+}
+
+CubeStateCheck cubeStateFailure(CubeStateError error, int piece, const char* detail) {
+    CubeStateCheck check;
+    check.error = error;
+    check.piece = piece;
+    char buffer[160];
+    if (piece >= 0) {
+        snprintf(buffer, sizeof(buffer), "%s (piece %d): %s", CUBE_STATE_ERROR_NAMES[error], piece, detail);
+    } else {
+        snprintf(buffer, sizeof(buffer), "%s: %s", CUBE_STATE_ERROR_NAMES[error], detail);
+    }
+    check.message = buffer;
+    return check;
+}
+
+// Wings of orbit t sit t stickers from a corner along each of the 12 edges, two per
+// edge. A wing's handedness is the sign of (nA x nB) . d, with nA and nB the normals under
+// its two colors in priority order and d pointing from the edge's middle to the wing:
+// moves keep it, and the two wings of one color pair have opposite ones.
+CubeStateCheck validateWingOrbits(const CubeState& state) {
+    const int n = state.n;
+    for (int t = 1; 2 * t < n - 1; t++) {
+        int seen = 0;           // bit home * 2 + handedness
+        int pairCount[12] = {0};
+        for (int slot = 0; slot < 24; slot++) {
+            const int edge = slot % 12;
+            const int along = edge / 4;
+            const int piece = 24 * (t - 1) + slot;
+            Face order[2];
+            edgeFaceOrder(edge, order);
+            int c[3];
+            c[along] = slot < 12 ? t : n - 1 - t;
+            for (int k = 0; k < 2; k++) {
+                c[colorAxis(order[k])] = colorSide(order[k]) ? n - 1 : 0;
+            }
+            int colors[2];
+            for (int k = 0; k < 2; k++) {
+                colors[k] = state.stickers[logicalStickerIndex(state, order[k], c)];
+                if (colors[k] >= 6) {
+                    return cubeStateFailure(CUBE_STATE_BAD_COLOR, piece, "wing sticker value outside 0..5");
+                }
+            }
+            if (colorAxis(colors[0]) == colorAxis(colors[1])) {
+                return cubeStateFailure(CUBE_STATE_BAD_EDGE, piece, "two stickers of one axis on a wing");
+            }
+            int home = edgeIndexOf(colorAxis(colors[0]), colorSide(colors[0]), colorAxis(colors[1]), colorSide(colors[1]));
+            Face homeOrder[2];
+            edgeFaceOrder(home, homeOrder);
+            const int* nA = FACE_NORMALS[colors[0] == homeOrder[0] ? order[0] : order[1]];
+            const int* nB = FACE_NORMALS[colors[0] == homeOrder[0] ? order[1] : order[0]];
+            const int d = slot < 12 ? -1 : 1;
+            const int cross = nA[(along + 1) % 3] * nB[(along + 2) % 3] - nA[(along + 2) % 3] * nB[(along + 1) % 3];
+            const int bit = 1 << (home * 2 + (cross * d > 0 ? 1 : 0));
+            if (seen & bit) {
+                return pairCount[home] >= 2
+                    ? cubeStateFailure(CUBE_STATE_DUPLICATE_PIECE, piece, "wing appears twice")
+                    : cubeStateFailure(CUBE_STATE_WING_FLIP, piece, "two wings of one color pair have the same handedness");
+            }
+            seen |= bit;
+            pairCount[home]++;
+        }
+    }
+    return cubeStateFailure(CUBE_STATE_VALID, -1, "solvable");
+}
+
+CubeStateCheck validateCubeState(const CubeState& state) {
+    const int n = state.n;
+    if (n < 2 || state.stickers.size() != (size_t)6 * (size_t)n * (size_t)n) {
+        return cubeStateFailure(CUBE_STATE_BAD_SIZE, -1, "sticker count doesn't match the cube size");
+    }
+    const int last = n - 1;
+    const int mid = n / 2;
+    
+    // Corners: a real cubie, each once, twists summing to 0 mod 3
+    int cornerPerm[8];
+    int twistSum = 0;
+    int seenCorners = 0;
+    for (int corner = 0; corner < 8; corner++) {
+        int c[3] = {(corner & 1) ? last : 0, (corner & 2) ? last : 0, (corner & 4) ? last : 0};
+        Face order[3];
+        cornerFaceOrder(corner, order);
+        int colors[3];
+        int axes = 0;
+        int home = 0;
+        int twist = -1;
+        for (int k = 0; k < 3; k++) {
+            colors[k] = state.stickers[logicalStickerIndex(state, order[k], c)];
+            if (colors[k] >= 6) {
+                return cubeStateFailure(CUBE_STATE_BAD_COLOR, corner, "sticker value outside 0..5");
+            }
+            int axis = colorAxis(colors[k]);
+            axes |= 1 << axis;
+            home |= colorSide(colors[k]) << axis;
+            if (axis == 1) {
+                twist = k;
+            }
+        }
+        if (axes != 7) {
+            return cubeStateFailure(CUBE_STATE_BAD_CORNER, corner, "two stickers of one axis on a corner");
+        }
+        Face homeOrder[3];
+        cornerFaceOrder(home, homeOrder);
+        if (colors[(twist + 1) % 3] != homeOrder[1]) {
+            return cubeStateFailure(CUBE_STATE_BAD_CORNER, corner, "mirror-image corner");
+        }
+        if (seenCorners & (1 << home)) {
+            return cubeStateFailure(CUBE_STATE_DUPLICATE_PIECE, corner, "corner appears twice");
+        }
+        seenCorners |= 1 << home;
+        cornerPerm[corner] = home;
+        twistSum += twist;
+    }
+    if (twistSum % 3 != 0) {
+        return cubeStateFailure(CUBE_STATE_CORNER_TWIST, -1, "corner twists don't sum to 0 mod 3");
+    }
+    CubeStateCheck wings = validateWingOrbits(state);
+    if (wings.error != CUBE_STATE_VALID || (n & 1) == 0) {
+        return wings;
+    }
+    
+    // Centers: a proper rotation of the color scheme (opposites opposite, not mirrored)
+    int centerPerm[6];
+    int centerNormals[3][3];
+    for (int face = 0; face < 6; face++) {
+        int c[3] = {mid, mid, mid};
+        int axis = colorAxis(face);
+        c[axis] = colorSide(face) ? last : 0;
+        centerPerm[face] = state.stickers[logicalStickerIndex(state, face, c)];
+        if (centerPerm[face] >= 6) {
+            return cubeStateFailure(CUBE_STATE_BAD_COLOR, -1, "center sticker value outside 0..5");
+        }
+    }
+    for (int face = 0; face < 6; face++) {
+        if (centerPerm[getOppositeFace((Face)face)] != getOppositeFace((Face)centerPerm[face])) {
+            return cubeStateFailure(CUBE_STATE_BAD_CENTERS, -1, "opposite centers aren't opposite colors");
+        }
+    }
+    const Face frame[3] = {RIGHT, UP, FRONT};
+    for (int i = 0; i < 3; i++) {
+        for (int a = 0; a < 3; a++) {
+            centerNormals[i][a] = FACE_NORMALS[centerPerm[frame[i]]][a];
+        }
+    }
+    int determinant = centerNormals[0][0] * (centerNormals[1][1] * centerNormals[2][2] - centerNormals[1][2] * centerNormals[2][1])
+                    - centerNormals[0][1] * (centerNormals[1][0] * centerNormals[2][2] - centerNormals[1][2] * centerNormals[2][0])
+                    + centerNormals[0][2] * (centerNormals[1][0] * centerNormals[2][1] - centerNormals[1][1] * centerNormals[2][0]);
+    if (determinant != 1) {
+        return cubeStateFailure(CUBE_STATE_BAD_CENTERS, -1, "centers are a mirror image of the color scheme");
+    }
+    
+    // Middle edges: a real cubie, each once, an even number flipped
+    int edgePerm[12];
+    int flipSum = 0;
+    int seenEdges = 0;
+    for (int edge = 0; edge < 12; edge++) {
+        Face order[2];
+        edgeFaceOrder(edge, order);
+        int c[3] = {mid, mid, mid};
+        int colors[2];
+        for (int k = 0; k < 2; k++) {
+            int axis = colorAxis(order[k]);
+            c[axis] = colorSide(order[k]) ? last : 0;
+        }
+        for (int k = 0; k < 2; k++) {
+            colors[k] = state.stickers[logicalStickerIndex(state, order[k], c)];
+            if (colors[k] >= 6) {
+                return cubeStateFailure(CUBE_STATE_BAD_COLOR, edge, "sticker value outside 0..5");
+            }
+        }
+        int axisA = colorAxis(colors[0]);
+        int axisB = colorAxis(colors[1]);
+        if (axisA == axisB) {
+            return cubeStateFailure(CUBE_STATE_BAD_EDGE, edge, "two stickers of one axis on an edge");
+        }
+        int home = edgeIndexOf(axisA, colorSide(colors[0]), axisB, colorSide(colors[1]));
+        if (seenEdges & (1 << home)) {
+            return cubeStateFailure(CUBE_STATE_DUPLICATE_PIECE, edge, "edge appears twice");
+        }
+        seenEdges |= 1 << home;
+        edgePerm[edge] = home;
+        Face homeOrder[2];
+        edgeFaceOrder(home, homeOrder);
+        flipSum += colors[0] != homeOrder[0];
+    }
+    if (flipSum & 1) {
+        return cubeStateFailure(CUBE_STATE_EDGE_FLIP, -1, "an odd number of edges are flipped");
+    }
+    // A face turn is a 4-cycle of corners and of edges, a slice turn of edges and of
+    // centers, a cube rotation even on corners and odd on both others
+    if (permutationIsOdd(cornerPerm, 8) ^ permutationIsOdd(edgePerm, 12) ^ permutationIsOdd(centerPerm, 6)) {
+        return cubeStateFailure(CUBE_STATE_PERMUTATION_PARITY, -1, "two pieces are swapped");
+    }
+    return cubeStateFailure(CUBE_STATE_VALID, -1, "solvable");
+}
+
+// Fill a render piece at grid position c: outer faces take their sticker color, the rest stay black
+void getPieceColors(const CubeState& state, const int c[3], CubePiece& piece) {
+    const int last = state.n - 1;
+    for (int face = 0; face < 6; face++) {
+        const float* color = COLOR_BLACK;
+        int axis = (face == LEFT || face == RIGHT) ? 0 : ((face == UP || face == DOWN) ? 1 : 2);
+        int outer = (FACE_NORMALS[face][axis] > 0) ? last : 0;
+        if (c[axis] == outer) {
+            color = STICKER_COLORS[state.stickers[logicalStickerIndex(state, face, c)]];
+        }
+        piece.colors[face][0] = color[0];
+        piece.colors[face][1] = color[1];
+        piece.colors[face][2] = color[2];
+    }
+    piece.position[0] = c[0];
+    piece.position[1] = c[1];
+    piece.position[2] = c[2];
+    piece.isVisible = true;
+}
+
+float easeInOutCubic(float t) {
+    if (t < 0.0f) {
+        t = 0.0f;
+    } else if (t > 1.0f) {
+        t = 1.0f;
+    }
+    if (t < 0.5f) {
+        return 4.0f * t * t * t;
+    }
+    float f = (2.0f * t) - 2.0f;
+    return 0.5f * f * f * f + 1.0f;
+}
+
+bool isAnimationActive() {
+    return g_activeAnimationCount > 0;
+}
+
+// Slot turning `layer` of the shared animation axis, or -1
+int animationSlotOfLayer(int layer) {
+    for (int slot = 0; slot < MAX_CONCURRENT_ANIMATIONS; slot++) {
+        if (g_animations[slot].isActive && g_animations[slot].layerMask[layer]) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+int activeAnimationAxis() {
+    for (int slot = 0; slot < MAX_CONCURRENT_ANIMATIONS; slot++) {
+        if (g_animations[slot].isActive) {
+            return g_animations[slot].axis;
+        }
+    }
+    return -1;
+}
+
+bool isPieceInAnimation(const int position[3]) {
+    int axis = activeAnimationAxis();
+    return axis >= 0 && animationSlotOfLayer(position[axis]) >= 0;
+}
+
+// Moves waiting in both queues (a snapshot while a script thread is producing)
+int getMoveQueueCount() {
+    return (int)(g_moveQueue.produced - g_moveQueue.consumed)
+        + (int)(g_scriptMoveQueue.produced - g_scriptMoveQueue.consumed);
+}
+
+// Producer side: each queue has exactly one producer thread
+void enqueueMove(MoveQueue& queue, const MoveToken& move, bool isScrambleMove,
+                 const InputLatencyStamp* input = NULL) {
+    MoveQueueChunk* tail = queue.tail;
+    int slot = tail->written;
+    if (slot == MOVE_QUEUE_CHUNK_SIZE) {
+        MoveQueueChunk* chunk = new MoveQueueChunk();
+        chunk->written = 0;
+        chunk->next = NULL;
+        MEMORY_BARRIER();
+        tail->next = chunk;
+        queue.tail = chunk;
+        tail = chunk;
+        slot = 0;
+    }
+    QueuedMove& entry = tail->entries[slot];
+    entry.move = move;
+    entry.isScrambleMove = isScrambleMove;
+    entry.enqueuedMs = getHighResTimeMs();
+    entry.input.arrivalNs = (input != NULL) ? input->arrivalNs : 0;
+    entry.input.queuedBehind = (input != NULL) ? input->queuedBehind : 0;
+    entry.generation = queue.generation;
+    entry.sequence = ATOMIC_INC32(&g_moveSequence);
+    MEMORY_BARRIER();
+    tail->written = slot + 1;
+    queue.produced++;
+}
+
+// Consumer side (main thread only)
+bool dequeueFrom(MoveQueue& queue, MoveToken& move, bool& isScrambleMove,
+                 InputLatencyStamp* input = NULL) {
+    MoveQueueChunk* head = queue.head;
+    if (queue.read == MOVE_QUEUE_CHUNK_SIZE) {
+        MoveQueueChunk* next = head->next;
+        if (next == NULL) {
+            return false;
+        }
+        MEMORY_BARRIER();
+        queue.head = next;
+        queue.read = 0;
+        delete head;
+        head = next;
+    }
+    if (queue.read >= head->written) {
+        return false;
+    }
+    MEMORY_BARRIER();
+    const QueuedMove& entry = head->entries[queue.read];
+    move = entry.move;
+    isScrambleMove = entry.isScrambleMove;
+    if (input != NULL) {
+        *input = entry.input;
+    }
+    traceAsyncSpan("queued", "queue", entry.enqueuedMs, getHighResTimeMs());
+    queue.read++;
+    queue.consumed++;
+    return true;
+}
+
+// Consumer side: the next entry without taking it, or NULL
+const QueuedMove* queueHead(MoveQueue& queue) {
+    MoveQueueChunk* head = queue.head;
+    int read = queue.read;
+    if (read == MOVE_QUEUE_CHUNK_SIZE) {
+        head = head->next;
+        if (head == NULL) {
+            return NULL;
+        }
+        read = 0;
+    }
+    if (read >= head->written) {
+        return NULL;
+    }
+    MEMORY_BARRIER();
+    return &head->entries[read];
+}
+
+// Consumer side: the queue whose head was posted first, or NULL if both are empty.
+// Heads from a cancelled generation are dropped on the way. Two posts racing on
+// different threads may come out either way round; anything else keeps posting order.
+MoveQueue* earliestMoveQueue() {
+    MoveQueue* queues[2] = {&g_moveQueue, &g_scriptMoveQueue};
+    const QueuedMove* heads[2];
+    for (int q = 0; q < 2; q++) {
+        while ((heads[q] = queueHead(*queues[q])) != NULL && heads[q]->generation != g_queueGeneration) {
+            MoveToken move;
+            bool isScrambleMove;
+            dequeueFrom(*queues[q], move, isScrambleMove);
+        }
+    }
+    if (heads[0] == NULL || heads[1] == NULL) {
+        return heads[0] != NULL ? queues[0] : (heads[1] != NULL ? queues[1] : NULL);
+    }
+    return (int)(heads[1]->sequence - heads[0]->sequence) < 0 ? queues[1] : queues[0];
+}
+
+// The move dequeueQueuedMove(..., queue) takes next; handing `queue` back keeps a script
+// post that lands in between from changing which entry that is
+bool peekQueuedMove(MoveToken& move, bool& isScrambleMove, MoveQueue*& queue) {
+    queue = earliestMoveQueue();
+    if (queue == NULL) {
+        return false;
+    }
+    const QueuedMove* head = queueHead(*queue);
+    move = head->move;
+    isScrambleMove = head->isScrambleMove;
+    return true;
+}
+
+// Next move to animate, in posting order across local input and the script thread
+bool dequeueQueuedMove(MoveToken& move, bool& isScrambleMove, InputLatencyStamp* input = NULL,
+                       MoveQueue* queue = NULL) {
+    if (queue == NULL) {
+        queue = earliestMoveQueue();
+    }
+    if (queue == NULL || !dequeueFrom(*queue, move, isScrambleMove, input)) {
+        return false;
+    }
+    traceCounter("moveQueue", getMoveQueueCount());
+    return true;
+}
+
+void resetAnimationSlot(RotationAnimation& animation) {
+    animation.traceId = 0;
+    animation.isActive = false;
+    animation.isScrambleMove = false;
+    animation.currentAngle = 0.0f;
+    animation.displayAngle = 0.0f;
+    animation.previousDisplayAngle = 0.0f;
+    animation.moveRepeats = 1;
+    animation.mergedMoves = 1;
+    animation.input.arrivalNs = 0;
+    memset(animation.layerMask, 0, sizeof(animation.layerMask));
+}
+
+void cancelAnimationAndQueue() {
+    for (int slot = 0; slot < MAX_CONCURRENT_ANIMATIONS; slot++) {
+        if (g_animations[slot].isActive) {
+            traceAsyncEnd(moveNotation(g_animations[slot].move), "move", g_animations[slot].traceId);
+        }
+        resetAnimationSlot(g_animations[slot]);
+    }
+    g_activeAnimationCount = 0;
+    // Drain on the consumer side, then retire the generation: a running script stops
+    // posting, and anything it publishes meanwhile is dropped when it reaches the head
+    int dropped = 0;
+    MoveToken move;
+    bool isScrambleMove;
+    while (dequeueQueuedMove(move, isScrambleMove)) {
+        dropped++;
+    }
+    g_queueGeneration++;
+    g_moveQueue.generation = g_queueGeneration;
+    traceInstant("cancel animation + queue", "queue", "dropped", dropped);
+}
+
+// Turning speed for the frame: the base speed, raised so that this turn plus
+// everything queued behind it plays out within ANIMATION_MAX_LAG_SEC
+float adaptiveAnimationSpeed(const RotationAnimation& animation) {
+    float remaining = (animation.targetAngle - animation.currentAngle) + 90.0f * (float)getMoveQueueCount();
+    float speed = remaining / ANIMATION_MAX_LAG_SEC;
+    if (speed < ROTATION_SPEED_DEG_PER_SEC) {
+        speed = ROTATION_SPEED_DEG_PER_SEC;
+    } else if (speed > ROTATION_SPEED_DEG_PER_SEC * ANIMATION_MAX_SPEEDUP) {
+        speed = ROTATION_SPEED_DEG_PER_SEC * ANIMATION_MAX_SPEEDUP;
+    }
+    return speed;
+}
+
+bool isSameLayerMove(const MoveToken& a, const MoveToken& b) {
+    return a.kind == b.kind && a.face == b.face && (a.kind != MOVE_WIDE || a.depth == b.depth);
+}
+
+// A move may start now if nothing animates, or if a slot is free and it turns other
+// layers of the axis already turning (rotations cover every layer, so they always wait)
+bool canAnimateConcurrently(const MoveToken& move) {
+    if (g_activeAnimationCount == 0) {
+        return true;
+    }
+    if (g_activeAnimationCount == MAX_CONCURRENT_ANIMATIONS || move.kind == MOVE_ROTATION) {
+        return false;
+    }
+    int axis, from, to, quarterTurns;
+    moveToLayerRange(g_rubikCube.state.n, move, axis, from, to, quarterTurns);
+    if (axis != activeAnimationAxis()) {
+        return false;
+    }
+    for (int layer = from; layer <= to; layer++) {
+        if (animationSlotOfLayer(layer) >= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void startRotation(Face face, bool clockwise, bool isScrambleMove) {
+    if (face < FRONT || face > DOWN) {
+        return;
+    }
+    startMove(makeMove(MOVE_FACE, face, clockwise), isScrambleMove);
+}
+
+// Log name of a move: the face name for outer turns, notation otherwise
+const char* moveLogName(const MoveToken& move) {
+    const char* faceNames[] = {"FRONT", "BACK", "LEFT", "RIGHT", "UP", "DOWN"};
+    if (move.kind == MOVE_FACE) {
+        return faceNames[move.face];
+    }
+    return moveNotation(makeMove(move.kind, move.face, true));
+}
+
+void startMove(const MoveToken& move, bool isScrambleMove) {
+    if (!isScrambleMove) {
+        recordSolveTurn(move);
+    }
+    InputLatencyStamp input = currentInputStamp();
+    // Behind already queued moves or a conflicting animation: keep FIFO order
+    if (getMoveQueueCount() > 0 || !canAnimateConcurrently(move)) {
+        enqueueMove(g_moveQueue, move, isScrambleMove, &input);
+        traceCounter("moveQueue", getMoveQueueCount());
+        if (g_logFile != NULL) {
+            double tsMs = getLogTimestampMs();
+            fprintf(g_logFile, "[%010.3f ms] ANIM QUEUED %s %s | queue=%d\n",
+                    tsMs,
+                    moveLogName(move),
+                    move.clockwise ? "CW" : "CCW",
+                    getMoveQueueCount());
+            fflush(g_logFile);
+        }
+        return;
+    }
+    beginMoveAnimation(move, isScrambleMove, &input);
+}
+
+// Consumer side: start animating a move now in a free slot (canAnimateConcurrently()
+// must hold). Queued turns of the same layers right behind it are folded in: two make
+// one 180 degree animation, and turns that cancel out are dropped without animating.
+void beginMoveAnimation(const MoveToken& firstMove, bool isScrambleMove, const InputLatencyStamp* input) {
+    MoveToken move = firstMove;
+    int netQuarterTurns = move.clockwise ? 1 : 3;
+    int mergedMoves = 1;
+    MoveToken next;
+    bool nextIsScramble;
+    MoveQueue* nextQueue;
+    while (peekQueuedMove(next, nextIsScramble, nextQueue) &&
+           isSameLayerMove(next, move) && nextIsScramble == isScrambleMove) {
+        dequeueQueuedMove(next, nextIsScramble, NULL, nextQueue);
+        netQuarterTurns = (netQuarterTurns + (next.clockwise ? 1 : 3)) % 4;
+        mergedMoves++;
+    }
+    // Whole-cube rotations are not turns: they don't start the timer or count toward TPS
+    if (move.kind != MOVE_ROTATION) {
+        for (int i = 0; i < mergedMoves; i++) {
+            onMoveStarted();
+        }
+    }
+    if (netQuarterTurns == 0) {
+        if (g_logFile != NULL) {
+            double tsMs = getLogTimestampMs();
+            fprintf(g_logFile, "[%010.3f ms] ANIM CANCELLED %s x%d | queue=%d\n",
+                    tsMs, moveLogName(move), mergedMoves, getMoveQueueCount());
+            fflush(g_logFile);
+        }
+        for (int i = 0; i < mergedMoves; i++) {
+            handleScrambleMoveCompletion(isScrambleMove);
+        }
+        requestRedisplay();
+        return;
+    }
+    int slot = 0;
+    while (g_animations[slot].isActive) {
+        slot++;
+    }
+    RotationAnimation& animation = g_animations[slot];
+    move.clockwise = (netQuarterTurns != 3);
+    animation.isActive = true;
+    animation.move = move;
+    animation.isScrambleMove = isScrambleMove;
+    animation.moveRepeats = (netQuarterTurns == 2) ? 2 : 1;
+    animation.mergedMoves = mergedMoves;
+    animation.input.arrivalNs = (input != NULL) ? input->arrivalNs : 0;
+    animation.input.queuedBehind = (input != NULL) ? input->queuedBehind : 0;
+    animation.startNs = getMonotonicTimeNs();
+    animation.currentAngle = 0.0f;
+    animation.displayAngle = 0.0f;
+    animation.previousDisplayAngle = 0.0f;
+    animation.targetAngle = 90.0f * (float)animation.moveRepeats;
+    animation.speed = adaptiveAnimationSpeed(animation);
+    int from, to;
+    moveToLayerRange(g_rubikCube.state.n, move, animation.axis, from, to, animation.quarterTurns);
+    if (animation.moveRepeats == 2) {
+        animation.quarterTurns = 2;
+    }
+    memset(animation.layerMask, 0, sizeof(animation.layerMask));
+    for (int layer = from; layer <= to; layer++) {
+        animation.layerMask[layer] = 1;
+    }
+    g_activeAnimationCount++;
+    animation.traceId = traceAsyncBegin(moveNotation(move), "move");
+    if (g_logFile != NULL) {
+        double tsMs = getLogTimestampMs();
+        fprintf(g_logFile, "[%010.3f ms] ANIM START %s %s%s | queue=%d speed=%.0f active=%d\n",
+                tsMs,
+                moveLogName(move),
+                move.clockwise ? "CW" : "CCW",
+                animation.moveRepeats == 2 ? " x2" : "",
+                getMoveQueueCount(),
+                animation.speed,
+                g_activeAnimationCount);
+        fflush(g_logFile);
+    }
+    requestRedisplay();
+}
+
+// Start queued moves from the front for as long as they fit next to the running ones
+void startQueuedAnimations() {
+    MoveToken move;
+    bool isScrambleMove;
+    InputLatencyStamp input;
+    MoveQueue* queue;
+    while (peekQueuedMove(move, isScrambleMove, queue) && canAnimateConcurrently(move)) {
+        dequeueQueuedMove(move, isScrambleMove, &input, queue);
+        beginMoveAnimation(move, isScrambleMove, &input);
+    }
+}
+
+// ========================================================================
+// Move history: undo / redo and time-travel scrubbing
+// ========================================================================
+// Every committed move is appended to a flat list; undo applies the inverse of the
+// move before the cursor (computed on demand, nothing extra is stored) and redo
+// reapplies the one after it. A copy of the cube is kept every `interval` moves, so
+// jumping to any position restores the nearest earlier checkpoint and replays at most
+// `interval` moves, whatever the session length. The history starts over at a reset
+// and whenever a scramble finishes, so it always covers the current solve. While a
+// timed solve is armed or running, navigation is ignored: the solve log records only
+// forward turns, so a solve with undos couldn't be reconstructed from its record.
+
+const int HISTORY_CHECKPOINT_INTERVAL = 64;
+const int HISTORY_CHECKPOINT_STICKER_BUDGET = 1024;  // bigger cubes checkpoint less often
+const int HISTORY_SCRUB_STEP = 10;
+
+struct MoveHistory {
+    std::vector<MoveToken> moves;
+    std::vector<CubeState> checkpoints;  // state after i * interval moves
+    size_t cursor;                       // moves[0, cursor) are applied
+    int interval;
+};
+
+MoveHistory g_history;
+
+// Keep checkpoint memory bounded on big cubes: interval grows with the sticker count
+int historyCheckpointInterval(int n) {
+    int interval = (6 * n * n) / HISTORY_CHECKPOINT_STICKER_BUDGET;
+    return interval > HISTORY_CHECKPOINT_INTERVAL ? interval : HISTORY_CHECKPOINT_INTERVAL;
+}
+
+MoveToken inverseMove(const MoveToken& move) {
+    MoveToken inverse = move;
+    inverse.clockwise = !move.clockwise;
+    return inverse;
+}
+
+void resetMoveHistory() {
+    g_history.moves.clear();
+    g_history.checkpoints.clear();
+    g_history.checkpoints.push_back(g_rubikCube.state);
+    g_history.cursor = 0;
+    g_history.interval = historyCheckpointInterval(g_rubikCube.state.n);
+}
+
+// Commit hook: a new move after an undo drops the redo tail
+void recordHistoryMove(const MoveToken& move) {
+    if (g_history.checkpoints.empty()) {
+        resetMoveHistory();
+    }
+    if (g_history.cursor < g_history.moves.size()) {
+        g_history.moves.resize(g_history.cursor);
+        g_history.checkpoints.resize(g_history.cursor / g_history.interval + 1);
+    }
+    g_history.moves.push_back(move);
+    g_history.cursor++;
+    if (g_history.cursor % g_history.interval == 0) {
+        g_history.checkpoints.push_back(g_rubikCube.state);
+    }
+}
+
+// Navigation only runs when nothing is animating or queued, so it never races a turn
+bool isHistoryIdle() {
+    return g_activeAnimationCount == 0 && getMoveQueueCount() == 0 && !g_history.checkpoints.empty();
+}
+
+// Move the cube to any history position in at most `interval` move applications
+void scrubHistoryTo(size_t position) {
+    if (!isHistoryIdle()) {
+        return;
+    }
+    if (g_timer.state == TIMER_READY || g_timer.state == TIMER_RUNNING) {
+        if (g_logFile != NULL) {
+            fprintf(g_logFile, "HISTORY: navigation ignored during a timed solve\n");
+            fflush(g_logFile);
+        }
+        return;
+    }
+    if (position > g_history.moves.size()) {
+        position = g_history.moves.size();
+    }
+    size_t from = g_history.cursor;
+    size_t checkpoint = position / g_history.interval;
+    size_t checkpointStart = checkpoint * g_history.interval;
+    size_t stepDistance = position > from ? position - from : from - position;
+    int applied = 0;
+    if (stepDistance <= position - checkpointStart) {
+        // Close to where we are: step with moves and their inverses
+        for (size_t i = from; i < position; i++) {
+            applyMove(g_rubikCube.state, g_history.moves[i]);
+            applied++;
+        }
+        for (size_t i = from; i > position; i--) {
+            applyMove(g_rubikCube.state, inverseMove(g_history.moves[i - 1]));
+            applied++;
+        }
+    } else {
+        g_rubikCube.state = g_history.checkpoints[checkpoint];
+        std::vector<MoveToken> replay(g_history.moves.begin() + checkpointStart,
+                                      g_history.moves.begin() + position);
+        bulkApplyMoves(g_rubikCube.state, replay);
+        applied = (int)replay.size();
+    }
+    g_history.cursor = position;
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "HISTORY: %d -> %d of %d (%d moves applied)\n",
+                (int)from, (int)position, (int)g_history.moves.size(), applied);
+        fflush(g_logFile);
+    }
+    requestRedisplay();
+}
+
+void undoMove() {
+    if (g_history.cursor > 0) {
+        scrubHistoryTo(g_history.cursor - 1);
+    }
+}
+
+void redoMove() {
+    scrubHistoryTo(g_history.cursor + 1);
+}
+
+// Commit a finished slot: its moves are applied now, independently of the other slots
+void finishAnimation(RotationAnimation& animation) {
+    MoveToken finishedMove = animation.move;
+    bool finishedWasScramble = animation.isScrambleMove;
+    int finishedMerged = animation.mergedMoves;
+    for (int i = 0; i < animation.moveRepeats; i++) {
+        performMove(finishedMove);
+        recordHistoryMove(finishedMove);
+    }
+    traceAsyncEnd(moveNotation(finishedMove), "move", animation.traceId);
+    markLatencyMotion(animation);
+    resetAnimationSlot(animation);
+    g_activeAnimationCount--;
+    if (g_logFile != NULL) {
+        double tsMs = getLogTimestampMs();
+        fprintf(g_logFile, "[%010.3f ms] ANIM END %s %s | queue=%d\n",
+                tsMs,
+                moveLogName(finishedMove),
+                finishedMove.clockwise ? "CW" : "CCW",
+                getMoveQueueCount());
+        fflush(g_logFile);
+    }
+    for (int i = 0; i < finishedMerged; i++) {
+        handleScrambleMoveCompletion(finishedWasScramble);
+    }
+    stopTimerIfSolved();
+}
+
+void updateAnimation(float deltaTime) {
+    // Instant mode: take the script moves posted so far in one frame, up to the first
+    // local move still queued (that one and whatever follows it play in order)
+    if (g_instantMoves && g_activeAnimationCount == 0) {
+        std::vector<MoveToken> posted;
+        MoveToken move;
+        bool isScrambleMove;
+        while (earliestMoveQueue() == &g_scriptMoveQueue && dequeueFrom(g_scriptMoveQueue, move, isScrambleMove)) {
+            posted.push_back(move);
+        }
+        if (!posted.empty()) {
+            applyMovesInstantly(posted, "script");
+            requestRedisplay();
+        }
+    }
+    if (g_activeAnimationCount == 0) {
+        // Moves posted from another thread wait here until the consumer picks them up
+        startQueuedAnimations();
+        return;
+    }
+    for (int slot = 0; slot < MAX_CONCURRENT_ANIMATIONS; slot++) {
+        RotationAnimation& animation = g_animations[slot];
+        if (!animation.isActive) {
+            continue;
+        }
+        animation.previousDisplayAngle = animation.displayAngle;
+        animation.speed = adaptiveAnimationSpeed(animation);
+        animation.currentAngle += animation.speed * deltaTime;
+        if (animation.currentAngle > animation.targetAngle) {
+            animation.currentAngle = animation.targetAngle;
+        }
+        float progress = (animation.targetAngle > 0.0f)
+            ? (animation.currentAngle / animation.targetAngle)
+            : 1.0f;
+        if (progress > 1.0f) {
+            progress = 1.0f;
+        }
+        animation.displayAngle = easeInOutCubic(progress) * animation.targetAngle;
+        if (animation.currentAngle >= animation.targetAngle - 0.0001f) {
+            finishAnimation(animation);
+        }
+    }
+    startQueuedAnimations();
+    requestRedisplay();
+}
+
+void onMoveStarted() {
+    if (g_timer.state == TIMER_READY) {
+        g_timer.state = TIMER_RUNNING;
+        g_timer.startUs = getMonotonicTimeUs();
+        g_timer.lastSampleUs = g_timer.startUs;
+        g_timer.moveCount = 0;
+        g_timer.currentUs = 0;
+        g_timer.tps = 0.0f;
+        if (g_logFile != NULL) {
+            fprintf(g_logFile, "TIMER STARTED\n");
+            fflush(g_logFile);
+        }
+    }
+    if (g_timer.state == TIMER_RUNNING) {
+        g_timer.moveCount++;
+    }
+}
+
+bool isCubeSolved() {
+    return isCubeStateSolved(g_rubikCube.state);
+}
+
+void sampleTimerClock() {
+    TimeUs now = getMonotonicTimeUs();
+    g_timer.currentUs = now - g_timer.startUs;
+    g_timer.lastSampleUs = now;
+    if (g_timer.currentUs < 0) {
+        g_timer.currentUs = 0;
+    }
+    if (g_timer.currentUs > 0) {
+        g_timer.tps = (float)((double)g_timer.moveCount * 1000000.0 / (double)g_timer.currentUs);
+    }
+}
+
+// Wall-clock display update from idle(); the solve itself ends in stopTimerIfSolved()
+void updateTimer() {
+    if (g_timer.state != TIMER_RUNNING) {
+        return;
+    }
+    sampleTimerClock();
+    requestRedisplay();
+}
+
+// Called from the fixed-step commit path (finishAnimation), so a headless --replay,
+// which never runs idle(), stops the timer on the same step the live session did
+void stopTimerIfSolved() {
+    if (g_timer.state != TIMER_RUNNING || isAnimationActive() || !isCubeSolved()) {
+        return;
+    }
+    sampleTimerClock();
+    g_timer.state = TIMER_STOPPED;
+    g_timer.endUs = g_timer.currentUs;
+    finishSolveRecord(g_timer.endUs);
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "========================================\n");
+        fprintf(g_logFile, "CUBE SOLVED!\n");
+        fprintf(g_logFile, "Time: %.6f seconds (%lld us)\n", (double)g_timer.endUs / 1000000.0, g_timer.endUs);
+        fprintf(g_logFile, "Moves: %d\n", g_timer.moveCount);
+        fprintf(g_logFile, "TPS: %.2f\n", g_timer.tps);
+        fprintf(g_logFile, "========================================\n");
+        fflush(g_logFile);
+    }
+    requestRedisplay();
+}
+
+void idle() {
+    double idleStartMs = getHighResTimeMs();
+    // Idle spins continuously; only trace it while there is work so the timeline stays readable
+    bool traceIdle = isAnimationActive() || g_timer.state == TIMER_RUNNING;
+    TimeNs now = getMonotonicTimeNs();
+    if (g_lastFrameNs == 0) {
+        g_lastFrameNs = now;
+    }
+    g_simulationLagNs += now - g_lastFrameNs;
+    g_lastFrameNs = now;
+    if (g_simulationLagNs > SIMULATION_STEP_NS * MAX_SIMULATION_STEPS_PER_FRAME) {
+        g_simulationLagNs = SIMULATION_STEP_NS * MAX_SIMULATION_STEPS_PER_FRAME;
+    }
+    double stageStartMs = getHighResTimeMs();
+    const float stepSeconds = (float)SIMULATION_STEP_NS / 1000000000.0f;
+    while (g_simulationLagNs >= SIMULATION_STEP_NS) {
+        updateAnimation(stepSeconds);
+        g_simulationStep++;
+        g_simulationLagNs -= SIMULATION_STEP_NS;
+    }
+    g_renderAlpha = (float)g_simulationLagNs / (float)SIMULATION_STEP_NS;
+    double stageEndMs = getHighResTimeMs();
+    recordProfileSample(PROFILE_UPDATE_ANIMATION, stageEndMs - stageStartMs);
+    if (traceIdle) {
+        traceComplete(PROFILE_STAGE_NAMES[PROFILE_UPDATE_ANIMATION], "frame", stageStartMs, stageEndMs);
+    }
+    updateTimer();
+    stageStartMs = stageEndMs;
+    stageEndMs = getHighResTimeMs();
+    recordProfileSample(PROFILE_UPDATE_TIMER, stageEndMs - stageStartMs);
+    recordProfileSample(PROFILE_IDLE, stageEndMs - idleStartMs);
+    if (traceIdle) {
+        traceComplete(PROFILE_STAGE_NAMES[PROFILE_UPDATE_TIMER], "frame", stageStartMs, stageEndMs);
+        traceComplete(PROFILE_STAGE_NAMES[PROFILE_IDLE], "frame", idleStartMs, stageEndMs);
+    }
+}
+
+bool performRelativeFaceTurn(int relativeFace, bool clockwise) {
+    Face absoluteFace = getAbsoluteFace(relativeFace);
+    startRotation(absoluteFace, clockwise);
+    return true;
+}
+
+// Slice / wide / whole-cube move turning like the given view-relative face
+bool performRelativeMove(MoveKind kind, int relativeFace, bool clockwise) {
+    startMove(makeMove(kind, getAbsoluteFace(relativeFace), clockwise));
+    return true;
+}
+
+// Convert relative face (F/U/R/L/D/B) to absolute face based on current front face
+// Relative faces: F=Front, U=Up, R=Right, L=Left, D=Down, B=Back (relative to current view)
+Face getAbsoluteFace(int relativeFace) {
+    if (relativeFace < 0 || relativeFace >= 6) {
+        relativeFace = 0;
+    }
+    Face selected = currentViewMapping().relative[relativeFace];
+    if (g_logFile != NULL) {
+        const char* faceNames[] = {"FRONT", "BACK", "LEFT", "RIGHT", "UP", "DOWN"};
+        double tsMs = getLogTimestampMs();
+        fprintf(g_logFile, "[%010.3f ms] REL FACE %d -> %s\n", tsMs, relativeFace, faceNames[selected]);
+        fflush(g_logFile);
+    }
+    return selected;
+}
+
+// Main move function: apply any move to the global cube
+void performMove(const MoveToken& move) {
+    TraceScope traceScope("performMove", "engine");
+    int axis, from, to, quarterTurns;
+    moveToLayerRange(g_rubikCube.state.n, move, axis, from, to, quarterTurns);
+    applyMove(g_rubikCube.state, move);
+    
+    // Log rotation with layer details
+    if (g_logFile != NULL) {
+        double tsMs = getLogTimestampMs();
+        fprintf(g_logFile, "[%010.3f ms] ROTATE %s %s: N=%d axis=%d layers=%d..%d quarter=%d%s\n",
+            tsMs,
+            moveLogName(move), move.clockwise ? "CW" : "CCW",
+            g_rubikCube.state.n, axis, from, to, quarterTurns,
+            move.kind == MOVE_ROTATION ? " (relabel)" : "");
+        fflush(g_logFile);
+    }
+}
+
+void rotateFace(int face, bool clockwise) {
+    performMove(makeMove(MOVE_FACE, static_cast<Face>(face), clockwise));
+}
+
+// Reset cube to solved state
+void resetCube() {
+    cancelAnimationAndQueue();
+    initRubikCube();
+    resetMoveHistory();
+    g_scrambleMovesPending = 0;
+    resetTimerState();
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "RESET: Cube to solved state\n");
+        fflush(g_logFile);
+    }
+}
+
+// Switch to an NxNxN cube, clamped to the supported range
+void setCubeSize(int n) {
+    if (n < MIN_CUBE_SIZE) {
+        n = MIN_CUBE_SIZE;
+    } else if (n > MAX_CUBE_SIZE) {
+        n = MAX_CUBE_SIZE;
+    }
+    if (n == g_cubeSize) {
+        return;
+    }
+    g_cubeSize = n;
+    resetCube();
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "CUBE SIZE: %dx%dx%d\n", n, n, n);
+        fflush(g_logFile);
+    }
+    reloadSessionHistory();
+}
+
+// Apply a scramble or pasted algorithm in one go: no animation, per-move logging or
+// redisplay, and the timer is armed for the solve straight away
+void applyMovesInstantly(const std::vector<MoveToken>& moves, const char* source) {
+    double startMs = getHighResTimeMs();
+    bulkApplyMoves(g_rubikCube.state, moves);
+    g_lastScramble = moves;
+    g_scrambleMovesPending = 0;
+    armTimerForSolve();
+    double endMs = getHighResTimeMs();
+    traceComplete("bulkApply", "engine", startMs, endMs);
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "INSTANT: %s, %d moves applied in %.3f ms, timer armed\n",
+                source, (int)moves.size(), endMs - startMs);
+        fflush(g_logFile);
+    }
+}
+
+// Shuffle cube with random moves
+void shuffleCube(int numMoves) {
+    if (numMoves <= 0) {
+        return;
+    }
+    if (g_instantMoves) {
+        cancelAnimationAndQueue();
+        std::vector<MoveToken> moves;
+        for (int i = 0; i < numMoves; i++) {
+            moves.push_back(makeMove(MOVE_FACE, static_cast<Face>(rand() % 6), (rand() % 2) == 0));
+        }
+        applyMovesInstantly(moves, "shuffle");
+        return;
+    }
+    resetTimerState();
+    g_scrambleMovesPending = numMoves;
+    g_lastScramble.clear();
+    for (int i = 0; i < numMoves; i++) {
+        Face face = static_cast<Face>(rand() % 6);
+        bool clockwise = (rand() % 2) == 0;
+        g_lastScramble.push_back(makeMove(MOVE_FACE, face, clockwise));
+        startRotation(face, clockwise, true);
+    }
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "SHUFFLE: %d random moves queued\n", numMoves);
+        fflush(g_logFile);
+    }
+}
+
+// Standard notation: F B L R U D, wide Rw / r / 3Rw, slices M E S, rotations x y z,
+// each optionally followed by 2 and/or '
+bool parseMoveSequence(const char* text, std::vector<MoveToken>& moves) {
+    const char* p = text;
+    while (p != NULL && *p != '\0') {
+        if (isspace((unsigned char)*p) || *p == ',') {
+            p++;
+            continue;
+        }
+        const char* tokenStart = p;
+        int depth = 0;
+        while (isdigit((unsigned char)*p)) {
+            depth = depth * 10 + (*p - '0');
+            p++;
+        }
+        MoveToken token = makeMove(MOVE_FACE, FRONT, true);
+        bool known = true;
+        switch (*p) {
+            case 'F': case 'f': token.face = FRONT; break;
+            case 'B': case 'b': token.face = BACK; break;
+            case 'L': case 'l': token.face = LEFT; break;
+            case 'R': case 'r': token.face = RIGHT; break;
+            case 'U': case 'u': token.face = UP; break;
+            case 'D': case 'd': token.face = DOWN; break;
+            case 'M': token.kind = MOVE_SLICE; token.face = LEFT; break;
+            case 'E': token.kind = MOVE_SLICE; token.face = DOWN; break;
+            case 'S': token.kind = MOVE_SLICE; token.face = FRONT; break;
+            case 'x': token.kind = MOVE_ROTATION; token.face = RIGHT; break;
+            case 'y': token.kind = MOVE_ROTATION; token.face = UP; break;
+            case 'z': token.kind = MOVE_ROTATION; token.face = FRONT; break;
+            default: known = false; break;
+        }
+        if (known && token.kind == MOVE_FACE) {
+            // Lowercase face letters are the two-layer wide shorthand (r = Rw)
+            if (islower((unsigned char)*p) || p[1] == 'w') {
+                token.kind = MOVE_WIDE;
+                token.depth = (depth > 0) ? depth : 2;
+                if (p[1] == 'w') {
+                    p++;
+                }
+            }
+        }
+        // A depth prefix only makes sense on a wide move
+        if (!known || (depth > 0 && token.kind != MOVE_WIDE)) {
+            if (g_logFile != NULL) {
+                fprintf(g_logFile, "PARSE MOVES: unknown token '%c'\n", *tokenStart);
+                fflush(g_logFile);
+            }
+            return false;
+        }
+        p++;
+        int turns = 1;
+        if (*p == '2') {
+            turns = 2;
+            p++;
+        }
+        if (*p == '\'') {
+            token.clockwise = false;
+            p++;
+        }
+        for (int t = 0; t < turns; t++) {
+            moves.push_back(token);
+        }
+    }
+    return true;
+}
+
+// "--play file": a script thread parses a move file and posts every move to
+// g_scriptMoveQueue; the animation consumer plays them in order, none are dropped
+std::string g_playScriptPath;
+
+// One whole line of any length (without the '\n'); false at end of file
+bool readWholeLine(FILE* file, std::string& line) {
+    char buffer[4096];
+    line.clear();
+    while (fgets(buffer, sizeof(buffer), file) != NULL) {
+        size_t length = strlen(buffer);
+        if (length > 0 && buffer[length - 1] == '\n') {
+            line.append(buffer, length - 1);
+            return true;
+        }
+        line.append(buffer, length);
+    }
+    return !line.empty();
+}
+
+// Stops at the first bad line: the moves before it are posted, nothing after it.
+// Also stops once a reset or new scramble retires the queue generation it started in.
+void playScriptFile(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        std::cerr << "Error: cannot open move script " << path << std::endl;
+        return;
+    }
+    std::string line;
+    int lineNumber = 0;
+    int posted = 0;
+    bool ok = true;
+    bool cancelled = false;
+    while (readWholeLine(file, line)) {
+        lineNumber++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::vector<MoveToken> moves;
+        if (!parseMoveSequence(line.c_str(), moves)) {
+            std::cerr << "Error: bad move in script " << path << ":" << lineNumber << ", stopping" << std::endl;
+            ok = false;
+            break;
+        }
+        for (size_t m = 0; m < moves.size() && !cancelled; m++) {
+            cancelled = g_scriptMoveQueue.generation != g_queueGeneration;
+            if (!cancelled) {
+                enqueueMove(g_scriptMoveQueue, moves[m], false);
+                posted++;
+            }
+        }
+        if (cancelled) {
+            break;
+        }
+    }
+    fclose(file);
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "PLAY: %d moves posted from %s%s\n", posted, path,
+                cancelled ? " (stopped by a reset)" : (ok ? "" : " (aborted at a bad line)"));
+        fflush(g_logFile);
+    }
+}
+
+#ifdef _WIN32
+DWORD WINAPI scriptThreadMain(LPVOID) {
+    playScriptFile(g_playScriptPath.c_str());
+    return 0;
+}
+#else
+void* scriptThreadMain(void*) {
+    playScriptFile(g_playScriptPath.c_str());
+    return NULL;
+}
+#endif
+
+bool startScriptThread(const char* path) {
+    g_playScriptPath = path;
+    g_scriptMoveQueue.generation = g_queueGeneration;
+#ifdef _WIN32
+    HANDLE thread = CreateThread(NULL, 0, scriptThreadMain, NULL, 0, NULL);
+    if (thread == NULL) {
+        return false;
+    }
+    CloseHandle(thread);
+#else
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, scriptThreadMain, NULL) != 0) {
+        return false;
+    }
+    pthread_detach(thread);
+#endif
+    return true;
+}
+
+// ========================================================================
+// Layer-rotation vertex shader (GLSL 1.10, compatibility profile)
+// ========================================================================
+
+#ifndef GL_VERTEX_SHADER
+#define GL_VERTEX_SHADER 0x8B31
+#endif
+#ifndef GL_FRAGMENT_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#endif
+#ifndef GL_COMPILE_STATUS
+#define GL_COMPILE_STATUS 0x8B81
+#endif
+#ifndef GL_LINK_STATUS
+#define GL_LINK_STATUS 0x8B82
+#endif
+
+typedef GLuint (APIENTRY *ShCreateShaderProc)(GLenum type);
+typedef void (APIENTRY *ShShaderSourceProc)(GLuint shader, GLsizei count, const char* const* source, const GLint* length);
+typedef void (APIENTRY *ShCompileShaderProc)(GLuint shader);
+typedef void (APIENTRY *ShGetShaderivProc)(GLuint shader, GLenum pname, GLint* params);
+typedef void (APIENTRY *ShGetInfoLogProc)(GLuint object, GLsizei maxLength, GLsizei* length, char* infoLog);
+typedef GLuint (APIENTRY *ShCreateProgramProc)();
+typedef void (APIENTRY *ShAttachShaderProc)(GLuint program, GLuint shader);
+typedef void (APIENTRY *ShLinkProgramProc)(GLuint program);
+typedef void (APIENTRY *ShGetProgramivProc)(GLuint program, GLenum pname, GLint* params);
+typedef void (APIENTRY *ShUseProgramProc)(GLuint program);
+typedef GLint (APIENTRY *ShGetUniformLocationProc)(GLuint program, const char* name);
+typedef void (APIENTRY *ShUniform1fProc)(GLint location, GLfloat v0);
+typedef void (APIENTRY *ShUniform3fProc)(GLint location, GLfloat v0, GLfloat v1, GLfloat v2);
+typedef void (APIENTRY *ShUniformMatrix4fvProc)(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+
+struct LayerShader {
+    bool available;
+    GLuint program;
+    GLint pieceOffsetLoc;
+    GLint inLayerLoc;
+    GLint layerRotationLoc;
+    ShUseProgramProc useProgram;
+    ShUniform1fProc uniform1f;
+    ShUniform3fProc uniform3f;
+    ShUniformMatrix4fvProc uniformMatrix4fv;
+};
+
+LayerShader g_layerShader;
+
+// Pieces are drawn around the origin; the shader adds the grid offset and, for pieces
+// flagged as part of the turning layer, applies the per-frame layer rotation
+const char* LAYER_VERTEX_SHADER =
+    "#version 110\n"
+    "uniform mat4 u_layerRotation;\n"
+    "uniform vec3 u_pieceOffset;\n"
+    "uniform float u_inLayer;\n"
+    "void main() {\n"
+    "    vec4 world = vec4(gl_Vertex.xyz + u_pieceOffset, 1.0);\n"
+    "    if (u_inLayer > 0.5) {\n"
+    "        world = u_layerRotation * world;\n"
+    "    }\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * world;\n"
+    "    gl_FrontColor = gl_Color;\n"
+    "    gl_BackColor = gl_Color;\n"
+    "}\n";
+
+const char* LAYER_FRAGMENT_SHADER =
+    "#version 110\n"
+    "void main() {\n"
+    "    gl_FragColor = gl_Color;\n"
+    "}\n";
+
+GLuint compileLayerShaderStage(ShCreateShaderProc createShader, ShShaderSourceProc shaderSource,
+                               ShCompileShaderProc compileShader, ShGetShaderivProc getShaderiv,
+                               ShGetInfoLogProc getShaderInfoLog, GLenum type, const char* source) {
+    GLuint shader = createShader(type);
+    GLint status = 0;
+    shaderSource(shader, 1, &source, NULL);
+    compileShader(shader);
+    getShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char infoLog[1024];
+        getShaderInfoLog(shader, sizeof(infoLog), NULL, infoLog);
+        if (g_logFile != NULL) {
+            fprintf(g_logFile, "SHADER: compile failed: %s\n", infoLog);
+            fflush(g_logFile);
+        }
+        return 0;
+    }
+    return shader;
+}
+
+// Needs a current GL context; leaves g_layerShader.available false (fixed-function path) on failure
+void initLayerShader() {
+    g_layerShader.available = false;
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int major = 0;
+    if (version == NULL || sscanf(version, "%d", &major) != 1 || major < 2) {
+        return;
+    }
+    ShCreateShaderProc createShader = (ShCreateShaderProc)loadGLProcAddress("glCreateShader");
+    ShShaderSourceProc shaderSource = (ShShaderSourceProc)loadGLProcAddress("glShaderSource");
+    ShCompileShaderProc compileShader = (ShCompileShaderProc)loadGLProcAddress("glCompileShader");
+    ShGetShaderivProc getShaderiv = (ShGetShaderivProc)loadGLProcAddress("glGetShaderiv");
+    ShGetInfoLogProc getShaderInfoLog = (ShGetInfoLogProc)loadGLProcAddress("glGetShaderInfoLog");
+    ShCreateProgramProc createProgram = (ShCreateProgramProc)loadGLProcAddress("glCreateProgram");
+    ShAttachShaderProc attachShader = (ShAttachShaderProc)loadGLProcAddress("glAttachShader");
+    ShLinkProgramProc linkProgram = (ShLinkProgramProc)loadGLProcAddress("glLinkProgram");
+    ShGetProgramivProc getProgramiv = (ShGetProgramivProc)loadGLProcAddress("glGetProgramiv");
+    ShGetUniformLocationProc getUniformLocation = (ShGetUniformLocationProc)loadGLProcAddress("glGetUniformLocation");
+    g_layerShader.useProgram = (ShUseProgramProc)loadGLProcAddress("glUseProgram");
+    g_layerShader.uniform1f = (ShUniform1fProc)loadGLProcAddress("glUniform1f");
+    g_layerShader.uniform3f = (ShUniform3fProc)loadGLProcAddress("glUniform3f");
+    g_layerShader.uniformMatrix4fv = (ShUniformMatrix4fvProc)loadGLProcAddress("glUniformMatrix4fv");
+    if (createShader == NULL || shaderSource == NULL || compileShader == NULL || getShaderiv == NULL ||
+        getShaderInfoLog == NULL || createProgram == NULL || attachShader == NULL || linkProgram == NULL ||
+        getProgramiv == NULL || getUniformLocation == NULL || g_layerShader.useProgram == NULL ||
+        g_layerShader.uniform1f == NULL || g_layerShader.uniform3f == NULL || g_layerShader.uniformMatrix4fv == NULL) {
+        return;
+    }
+    
+    GLuint vertexShader = compileLayerShaderStage(createShader, shaderSource, compileShader, getShaderiv,
+                                                  getShaderInfoLog, GL_VERTEX_SHADER, LAYER_VERTEX_SHADER);
+    GLuint fragmentShader = compileLayerShaderStage(createShader, shaderSource, compileShader, getShaderiv,
+                                                    getShaderInfoLog, GL_FRAGMENT_SHADER, LAYER_FRAGMENT_SHADER);
+    if (vertexShader == 0 || fragmentShader == 0) {
+        return;
+    }
+    GLuint program = createProgram();
+    GLint linked = 0;
+    attachShader(program, vertexShader);
+    attachShader(program, fragmentShader);
+    linkProgram(program);
+    getProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        if (g_logFile != NULL) {
+            fprintf(g_logFile, "SHADER: link failed, using fixed-function layer rotation\n");
+            fflush(g_logFile);
+        }
+        return;
+    }
+    g_layerShader.program = program;
+    g_layerShader.pieceOffsetLoc = getUniformLocation(program, "u_pieceOffset");
+    g_layerShader.inLayerLoc = getUniformLocation(program, "u_inLayer");
+    g_layerShader.layerRotationLoc = getUniformLocation(program, "u_layerRotation");
+    g_layerShader.available = true;
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "SHADER: layer rotation vertex shader enabled\n");
+        fflush(g_logFile);
+    }
+}
+
+// Initialize OpenGL settings
+void initOpenGL() {
+    invalidateStickerTextures();
+    
+    // Disable face culling to show all 6 faces of each piece
+    glDisable(GL_CULL_FACE);
+    
+    // Enable depth testing for 3D rendering
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+
+#ifdef GL_MULTISAMPLE
+    glEnable(GL_MULTISAMPLE);
+#endif
+    glEnable(GL_LINE_SMOOTH);
+    glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glLineWidth(1.5f);
+    
+    // Set clear color to dark gray
+    glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+    
+    // Enable smooth shading
+    glShadeModel(GL_SMOOTH);
+    
+    // Disable OpenGL lighting so cube colors stay flat and matching textures
+    glDisable(GL_LIGHTING);
+    glDisable(GL_LIGHT0);
+    glDisable(GL_COLOR_MATERIAL);
+}
+
+// Draw a single cube piece with 6 custom colors
+void drawCubePiece(const CubePiece& piece) {
+    const float size = g_rubikCube.pieceSize * 0.5f; // Half size
+    
+    glBegin(GL_QUADS);
+    
+    // Front face (Z+) - Face 0
+    glColor3fv(piece.colors[0]);
+    glNormal3f(0.0f, 0.0f, 1.0f);
+    glVertex3f(-size, -size, size);
+    glVertex3f(size, -size, size);
+    glVertex3f(size, size, size);
+    glVertex3f(-size, size, size);
+    
+    // Back face (Z-) - Face 1
+    glColor3fv(piece.colors[1]);
+    glNormal3f(0.0f, 0.0f, -1.0f);
+    glVertex3f(size, -size, -size);
+    glVertex3f(-size, -size, -size);
+    glVertex3f(-size, size, -size);
+    glVertex3f(size, size, -size);
+    
+    // Left face (X-) - Face 2
+    glColor3fv(piece.colors[2]);
+    glNormal3f(-1.0f, 0.0f, 0.0f);
+    glVertex3f(-size, -size, -size);
+    glVertex3f(-size, -size, size);
+    glVertex3f(-size, size, size);
+    glVertex3f(-size, size, -size);
+    
+    // Right face (X+) - Face 3
+    glColor3fv(piece.colors[3]);
+    glNormal3f(1.0f, 0.0f, 0.0f);
+    glVertex3f(size, -size, size);
+    glVertex3f(size, -size, -size);
+    glVertex3f(size, size, -size);
+    glVertex3f(size, size, size);
+    
+    // Up face (Y+) - Face 4
+    glColor3fv(piece.colors[4]);
+    glNormal3f(0.0f, 1.0f, 0.0f);
+    glVertex3f(-size, size, size);
+    glVertex3f(size, size, size);
+    glVertex3f(size, size, -size);
+    glVertex3f(-size, size, -size);
+    
+    // Down face (Y-) - Face 5
+    glColor3fv(piece.colors[5]);
+    glNormal3f(0.0f, -1.0f, 0.0f);
+    glVertex3f(-size, -size, -size);
+    glVertex3f(size, -size, -size);
+    glVertex3f(size, -size, size);
+    glVertex3f(-size, -size, size);
+    
+    glEnd();
+}
+
+// Initialize Rubik's Cube (g_cubeSize^3) in the solved state with standard colors
+void initRubikCube() {
+    // Keep the overall cube ~3 units wide for every N so the camera setup still fits
+    const float scale = 3.0f / (float)g_cubeSize;
+    g_rubikCube.pieceSize = PIECE_SIZE * scale;
+    g_rubikCube.gapSize = GAP_SIZE * scale;
+    
+    // Face f holds color id f: 0=Front(red) 1=Back(orange) 2=Left(blue) 3=Right(green) 4=Up(white) 5=Down(yellow)
+    initCubeState(g_rubikCube.state, g_cubeSize);
+    
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "Initialized %dx%dx%d cube (%d stickers, %s move path)\n",
+                g_cubeSize, g_cubeSize, g_cubeSize, (int)g_rubikCube.state.stickers.size(),
+                g_cubeSize <= MAX_SPECIALIZED_CUBE_SIZE ? "specialized" : "dynamic");
+        fflush(g_logFile);
+    }
+}
+
+// Angle a frame draws: between the last two simulation steps
+float renderedDisplayAngle(const RotationAnimation& animation) {
+    return animation.previousDisplayAngle
+        + (animation.displayAngle - animation.previousDisplayAngle) * g_renderAlpha;
+}
+
+// Column-major 4x4 rotation of an animating slot's layers (about its axis by the eased angle)
+// Built once per frame instead of once per animating piece
+void computeLayerRotationMatrix(const RotationAnimation& animation, float m[16]) {
+    int axis = animation.axis;
+    float displayAngle = renderedDisplayAngle(animation);
+    // Clockwise about +axis is a negative glRotatef angle
+    float angle = (animation.quarterTurns == 3) ? displayAngle : -displayAngle;
+    float angleRad = angle * 3.14159265f / 180.0f;
+    float c = cos(angleRad);
+    float sn = sin(angleRad);
+    for (int i = 0; i < 16; i++) {
+        m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+    }
+    // Same convention as glRotatef(angle, axis): counter-clockwise looking down the +axis
+    int a = (axis + 1) % 3;
+    int b = (axis + 2) % 3;
+    m[a * 4 + a] = c;
+    m[b * 4 + b] = c;
+    m[a * 4 + b] = sn;   // column a, row b
+    m[b * 4 + a] = -sn;  // column b, row a
+}
+
+// ========================================================================
+// Big-cube renderer (textured faces instead of N^3 boxes)
+// ========================================================================
+// Each storage face block is one N x N color texture, so a face is one quad whatever N
+// is. Lazy face offsets and whole-cube relabeling only change texture coordinates.
+// The move paths mark the rectangle each block changed in (a row or column strip per
+// ring face) and a sync uploads just those texels. A block whose Zobrist share no
+// longer matches what was uploaded (a history restore, a copied-in state) is diffed
+// in full instead. The turning layers are drawn as a separate block between black caps.
+
+const int TEXTURE_RENDER_MIN_CUBE_SIZE = 11;  // per-piece boxes stop scaling around 10x10x10
+const int TEXTURE_GRID_MAX_CUBE_SIZE = 32;    // black sticker grid lines up to this size (denser turns to moire)
+
+struct StickerTextures {
+    bool valid;                          // textures exist in the current GL context
+    int n;
+    int texSize;                         // power of two >= n
+    GLuint ids[6];                       // one texture per storage face block
+    std::vector<unsigned char> uploaded; // stickers as last uploaded
+    unsigned long long shares[6];        // Zobrist share of each uploaded block (see CubeState::zobrist)
+    std::vector<unsigned char> rgb;      // scratch for sub-image uploads
+};
+
+StickerTextures g_stickerTextures;
+
+// Call when the GL context is (re)created: old texture names belong to the old context
+void invalidateStickerTextures() {
+    g_stickerTextures.valid = false;
+}
+
+// Upload the texels of block f inside rect that differ from the last upload (as their
+// bounding rectangle), keeping the block's uploaded Zobrist share in step
+void uploadChangedStickers(StickerTextures& tex, const CubeState& state, int f, const StickerDirtyRect& rect) {
+    const int n = state.n;
+    const size_t base = (size_t)f * n * n;
+    const unsigned char* now = &state.stickers[base];
+    unsigned char* old = &tex.uploaded[base];
+    const unsigned long long* keys = &zobristKeyTable(n).keys[base];
+    int minRow = n, maxRow = -1, minCol = n, maxCol = -1;
+    for (int v = rect.minRow; v <= rect.maxRow; v++) {
+        const int row = v * n;
+        if (memcmp(now + row + rect.minCol, old + row + rect.minCol, rect.maxCol - rect.minCol + 1) == 0) {
+            continue;
+        }
+        minRow = std::min(minRow, v);
+        maxRow = v;
+        for (int u = rect.minCol; u <= rect.maxCol; u++) {
+            if (now[row + u] != old[row + u]) {
+                tex.shares[f] ^= zobristKey(keys[row + u], old[row + u]) ^ zobristKey(keys[row + u], now[row + u]);
+                minCol = std::min(minCol, u);
+                maxCol = std::max(maxCol, u);
+            }
+        }
+    }
+    if (maxRow < 0) {
+        return;
+    }
+    const int w = maxCol - minCol + 1;
+    const int h = maxRow - minRow + 1;
+    tex.rgb.resize((size_t)w * h * 3);
+    unsigned char* out = &tex.rgb[0];
+    for (int v = minRow; v <= maxRow; v++) {
+        for (int u = minCol; u <= maxCol; u++) {
+            const float* color = STICKER_COLORS[now[v * n + u]];
+            *out++ = (unsigned char)(color[0] * 255.0f + 0.5f);
+            *out++ = (unsigned char)(color[1] * 255.0f + 0.5f);
+            *out++ = (unsigned char)(color[2] * 255.0f + 0.5f);
+        }
+        memcpy(old + v * n + minCol, now + v * n + minCol, w);
+    }
+    glBindTexture(GL_TEXTURE_2D, tex.ids[f]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, minCol, minRow, w, h, GL_RGB, GL_UNSIGNED_BYTE, &tex.rgb[0]);
+}
+
+// Upload what the move paths marked since the last sync; O(1) per block when nothing moved
+void syncStickerTextures() {
+    CubeState& state = g_rubikCube.state;
+    const int n = state.n;
+    StickerTextures& tex = g_stickerTextures;
+    if (!tex.valid || tex.n != n) {
+        if (tex.valid) {
+            glDeleteTextures(6, tex.ids);
+        }
+        tex.n = n;
+        tex.texSize = 1;
+        while (tex.texSize < n) {
+            tex.texSize *= 2;
+        }
+        glGenTextures(6, tex.ids);
+        std::vector<unsigned char> black((size_t)tex.texSize * tex.texSize * 3, 0);
+        for (int f = 0; f < 6; f++) {
+            glBindTexture(GL_TEXTURE_2D, tex.ids[f]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tex.texSize, tex.texSize, 0, GL_RGB, GL_UNSIGNED_BYTE, &black[0]);
+        }
+        // No color id is 0xFF, so every block mismatches its share and uploads in full
+        tex.uploaded.assign(state.stickers.size(), 0xFF);
+        const unsigned long long* keys = &zobristKeyTable(n).keys[0];
+        for (int f = 0; f < 6; f++) {
+            tex.shares[f] = 0;
+            for (size_t i = (size_t)f * n * n; i < (size_t)(f + 1) * n * n; i++) {
+                tex.shares[f] ^= zobristKey(keys[i], 0xFF);
+            }
+        }
+        tex.valid = true;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int f = 0; f < 6; f++) {
+        if (state.dirty[f].maxRow >= 0) {
+            uploadChangedStickers(tex, state, f, state.dirty[f]);
+        }
+        if (tex.shares[f] != state.zobrist[f]) {
+            markFaceDirty(state, f);
+            uploadChangedStickers(tex, state, f, state.dirty[f]);
+        }
+        clearStickerDirty(state, f);
+    }
+}
+
+// Textured quad for logical face over grid cells lo..hi (inclusive, lo[a] == hi[a] on
+// the face's own axis a), with the sticker grid drawn on top for moderate N
+void drawTexturedFaceRegion(int face, const int lo[3], const int hi[3]) {
+    const CubeState& state = g_rubikCube.state;
+    const int n = state.n;
+    const float spacing = g_rubikCube.pieceSize + g_rubikCube.gapSize;
+    const float center = (float)(n - 1) * 0.5f;
+    const int a = (face == LEFT || face == RIGHT) ? 0 : ((face == UP || face == DOWN) ? 1 : 2);
+    const int b = (a + 1) % 3;
+    const int c = (a + 2) % 3;
+    const float plane = (float)FACE_NORMALS[face][a] * (float)n * spacing * 0.5f;
+    
+    // Texture coordinates are affine in the grid: sample the origin cell and one step along b and c
+    int cell[3] = {lo[0], lo[1], lo[2]};
+    int physicalFace, u0, v0, ub, vb, uc, vc;
+    logicalStickerUV(state, face, cell, physicalFace, u0, v0);
+    cell[b] = lo[b] + 1;
+    logicalStickerUV(state, face, cell, physicalFace, ub, vb);
+    cell[b] = lo[b];
+    cell[c] = lo[c] + 1;
+    logicalStickerUV(state, face, cell, physicalFace, uc, vc);
+    const float texScale = 1.0f / (float)g_stickerTextures.texSize;
+    
+    const float kb[4] = {(float)lo[b] - 0.5f, (float)hi[b] + 0.5f, (float)hi[b] + 0.5f, (float)lo[b] - 0.5f};
+    const float kc[4] = {(float)lo[c] - 0.5f, (float)lo[c] - 0.5f, (float)hi[c] + 0.5f, (float)hi[c] + 0.5f};
+    glBindTexture(GL_TEXTURE_2D, g_stickerTextures.ids[physicalFace]);
+    glBegin(GL_QUADS);
+    for (int k = 0; k < 4; k++) {
+        float db = kb[k] - (float)lo[b];
+        float dc = kc[k] - (float)lo[c];
+        float u = (float)u0 + db * (float)(ub - u0) + dc * (float)(uc - u0);
+        float v = (float)v0 + db * (float)(vb - v0) + dc * (float)(vc - v0);
+        float p[3];
+        p[a] = plane;
+        p[b] = (kb[k] - center) * spacing;
+        p[c] = (kc[k] - center) * spacing;
+        glTexCoord2f((u + 0.5f) * texScale, (v + 0.5f) * texScale);
+        glVertex3fv(p);
+    }
+    glEnd();
+    
+    if (n > TEXTURE_GRID_MAX_CUBE_SIZE) {
+        return;
+    }
+    glDisable(GL_TEXTURE_2D);
+    glColor3fv(COLOR_BLACK);
+    glBegin(GL_LINES);
+    float p[3];
+    p[a] = plane * 1.001f;
+    for (int i = lo[b]; i <= hi[b] + 1; i++) {
+        p[b] = ((float)i - 0.5f - center) * spacing;
+        p[c] = (kc[0] - center) * spacing;
+        glVertex3fv(p);
+        p[c] = (kc[2] - center) * spacing;
+        glVertex3fv(p);
+    }
+    for (int i = lo[c]; i <= hi[c] + 1; i++) {
+        p[c] = ((float)i - 0.5f - center) * spacing;
+        p[b] = (kb[0] - center) * spacing;
+        glVertex3fv(p);
+        p[b] = (kb[1] - center) * spacing;
+        glVertex3fv(p);
+    }
+    glEnd();
+    glEnable(GL_TEXTURE_2D);
+}
+
+// Black square across the whole cube at a layer boundary (k = boundary in grid units)
+void drawLayerCap(int axis, float k) {
+    const int n = g_rubikCube.state.n;
+    const float spacing = g_rubikCube.pieceSize + g_rubikCube.gapSize;
+    const float half = (float)n * spacing * 0.5f;
+    const int b = (axis + 1) % 3;
+    const int c = (axis + 2) % 3;
+    const float sb[4] = {-half, half, half, -half};
+    const float sc[4] = {-half, -half, half, half};
+    glDisable(GL_TEXTURE_2D);
+    glColor3fv(COLOR_BLACK);
+    glBegin(GL_QUADS);
+    for (int i = 0; i < 4; i++) {
+        float p[3];
+        p[axis] = (k - (float)(n - 1) * 0.5f) * spacing;
+        p[b] = sb[i];
+        p[c] = sc[i];
+        glVertex3fv(p);
+    }
+    glEnd();
+    glEnable(GL_TEXTURE_2D);
+}
+
+// Layers first..last on axis as one solid block: its slice of the 4 side faces, plus
+// the outer face or a black cap at each end
+void drawTexturedBlock(int axis, int first, int last) {
+    const int n = g_rubikCube.state.n;
+    for (int face = 0; face < 6; face++) {
+        const int a = (face == LEFT || face == RIGHT) ? 0 : ((face == UP || face == DOWN) ? 1 : 2);
+        const bool positive = FACE_NORMALS[face][a] > 0;
+        int lo[3] = {0, 0, 0};
+        int hi[3] = {n - 1, n - 1, n - 1};
+        lo[a] = hi[a] = positive ? n - 1 : 0;
+        if (a == axis) {
+            if (positive && last != n - 1) {
+                drawLayerCap(axis, (float)last + 0.5f);
+                continue;
+            }
+            if (!positive && first != 0) {
+                drawLayerCap(axis, (float)first - 0.5f);
+                continue;
+            }
+        } else {
+            lo[axis] = first;
+            hi[axis] = last;
+        }
+        drawTexturedFaceRegion(face, lo, hi);
+    }
+}
+
+void drawBigCube() {
+    const int n = g_rubikCube.state.n;
+    syncStickerTextures();
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    const int axis = activeAnimationAxis();
+    if (axis < 0) {
+        drawTexturedBlock(0, 0, n - 1);
+    } else {
+        // One block per run of layers sharing a slot (or standing still)
+        int first = 0;
+        while (first < n) {
+            int slot = animationSlotOfLayer(first);
+            int last = first;
+            while (last + 1 < n && animationSlotOfLayer(last + 1) == slot) {
+                last++;
+            }
+            if (slot < 0) {
+                drawTexturedBlock(axis, first, last);
+            } else {
+                float layerRotation[16];
+                computeLayerRotationMatrix(g_animations[slot], layerRotation);
+                glPushMatrix();
+                glMultMatrixf(layerRotation);
+                drawTexturedBlock(axis, first, last);
+                glPopMatrix();
+            }
+            first = last + 1;
+        }
+    }
+    glDisable(GL_TEXTURE_2D);
+}
+
+// Draw the complete NxNxN Rubik's Cube (surface pieces only)
+void drawRubikCube() {
+    const CubeState& state = g_rubikCube.state;
+    const int n = state.n;
+    const float spacing = g_rubikCube.pieceSize + g_rubikCube.gapSize;
+    const float center = (float)(n - 1) * 0.5f;
+    const int animationAxis = activeAnimationAxis();
+    const bool useShader = g_layerShader.available;
+    if (n >= TEXTURE_RENDER_MIN_CUBE_SIZE) {
+        drawBigCube();
+        return;
+    }
+    // Per layer on the animation axis: the slot turning it (-1 = still), and one matrix per slot
+    int layerSlot[MAX_CUBE_SIZE];
+    float layerRotations[MAX_CONCURRENT_ANIMATIONS][16];
+    for (int layer = 0; layer < n; layer++) {
+        layerSlot[layer] = (animationAxis >= 0) ? animationSlotOfLayer(layer) : -1;
+    }
+    for (int slot = 0; slot < MAX_CONCURRENT_ANIMATIONS; slot++) {
+        if (g_animations[slot].isActive) {
+            computeLayerRotationMatrix(g_animations[slot], layerRotations[slot]);
+        }
+    }
+    int uploadedSlot = -1;
+    
+    // GPU path: one program bind + two uniforms per piece, the shader pivots flagged pieces
+    if (useShader) {
+        g_layerShader.useProgram(g_layerShader.program);
+    } else {
+        // Fixed-function fallback: same precomputed mask/matrix, applied with glMultMatrixf
+        glPushMatrix();
+    }
+    
+    CubePiece piece;
+    int c[3];
+    for (c[2] = 0; c[2] < n; c[2]++) {
+        for (c[1] = 0; c[1] < n; c[1]++) {
+            // Interior rows only have their two end pieces on the surface
+            bool interiorRow = c[1] > 0 && c[1] < n - 1 && c[2] > 0 && c[2] < n - 1;
+            int step = interiorRow ? n - 1 : 1;
+            for (c[0] = 0; c[0] < n; c[0] += step) {
+                getPieceColors(state, c, piece);
+                int slot = (animationAxis >= 0) ? layerSlot[c[animationAxis]] : -1;
+                bool inLayer = slot >= 0;
+                // Position = (grid_pos - center) * (pieceSize + gapSize)
+                float worldX = ((float)c[0] - center) * spacing;
+                float worldY = ((float)c[1] - center) * spacing;
+                float worldZ = ((float)c[2] - center) * spacing;
+                if (useShader) {
+                    g_layerShader.uniform3f(g_layerShader.pieceOffsetLoc, worldX, worldY, worldZ);
+                    if (inLayer && slot != uploadedSlot) {
+                        g_layerShader.uniformMatrix4fv(g_layerShader.layerRotationLoc, 1, GL_FALSE, layerRotations[slot]);
+                        uploadedSlot = slot;
+                    }
+                    g_layerShader.uniform1f(g_layerShader.inLayerLoc, inLayer ? 1.0f : 0.0f);
+                    drawCubePiece(piece);
+                    continue;
+                }
+                
+                // Save current matrix
+                glPushMatrix();
+                if (inLayer) {
+                    glMultMatrixf(layerRotations[slot]);
+                }
+                // Translate to piece position after optional face rotation so the whole layer pivots together
+                glTranslatef(worldX, worldY, worldZ);
+                
+                // Draw the piece with its colors
+                drawCubePiece(piece);
+                
+                // Restore matrix
+                glPopMatrix();
+            }
+        }
+    }
+    
+    if (useShader) {
+        g_layerShader.useProgram(0);
+    } else {
+        glPopMatrix();
+    }
+}
+
+void renderBitmapString(float x, float y, void* font, const char* string) {
+    glRasterPos2f(x, y);
+    while (*string != '\0') {
+        glutBitmapCharacter(font, *string);
+        ++string;
+    }
+}
+
+void formatTimerText(TimeUs micros, char* buffer, int bufferSize) {
+    if (micros < 0) {
+        micros = 0;
+    }
+    TimeUs millis = micros / 1000;
+    int minutes = (int)(millis / 60000);
+    int sec = (int)(millis / 1000 % 60);
+    int ms = (int)(millis % 1000);
+    if (bufferSize > 0) {
+        snprintf(buffer, bufferSize, "%02d:%02d.%03d", minutes, sec, ms);
+    }
+}
+
+// Profiler HUD in the top-right corner, drawn inside displayTimerOverlay()'s 2D projection
+void displayProfilerOverlay() {
+    char buffer[128];
+    const float lineHeight = 15.0f;
+    float x = (float)windowWidth - 360.0f;
+    float y = (float)windowHeight - 20.0f;
+    if (x < 10.0f) {
+        x = 10.0f;
+    }
+    glColor3f(0.6f, 0.9f, 1.0f);
+    snprintf(buffer, sizeof(buffer), "%-18s %7s %7s %7s", "stage (ms)", "p50", "p95", "p99");
+    renderBitmapString(x, y, GLUT_BITMAP_8_BY_13, buffer);
+    for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+        const StageSamples& stage = g_profiler.stages[s];
+        y -= lineHeight;
+        if (stage.count == 0) {
+            snprintf(buffer, sizeof(buffer), "%-18s %7s", PROFILE_STAGE_NAMES[s],
+                     (s == PROFILE_GPU_DRAW && !g_profiler.gpuTimerAvailable) ? "n/a" : "-");
+        } else {
+            float p50, p95, p99;
+            computeStagePercentiles(stage, p50, p95, p99);
+            snprintf(buffer, sizeof(buffer), "%-18s %7.3f %7.3f %7.3f", PROFILE_STAGE_NAMES[s], p50, p95, p99);
+        }
+        renderBitmapString(x, y, GLUT_BITMAP_8_BY_13, buffer);
+    }
+    y -= lineHeight;
+    const StageSamples& frame = g_profiler.stages[PROFILE_FRAME];
+    if (frame.count > 0) {
+        float p50, p95, p99;
+        computeStagePercentiles(frame, p50, p95, p99);
+        snprintf(buffer, sizeof(buffer), "fps(p50) %.1f  [P] hide  [O] dump", p50 > 0.0f ? 1000.0f / p50 : 0.0f);
+        renderBitmapString(x, y, GLUT_BITMAP_8_BY_13, buffer);
+    }
+    const LatencyHistogram& total = g_latency.metrics[LATENCY_TOTAL];
+    if (total.count > 0) {
+        y -= lineHeight;
+        snprintf(buffer, sizeof(buffer), "input->motion mean %.1f max %.1f ms (%ld backlogged, %ld dropped)",
+                 total.totalMs / (double)total.count, total.maxMs, g_latency.backlogged, g_latency.dropped);
+        renderBitmapString(x, y, GLUT_BITMAP_8_BY_13, buffer);
+    }
+}
+
+// Session statistics in the bottom-left corner, drawn inside displayTimerOverlay()'s 2D projection
+void displaySessionStatsOverlay() {
+    const SessionStats& stats = g_sessionStats;
+    if (stats.solves == 0) {
+        return;
+    }
+    char buffer[128];
+    char current[32];
+    char best[32];
+    const float lineHeight = 15.0f;
+    float y = 10.0f + lineHeight * (float)STATS_WINDOW_COUNT;
+    glColor3f(0.8f, 0.8f, 0.8f);
+    formatTimerText(stats.bestUs, best, sizeof(best));
+    formatTimerText(stats.totalUs / stats.solves, current, sizeof(current));
+    snprintf(buffer, sizeof(buffer), "%dx%d: %ld solves  best %s  mean %s",
+             stats.cubeSize, stats.cubeSize, stats.solves, best, current);
+    renderBitmapString(10.0f, y, GLUT_BITMAP_8_BY_13, buffer);
+    for (int w = 0; w < STATS_WINDOW_COUNT; w++) {
+        const TrimmedWindow& window = stats.windows[w];
+        TimeUs average = currentTrimmedAverage(window);
+        if (average == 0) {
+            break;
+        }
+        y -= lineHeight;
+        formatTimerText(average, current, sizeof(current));
+        formatTimerText(window.best, best, sizeof(best));
+        snprintf(buffer, sizeof(buffer), "ao%-4d %s  (best %s)", window.size, current, best);
+        renderBitmapString(10.0f, y, GLUT_BITMAP_8_BY_13, buffer);
+    }
+}
+
+void displayTimerOverlay() {
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0.0f, (float)windowWidth, 0.0f, (float)windowHeight);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    GLboolean depthEnabled = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean lightingEnabled = glIsEnabled(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_LIGHTING);
+    char buffer[128];
+    if (g_scrambleMovesPending > 0) {
+        glColor3f(1.0f, 0.6f, 0.0f);
+        snprintf(buffer, sizeof(buffer), "Scrambling... (%d moves left)", g_scrambleMovesPending);
+        renderBitmapString(10.0f, windowHeight - 20.0f, GLUT_BITMAP_HELVETICA_18, buffer);
+        renderBitmapString(10.0f, windowHeight - 40.0f, GLUT_BITMAP_HELVETICA_18,
+                           "Please wait for scramble to finish");
+    } else {
+        switch (g_timer.state) {
+            case TIMER_IDLE:
+                glColor3f(1.0f, 1.0f, 1.0f);
+                renderBitmapString(10.0f, windowHeight - 20.0f, GLUT_BITMAP_HELVETICA_18,
+                                   "Press 'S' to scramble");
+                break;
+            case TIMER_READY:
+                glColor3f(1.0f, 1.0f, 0.2f);
+                renderBitmapString(10.0f, windowHeight - 20.0f, GLUT_BITMAP_HELVETICA_18,
+                                   "READY - Make first move to start");
+                break;
+            case TIMER_RUNNING:
+                glColor3f(0.0f, 1.0f, 0.0f);
+                formatTimerText(g_timer.currentUs, buffer, sizeof(buffer));
+                renderBitmapString(10.0f, windowHeight - 20.0f, GLUT_BITMAP_HELVETICA_18,
+                                   buffer);
+                snprintf(buffer, sizeof(buffer), "Moves: %d", g_timer.moveCount);
+                renderBitmapString(10.0f, windowHeight - 40.0f, GLUT_BITMAP_HELVETICA_18,
+                                   buffer);
+                snprintf(buffer, sizeof(buffer), "TPS: %.2f", g_timer.tps);
+                renderBitmapString(10.0f, windowHeight - 60.0f, GLUT_BITMAP_HELVETICA_18,
+                                   buffer);
+                break;
+            case TIMER_STOPPED:
+                glColor3f(0.2f, 1.0f, 0.2f);
+                snprintf(buffer, sizeof(buffer), "Solved! Time %.3fs | Moves %d | TPS %.2f",
+                         (double)g_timer.endUs / 1000000.0, g_timer.moveCount, g_timer.tps);
+                renderBitmapString(windowWidth * 0.2f, windowHeight * 0.5f,
+                                   GLUT_BITMAP_HELVETICA_18, buffer);
+                break;
+        }
+    }
+    displaySessionStatsOverlay();
+    if (g_profiler.overlayVisible) {
+        displayProfilerOverlay();
+    }
+    if (depthEnabled) {
+        glEnable(GL_DEPTH_TEST);
+    }
+    if (lightingEnabled) {
+        glEnable(GL_LIGHTING);
+    }
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// Camera view transform shared by the window and headless renderers
+void applyCameraTransform() {
+    // Move camera back from origin first
+    glTranslatef(0.0f, 0.0f, -CAMERA_DISTANCE);
+    
+    // Camera orientation, rebuilt from the quaternion only when it changes
+    glMultMatrixf(g_camera.matrix);
+}
+
+// Perspective projection shared by reshape() and the headless renderer
+void applyProjection(int w, int h) {
+    // Prevent division by zero
+    if (h == 0) {
+        h = 1;
+    }
+    
+    // Set viewport to entire window
+    glViewport(0, 0, w, h);
+    
+    // Switch to projection matrix mode
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    
+    // Set up perspective projection
+    // FOV = 45 degrees, aspect ratio, near = 0.1, far = 100.0
+    const float fov = 45.0f;
+    const float aspect = (float)w / (float)h;
+    const float nearPlane = 0.1f;
+    const float farPlane = 100.0f;
+    
+    gluPerspective(fov, aspect, nearPlane, farPlane);
+    
+    // Switch back to modelview matrix mode
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// ========================================================================
+// Input recording (--record) and headless replay (--replay)
+// ========================================================================
+// Every GLUT input callback is written as it arrives, keyed on the simulation step it
+// landed before (the only clock the cube state depends on) plus the real-time delta.
+// The header holds the cube size, the shuffle seed and startup flags; the END record,
+// written at exit, holds the step count and the state key the replay must reproduce.
+//
+//   header: "RBKI" version:u8 cubeSize:varint seed:varint flags:u8
+//   event:  type:u8 dtUs:varint dSteps:varint payload (see InputEventType)
+// Varints are LEB128 (7 bits per byte, low first); coordinates are zigzag-encoded.
+// Version 2: drags turn the quaternion camera, so version-1 sessions no longer replay.
+// Version 3: END holds cubeStateKey() (stored state and orientation) instead of an FNV
+// hash of the look, so the verdict costs O(1) and also catches a diverged orientation.
+
+const unsigned char INPUT_RECORD_MAGIC[4] = {'R', 'B', 'K', 'I'};
+const unsigned char INPUT_RECORD_VERSION = 3;
+const unsigned char INPUT_FLAG_INSTANT = 1;
+
+enum InputEventType {
+    INPUT_KEY_DOWN = 1,   // key:u8 modifiers:u8
+    INPUT_KEY_UP,         // key:u8
+    INPUT_SPECIAL,        // key:varint
+    INPUT_MOUSE,          // button:u8 state:u8 x:zigzag y:zigzag
+    INPUT_MOTION,         // x:zigzag y:zigzag
+    INPUT_RESHAPE,        // w:varint h:varint
+    INPUT_END             // cubeStateKey():8 bytes little-endian
+};
+
+struct InputRecorder {
+    FILE* file;
+    TimeNs lastEventNs;
+    unsigned long lastStep;
+    long events;
+};
+
+InputRecorder g_inputRecorder = {NULL, 0, 0, 0};
+int g_replayModifiers = 0;   // glutGetModifiers() stand-in while replaying
+
+void writeVarint(std::vector<unsigned char>& out, unsigned long long value) {
+    while (value >= 0x80) {
+        out.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((unsigned char)value);
+}
+
+bool readVarint(const unsigned char*& p, const unsigned char* end, unsigned long long& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        unsigned char byte = *p++;
+        value |= (unsigned long long)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned long long zigzagEncode(long long value) {
+    return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+long long zigzagDecode(unsigned long long value) {
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+int getKeyModifiers() {
+    return g_headlessReplay ? g_replayModifiers : glutGetModifiers();
+}
+
+void finishInputRecording() {
+    if (g_inputRecorder.file == NULL) {
+        return;
+    }
+    unsigned long long key = cubeStateKey(g_rubikCube.state);
+    std::vector<unsigned char> record;
+    record.push_back((unsigned char)INPUT_END);
+    writeVarint(record, (unsigned long long)((getMonotonicTimeNs() - g_inputRecorder.lastEventNs) / 1000));
+    writeVarint(record, (unsigned long long)(g_simulationStep - g_inputRecorder.lastStep));
+    for (int i = 0; i < 8; i++) {
+        record.push_back((unsigned char)(key >> (8 * i)));
+    }
+    fwrite(&record[0], 1, record.size(), g_inputRecorder.file);
+    fclose(g_inputRecorder.file);
+    g_inputRecorder.file = NULL;
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "RECORD: %ld input events, %lu steps, state key %016llx\n",
+                g_inputRecorder.events, g_simulationStep, key);
+        fflush(g_logFile);
+    }
+}
+
+bool startInputRecording(const char* path) {
+    g_inputRecorder.file = fopen(path, "wb");
+    if (g_inputRecorder.file == NULL) {
+        return false;
+    }
+    std::vector<unsigned char> header(INPUT_RECORD_MAGIC, INPUT_RECORD_MAGIC + 4);
+    header.push_back(INPUT_RECORD_VERSION);
+    writeVarint(header, (unsigned long long)g_cubeSize);
+    writeVarint(header, (unsigned long long)g_randomSeed);
+    header.push_back(g_instantMoves ? INPUT_FLAG_INSTANT : 0);
+    fwrite(&header[0], 1, header.size(), g_inputRecorder.file);
+    g_inputRecorder.lastEventNs = getMonotonicTimeNs();
+    g_inputRecorder.lastStep = g_simulationStep;
+    g_inputRecorder.events = 0;
+    atexit(finishInputRecording);
+    return true;
+}
+
+// Called first thing in each input callback; flushed per event so a crash keeps the session
+void recordInputEvent(InputEventType type, long a, long b = 0, long c = 0, long d = 0) {
+    if (g_inputRecorder.file == NULL) {
+        return;
+    }
+    TimeNs now = getMonotonicTimeNs();
+    std::vector<unsigned char> record;
+    record.push_back((unsigned char)type);
+    writeVarint(record, (unsigned long long)((now - g_inputRecorder.lastEventNs) / 1000));
+    writeVarint(record, (unsigned long long)(g_simulationStep - g_inputRecorder.lastStep));
+    switch (type) {
+        case INPUT_KEY_DOWN:
+            record.push_back((unsigned char)a);
+            record.push_back((unsigned char)b);
+            break;
+        case INPUT_KEY_UP:
+            record.push_back((unsigned char)a);
+            break;
+        case INPUT_SPECIAL:
+            writeVarint(record, (unsigned long long)a);
+            break;
+        case INPUT_MOUSE:
+            record.push_back((unsigned char)a);
+            record.push_back((unsigned char)b);
+            writeVarint(record, zigzagEncode(c));
+            writeVarint(record, zigzagEncode(d));
+            break;
+        case INPUT_MOTION:
+            writeVarint(record, zigzagEncode(a));
+            writeVarint(record, zigzagEncode(b));
+            break;
+        case INPUT_RESHAPE:
+            writeVarint(record, (unsigned long long)a);
+            writeVarint(record, (unsigned long long)b);
+            break;
+        default:
+            return;
+    }
+    fwrite(&record[0], 1, record.size(), g_inputRecorder.file);
+    fflush(g_inputRecorder.file);
+    g_inputRecorder.lastEventNs = now;
+    g_inputRecorder.lastStep = g_simulationStep;
+    g_inputRecorder.events++;
+}
+
+// ========================================================================
+// Solve log: compact binary solve records (append-only, read back memory-mapped)
+// ========================================================================
+// One record per finished solve, appended to rubik_solves.rbks (varints as in the
+// input recording). Summary fields come first, so bulk readers can skip the turn list.
+//
+//   file:   "RBKS" version:u8, then records
+//   record: 0xA5 bodyLength:varint body
+//   body:   cubeSize unixTime inspectionUs totalUs turnCount scrambleLength (varints)
+//           scramble move codes, then per event: dtUs:varint code
+//   code:   0x00-0x7F move: face bits 0-2, clockwise bit 3, MoveKind bits 4-5,
+//                  bit 6 = wide depth (varint) follows (else depth 2 / 1)
+//           0x80-0xFF phase marker (0x80 | phase), e.g. split with Tab
+
+const unsigned char SOLVE_LOG_MAGIC[4] = {'R', 'B', 'K', 'S'};
+const unsigned char SOLVE_LOG_VERSION = 1;
+const unsigned char SOLVE_RECORD_SYNC = 0xA5;
+const unsigned char SOLVE_CODE_PHASE = 0x80;
+const unsigned char SOLVE_CODE_DEPTH = 0x40;
+
+struct SolveRecorder {
+    bool armed;           // scrambled, waiting for or inside the solve
+    bool started;         // first turn made
+    int cubeSize;
+    TimeUs armedUs;
+    TimeUs lastEventUs;
+    TimeUs inspectionUs;  // armed -> first turn
+    int turnCount;
+    int scrambleLength;
+    std::vector<unsigned char> scramble;  // move codes
+    std::vector<unsigned char> events;    // dtUs + code per turn / marker
+};
+
+SolveRecorder g_solveRecorder;
+int g_solvePhaseCount = 0;  // Tab splits so far in this solve
+std::string g_solveLogPath = "rubik_solves.rbks";
+
+void encodeMoveCode(std::vector<unsigned char>& out, const MoveToken& move) {
+    unsigned char code = (unsigned char)(move.face | (move.clockwise ? 0x08 : 0) | (move.kind << 4));
+    bool extraDepth = move.kind == MOVE_WIDE && move.depth != 2;
+    out.push_back(extraDepth ? (unsigned char)(code | SOLVE_CODE_DEPTH) : code);
+    if (extraDepth) {
+        writeVarint(out, (unsigned long long)move.depth);
+    }
+}
+
+bool decodeMoveCode(const unsigned char*& p, const unsigned char* end, MoveToken& move) {
+    if (p >= end || (*p & SOLVE_CODE_PHASE) != 0 || (*p & 0x07) > DOWN) {
+        return false;
+    }
+    unsigned char code = *p++;
+    move = makeMove((MoveKind)((code >> 4) & 3), (Face)(code & 7), (code & 0x08) != 0,
+                    ((code >> 4) & 3) == MOVE_WIDE ? 2 : 1);
+    if (code & SOLVE_CODE_DEPTH) {
+        unsigned long long depth;
+        if (!readVarint(p, end, depth)) {
+            return false;
+        }
+        move.depth = (int)depth;
+    }
+    return true;
+}
+
+void discardSolveRecord() {
+    g_solveRecorder.armed = false;
+    g_solveRecorder.started = false;
+}
+
+// Timer armed after a scramble: a new record starts with that scramble
+void beginSolveRecord() {
+    SolveRecorder& rec = g_solveRecorder;
+    rec.armed = true;
+    rec.started = false;
+    rec.cubeSize = g_rubikCube.state.n;
+    rec.armedUs = getMonotonicTimeUs();
+    rec.lastEventUs = rec.armedUs;
+    rec.inspectionUs = 0;
+    rec.turnCount = 0;
+    g_solvePhaseCount = 0;
+    rec.scrambleLength = (int)g_lastScramble.size();
+    rec.scramble.clear();
+    rec.events.clear();
+    for (size_t i = 0; i < g_lastScramble.size(); i++) {
+        encodeMoveCode(rec.scramble, g_lastScramble[i]);
+    }
+}
+
+// Every solver move at input time (queued or not), whole-cube rotations included
+void recordSolveTurn(const MoveToken& move) {
+    SolveRecorder& rec = g_solveRecorder;
+    if (!rec.armed) {
+        return;
+    }
+    TimeUs now = getMonotonicTimeUs();
+    // Rotations during inspection don't start the solve; keep them for the reconstruction
+    if (!rec.started && move.kind == MOVE_ROTATION) {
+        writeVarint(rec.events, 0);
+        encodeMoveCode(rec.events, move);
+        rec.turnCount++;
+        return;
+    }
+    if (!rec.started) {
+        rec.started = true;
+        rec.inspectionUs = now - rec.armedUs;
+        rec.lastEventUs = now;
+    }
+    writeVarint(rec.events, (unsigned long long)(now - rec.lastEventUs));
+    encodeMoveCode(rec.events, move);
+    rec.lastEventUs = now;
+    rec.turnCount++;
+}
+
+void recordSolvePhase(int phase) {
+    SolveRecorder& rec = g_solveRecorder;
+    if (!rec.started) {
+        return;
+    }
+    TimeUs now = getMonotonicTimeUs();
+    writeVarint(rec.events, (unsigned long long)(now - rec.lastEventUs));
+    rec.events.push_back((unsigned char)(SOLVE_CODE_PHASE | (phase & 0x7F)));
+    rec.lastEventUs = now;
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "SOLVE PHASE %d after %d turns\n", phase, rec.turnCount);
+        fflush(g_logFile);
+    }
+}
+
+// Solved: append the record (the file is opened per solve, so a crash loses nothing older)
+void finishSolveRecord(TimeUs totalUs) {
+    SolveRecorder& rec = g_solveRecorder;
+    if (!rec.started) {
+        discardSolveRecord();
+        return;
+    }
+    std::vector<unsigned char> body;
+    writeVarint(body, (unsigned long long)rec.cubeSize);
+    writeVarint(body, (unsigned long long)time(NULL));
+    writeVarint(body, (unsigned long long)rec.inspectionUs);
+    writeVarint(body, (unsigned long long)totalUs);
+    writeVarint(body, (unsigned long long)rec.turnCount);
+    writeVarint(body, (unsigned long long)rec.scrambleLength);
+    body.insert(body.end(), rec.scramble.begin(), rec.scramble.end());
+    body.insert(body.end(), rec.events.begin(), rec.events.end());
+    std::vector<unsigned char> record;
+    record.push_back(SOLVE_RECORD_SYNC);
+    writeVarint(record, (unsigned long long)body.size());
+    record.insert(record.end(), body.begin(), body.end());
+    discardSolveRecord();
+    addSessionSolve(rec.cubeSize, totalUs);
+    logSessionStats();
+    
+    FILE* file = fopen(g_solveLogPath.c_str(), "ab");
+    if (file == NULL) {
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) == 0) {
+        fwrite(SOLVE_LOG_MAGIC, 1, 4, file);
+        fwrite(&SOLVE_LOG_VERSION, 1, 1, file);
+    }
+    fwrite(&record[0], 1, record.size(), file);
+    fclose(file);
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "SOLVE LOG: %d turns, %d bytes appended to %s\n",
+                rec.turnCount, (int)record.size(), g_solveLogPath.c_str());
+        fflush(g_logFile);
+    }
+}
+
+// Read-only mapping of a whole file (empty files map to size 0)
+struct MappedFile {
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+bool openMappedFile(const char* path, MappedFile& mapped) {
+    mapped.data = NULL;
+    mapped.size = 0;
+#ifdef _WIN32
+    mapped.mapping = NULL;
+    mapped.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (mapped.file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(mapped.file, &size);
+    mapped.size = (size_t)size.QuadPart;
+    if (mapped.size == 0) {
+        return true;
+    }
+    mapped.mapping = CreateFileMappingA(mapped.file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapped.mapping != NULL) {
+        mapped.data = (const unsigned char*)MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    return mapped.data != NULL;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return false;
+    }
+    mapped.size = (size_t)info.st_size;
+    if (mapped.size > 0) {
+        void* address = mmap(NULL, mapped.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        mapped.data = (address == MAP_FAILED) ? NULL : (const unsigned char*)address;
+    }
+    close(fd);
+    return mapped.size == 0 || mapped.data != NULL;
+#endif
+}
+
+void closeMappedFile(MappedFile& mapped) {
+#ifdef _WIN32
+    if (mapped.data != NULL) {
+        UnmapViewOfFile(mapped.data);
+    }
+    if (mapped.mapping != NULL) {
+        CloseHandle(mapped.mapping);
+    }
+    if (mapped.file != INVALID_HANDLE_VALUE) {
+        CloseHandle(mapped.file);
+    }
+#else
+    if (mapped.data != NULL) {
+        munmap((void*)mapped.data, mapped.size);
+    }
+#endif
+    mapped.data = NULL;
+    mapped.size = 0;
+}
+
+// One record's summary; scramble and events point into the mapping (decode lazily)
+struct SolveRecordView {
+    int cubeSize;
+    long unixTime;
+    TimeUs inspectionUs;
+    TimeUs totalUs;
+    int turnCount;
+    int scrambleLength;
+    const unsigned char* moves;   // scrambleLength move codes, then the events
+    const unsigned char* end;
+};
+
+// Advance p past the next record; false at the end or on a truncated / corrupt record
+bool readSolveRecord(const unsigned char*& p, const unsigned char* end, SolveRecordView& view) {
+    unsigned long long length, cubeSize, unixTime, inspection, total, turns, scrambleLength;
+    if (p >= end || *p != SOLVE_RECORD_SYNC) {
+        return false;
+    }
+    const unsigned char* q = p + 1;
+    if (!readVarint(q, end, length) || length > (unsigned long long)(end - q)) {
+        return false;
+    }
+    const unsigned char* bodyEnd = q + length;
+    if (!readVarint(q, bodyEnd, cubeSize) || !readVarint(q, bodyEnd, unixTime) ||
+        !readVarint(q, bodyEnd, inspection) || !readVarint(q, bodyEnd, total) ||
+        !readVarint(q, bodyEnd, turns) || !readVarint(q, bodyEnd, scrambleLength)) {
+        return false;
+    }
+    view.cubeSize = (int)cubeSize;
+    view.unixTime = (long)unixTime;
+    view.inspectionUs = (TimeUs)inspection;
+    view.totalUs = (TimeUs)total;
+    view.turnCount = (int)turns;
+    view.scrambleLength = (int)scrambleLength;
+    view.moves = q;
+    view.end = bodyEnd;
+    p = bodyEnd;
+    return true;
+}
+
+// Startup and size changes: feed the solve log's records for the current cube size into
+// the session statistics, straight from the mapping (only the summary varints are touched)
+void loadSessionHistory(const char* path) {
+    initSessionStats(g_cubeSize);
+    MappedFile mapped;
+    if (!openMappedFile(path, mapped)) {
+        return;
+    }
+    double startMs = getHighResTimeMs();
+    if (mapped.size >= 5 && memcmp(mapped.data, SOLVE_LOG_MAGIC, 4) == 0 && mapped.data[4] == SOLVE_LOG_VERSION) {
+        const unsigned char* p = mapped.data + 5;
+        const unsigned char* end = mapped.data + mapped.size;
+        SolveRecordView view;
+        while (readSolveRecord(p, end, view)) {
+            addSessionSolve(view.cubeSize, view.totalUs);
+        }
+    }
+    closeMappedFile(mapped);
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "HISTORY: %ld solves loaded from %s in %.3f ms\n",
+                g_sessionStats.solves, path, getHighResTimeMs() - startMs);
+    }
+    logSessionStats();
+}
+
+void reloadSessionHistory() {
+    loadSessionHistory(g_solveLogPath.c_str());
+}
+
+// "--solve-stats file": bulk summary straight from the mapping
+int printSolveLogStats(const char* path) {
+    MappedFile mapped;
+    if (!openMappedFile(path, mapped)) {
+        std::cerr << "Error: cannot map " << path << std::endl;
+        return 1;
+    }
+    double startMs = getHighResTimeMs();
+    const unsigned char* p = mapped.data;
+    const unsigned char* end = mapped.data + mapped.size;
+    if (mapped.size < 5 || memcmp(p, SOLVE_LOG_MAGIC, 4) != 0 || p[4] != SOLVE_LOG_VERSION) {
+        std::cerr << "Error: " << path << " is not a solve log" << std::endl;
+        closeMappedFile(mapped);
+        return 1;
+    }
+    p += 5;
+    long solves = 0;
+    long long turns = 0;
+    double totalSeconds = 0.0;
+    TimeUs best = 0;
+    SolveRecordView view;
+    while (readSolveRecord(p, end, view)) {
+        solves++;
+        turns += view.turnCount;
+        totalSeconds += (double)view.totalUs / 1000000.0;
+        if (best == 0 || view.totalUs < best) {
+            best = view.totalUs;
+        }
+    }
+    double readMs = getHighResTimeMs() - startMs;
+    printf("%ld solves (%lu bytes, %.1f bytes/solve) read in %.3f ms%s\n", solves, (unsigned long)mapped.size,
+           solves > 0 ? (double)mapped.size / (double)solves : 0.0, readMs, p < end ? ", stopped at a bad record" : "");
+    if (solves > 0) {
+        printf("mean %.3f s, best %.3f s, mean TPS %.2f\n", totalSeconds / (double)solves,
+               (double)best / 1000000.0, totalSeconds > 0.0 ? (double)turns / totalSeconds : 0.0);
+    }
+    closeMappedFile(mapped);
+    return 0;
+}
+
+// ========================================================================
+// 2x2x2 state-space enumeration (--enumerate-2x2)
+// ========================================================================
+// With the down-back-left corner held still, R, U and F (x1, x2, x3) reach all
+// 7! * 3^6 = 3,674,160 states. A state's rank is the Lehmer code of the other 7
+// corners' permutation times 729 plus the twists of the first 6 (the 7th follows from
+// the twist sum). The search is level-synchronous on the worker pool: each state has
+// 2 bits, its distance mod 3 or 3 = unseen, packed 16 to a word and claimed with a
+// compare-and-swap. States are expanded through the sticker engine itself (applyMove
+// on a 2x2x2 CubeState), so a run doubles as a move-throughput benchmark across cores:
+// compare --threads 1 with the default.
+
+const int POCKET_STATES = 3674160;
+const unsigned int POCKET_UNSEEN = 3;
+const int POCKET_MAX_DEPTH = 16;
+const int POCKET_CHUNKS = 1024;
+const char POCKET_TABLE_MAGIC[4] = {'R', 'B', '2', 'D'};
+const unsigned char POCKET_TABLE_VERSION = 1;
+
+// Corner position x | y << 1 | z << 2 (0 = down-back-left, held still): its 3 sticker
+// slots clockwise from the U/D one, and the colors they show when solved
+struct PocketCorner {
+    int slots[3];
+    unsigned char colors[3];
+};
+
+PocketCorner g_pocketCorners[8];
+bool g_pocketCornersBuilt = false;
+
+void buildPocketCorners() {
+    for (int corner = 0; corner < 8; corner++) {
+        int c[3] = {corner & 1, (corner >> 1) & 1, (corner >> 2) & 1};
+        Face order[3];
+        cornerFaceOrder(corner, order);
+        for (int k = 0; k < 3; k++) {
+            g_pocketCorners[corner].slots[k] = stickerIndex(2, order[k], c);
+            g_pocketCorners[corner].colors[k] = (unsigned char)order[k];
+        }
+    }
+    g_pocketCornersBuilt = true;
+}
+
+int encodePocketState(const CubeState& state) {
+    int perm[7];
+    int twist[7];
+    for (int p = 1; p < 8; p++) {
+        const PocketCorner& corner = g_pocketCorners[p];
+        int cubie = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned char color = state.stickers[corner.slots[k]];
+            if (color == UP || color == DOWN) {
+                twist[p - 1] = k;
+                cubie |= (color == UP) ? 2 : 0;
+            } else if (color == RIGHT) {
+                cubie |= 1;
+            } else if (color == FRONT) {
+                cubie |= 4;
+            }
+        }
+        perm[p - 1] = cubie - 1;
+    }
+    int rank = 0;
+    for (int i = 0; i < 7; i++) {
+        int smaller = 0;
+        for (int j = i + 1; j < 7; j++) {
+            if (perm[j] < perm[i]) {
+                smaller++;
+            }
+        }
+        rank = rank * (7 - i) + smaller;
+    }
+    for (int i = 0; i < 6; i++) {
+        rank = rank * 3 + twist[i];
+    }
+    return rank;
+}
+
+// Overwrites the 7 free corners; the fixed one is left as it is (solved)
+void decodePocketState(int rank, CubeState& state) {
+    int twist[7];
+    int twistSum = 0;
+    for (int i = 5; i >= 0; i--) {
+        twist[i] = rank % 3;
+        twistSum += twist[i];
+        rank /= 3;
+    }
+    twist[6] = (3 - twistSum % 3) % 3;
+    int lehmer[7];
+    for (int i = 6; i >= 0; i--) {
+        lehmer[i] = rank % (7 - i);
+        rank /= 7 - i;
+    }
+    int available[7] = {0, 1, 2, 3, 4, 5, 6};
+    for (int i = 0; i < 7; i++) {
+        int cubie = available[lehmer[i]] + 1;
+        for (int j = lehmer[i]; j < 6 - i; j++) {
+            available[j] = available[j + 1];
+        }
+        const PocketCorner& home = g_pocketCorners[cubie];
+        const PocketCorner& position = g_pocketCorners[i + 1];
+        for (int k = 0; k < 3; k++) {
+            state.stickers[position.slots[(twist[i] + k) % 3]] = home.colors[k];
+        }
+    }
+}
+
+inline unsigned int pocketDistance(const unsigned int* words, int rank) {
+    return (words[rank >> 4] >> ((rank & 15) * 2)) & 3;
+}
+
+// Mark rank with distance mod 3; false if it was already seen (maybe by another thread)
+bool claimPocketState(unsigned int* words, int rank, unsigned int value) {
+    volatile unsigned int* word = &words[rank >> 4];
+    const int shift = (rank & 15) * 2;
+    for (;;) {
+        unsigned int old = *word;
+        if (((old >> shift) & 3) != POCKET_UNSEEN) {
+            return false;
+        }
+        unsigned int desired = (old & ~(3u << shift)) | (value << shift);
+        if (ATOMIC_CAS32(word, old, desired) == old) {
+            return true;
+        }
+    }
+}
+
+struct PocketSearch {
+    unsigned int* words;
+    CubeState solved;              // template for the per-chunk scratch state
+    int depth;                     // expanding the states at this distance (mod 3)
+    long found[POCKET_CHUNKS];
+    long long moves[POCKET_CHUNKS];
+};
+
+// Expand every state of one rank range. States 3, 6, ... levels back share the mod-3
+// value and are expanded again; all their neighbours are seen, so they only cost time.
+void runPocketChunk(void* context, int chunk) {
+    PocketSearch& search = *(PocketSearch*)context;
+    const int begin = (int)((long long)POCKET_STATES * chunk / POCKET_CHUNKS);
+    const int end = (int)((long long)POCKET_STATES * (chunk + 1) / POCKET_CHUNKS);
+    const unsigned int level = (unsigned int)(search.depth % 3);
+    const unsigned int next = (unsigned int)((search.depth + 1) % 3);
+    const Face faces[3] = {RIGHT, UP, FRONT};
+    CubeState state = search.solved;
+    long found = 0;
+    long long moves = 0;
+    for (int rank = begin; rank < end; rank++) {
+        if (pocketDistance(search.words, rank) != level) {
+            continue;
+        }
+        decodePocketState(rank, state);
+        for (int f = 0; f < 3; f++) {
+            const MoveToken turn = makeMove(MOVE_FACE, faces[f], true);
+            // x1, x2, x3, then a 4th quarter turn restores the state
+            for (int q = 0; q < 4; q++) {
+                applyMove(state, turn);
+                moves++;
+                if (q == 3) {
+                    break;
+                }
+                int neighbour = encodePocketState(state);
+                if (pocketDistance(search.words, neighbour) == POCKET_UNSEEN &&
+                    claimPocketState(search.words, neighbour, next)) {
+                    found++;
+                }
+            }
+        }
+    }
+    search.found[chunk] = found;
+    search.moves[chunk] = moves;
+}
+
+// "--enumerate-2x2 [table.bin]": distance distribution + 2-bit table written to disk
+int enumeratePocketCube(const char* path) {
+    if (!g_pocketCornersBuilt) {
+        buildPocketCorners();
+    }
+    PocketSearch* search = new PocketSearch();
+    std::vector<unsigned int> words((POCKET_STATES + 15) / 16, 0xFFFFFFFFu);
+    search->words = &words[0];
+    // Built here so the 2x2x2 Zobrist key table exists before the workers read it
+    initCubeState(search->solved, 2);
+    claimPocketState(search->words, encodePocketState(search->solved), 0);
+    startWorkerPool();
+    long counts[POCKET_MAX_DEPTH + 1];
+    counts[0] = 1;
+    long total = 1;
+    long long totalMoves = 0;
+    int maxDepth = 0;
+    double startMs = getHighResTimeMs();
+    for (int depth = 0; depth < POCKET_MAX_DEPTH; depth++) {
+        search->depth = depth;
+        parallelFor(runPocketChunk, search, POCKET_CHUNKS);
+        long found = 0;
+        for (int chunk = 0; chunk < POCKET_CHUNKS; chunk++) {
+            found += search->found[chunk];
+            totalMoves += search->moves[chunk];
+        }
+        if (found == 0) {
+            break;
+        }
+        counts[depth + 1] = found;
+        total += found;
+        maxDepth = depth + 1;
+    }
+    double elapsedMs = getHighResTimeMs() - startMs;
+    delete search;
+    printf("2x2x2: %ld of %d states, God's number %d (half-turn metric)\n", total, POCKET_STATES, maxDepth);
+    printf("%.3f s on %d threads, %.2f M engine moves/s\n", elapsedMs / 1000.0, g_workerPool.threadCount + 1,
+           elapsedMs > 0.0 ? (double)totalMoves / elapsedMs / 1000.0 : 0.0);
+    printf("distance  states\n");
+    for (int depth = 0; depth <= maxDepth; depth++) {
+        printf("%8d  %ld\n", depth, counts[depth]);
+    }
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "ENUMERATE 2x2: %ld states, depth %d, %.3f ms, %lld moves, %d threads\n",
+                total, maxDepth, elapsedMs, totalMoves, g_workerPool.threadCount + 1);
+        fflush(g_logFile);
+    }
+    // Table: magic, version, state count (u32 LE), then the 2-bit words (u32 LE each)
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        std::cerr << "Error: cannot write " << path << std::endl;
+        return 1;
+    }
+    std::vector<unsigned char> bytes;
+    bytes.insert(bytes.end(), POCKET_TABLE_MAGIC, POCKET_TABLE_MAGIC + 4);
+    bytes.push_back(POCKET_TABLE_VERSION);
+    for (int i = 0; i < 4; i++) {
+        bytes.push_back((unsigned char)((unsigned int)POCKET_STATES >> (8 * i)));
+    }
+    for (size_t w = 0; w < words.size(); w++) {
+        for (int i = 0; i < 4; i++) {
+            bytes.push_back((unsigned char)(words[w] >> (8 * i)));
+        }
+    }
+    bool ok = fwrite(&bytes[0], 1, bytes.size(), file) == bytes.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Error: cannot write " << path << std::endl;
+        return 1;
+    }
+    printf("distance table (2 bits/state, distance mod 3) written to %s\n", path);
+    return total == POCKET_STATES ? 0 : 1;
+}
+
+// Main display function - renders the scene
+void display() {
+    double frameStartMs = getHighResTimeMs();
+    if (g_profiler.lastFrameStartMs > 0.0) {
+        recordProfileSample(PROFILE_FRAME, frameStartMs - g_profiler.lastFrameStartMs);
+    }
+    g_profiler.lastFrameStartMs = frameStartMs;
+    
+    // Clear color and depth buffers
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    
+    // Reset modelview matrix
+    glLoadIdentity();
+    
+    // DEBUG: Log frame count periodically (every 30 frames to avoid spam)
+    static int frameCount = 0;
+    if (frameCount++ % 30 == 0 && g_logFile != NULL) {
+        fprintf(g_logFile, "DISPLAY: frame=%d\n", frameCount);
+        fflush(g_logFile);
+    }
+    
+    // Apply camera transformations
+    applyCameraTransform();
+    
+    // Draw the complete NxNxN Rubik's Cube
+    double stageStartMs = getHighResTimeMs();
+    beginGpuDrawTiming();
+    drawRubikCube();
+    endGpuDrawTiming();
+    double stageEndMs = getHighResTimeMs();
+    recordStageTiming(PROFILE_DRAW_CUBE, stageStartMs, stageEndMs);
+    displayTimerOverlay();
+    stageStartMs = stageEndMs;
+    stageEndMs = getHighResTimeMs();
+    recordStageTiming(PROFILE_OVERLAY, stageStartMs, stageEndMs);
+    for (int slot = 0; slot < MAX_CONCURRENT_ANIMATIONS; slot++) {
+        if (g_animations[slot].isActive && renderedDisplayAngle(g_animations[slot]) > 0.0f) {
+            markLatencyMotion(g_animations[slot]);
+        }
+    }
+    
+    // Swap buffers to display the rendered frame
+    glutSwapBuffers();
+    recordLatencyFrame(getMonotonicTimeNs());
+    double frameEndMs = getHighResTimeMs();
+    recordStageTiming(PROFILE_SWAP, stageEndMs, frameEndMs);
+    traceComplete("display", "frame", frameStartMs, frameEndMs);
+}
+
+// Handle window reshape events
+void reshape(int w, int h) {
+    recordInputEvent(INPUT_RESHAPE, w, h);
+    // Update global window dimensions
+    windowWidth = w;
+    windowHeight = h;
+    
+    if (!g_headlessReplay) {
+        applyProjection(w, h);
+    }
+}
+
+// ========================================================================
+// Drag-to-turn: analytic ray picking against the NxNxN grid (no GL read-back)
+// ========================================================================
+
+const float DRAG_TURN_THRESHOLD_PX = 12.0f;  // drag distance before the turn direction is resolved
+const float PROJECTION_FOV_DEG = 45.0f;      // must match applyProjection()
+
+// Sticker under the cursor, in the same model space as drawRubikCube()
+struct StickerPick {
+    Face face;        // face whose outer surface was hit
+    int cell[3];      // grid cell of the hit piece, each in {0..N-1}
+    float point[3];   // hit point on the cube surface
+};
+
+struct DragTurnState {
+    bool enabled;     // 'M' toggles between drag-to-turn and orbit-only
+    bool active;      // mouse went down on a sticker
+    bool resolved;    // turn already issued for this drag
+    int startX;
+    int startY;
+    StickerPick pick;
+};
+
+DragTurnState g_dragTurn = {true, false, false, 0, 0, {FRONT, {0, 0, 0}, {0.0f, 0.0f, 0.0f}}};
+
+// Camera ray through a window pixel, transformed into cube space by inverting
+// applyCameraTransform(): undo the translate, then the conjugate camera rotation
+void computePickRay(int mouseX, int mouseY, float origin[3], float dir[3]) {
+    int w = windowWidth > 0 ? windowWidth : 1;
+    int h = windowHeight > 0 ? windowHeight : 1;
+    float tanHalfFov = (float)tan(PROJECTION_FOV_DEG * 0.5f * 3.14159265f / 180.0f);
+    float ndcX = 2.0f * ((float)mouseX + 0.5f) / (float)w - 1.0f;
+    float ndcY = 1.0f - 2.0f * ((float)mouseY + 0.5f) / (float)h;
+    origin[0] = 0.0f;
+    origin[1] = 0.0f;
+    origin[2] = CAMERA_DISTANCE;
+    dir[0] = ndcX * tanHalfFov * ((float)w / (float)h);
+    dir[1] = ndcY * tanHalfFov;
+    dir[2] = -1.0f;
+    applyInverseViewRotation(origin[0], origin[1], origin[2]);
+    applyInverseViewRotation(dir[0], dir[1], dir[2]);
+}
+
+// Cube-space point to window pixel (mouse convention: y grows downward)
+void projectCubePointToScreen(const float p[3], float& screenX, float& screenY) {
+    int w = windowWidth > 0 ? windowWidth : 1;
+    int h = windowHeight > 0 ? windowHeight : 1;
+    float tanHalfFov = (float)tan(PROJECTION_FOV_DEG * 0.5f * 3.14159265f / 180.0f);
+    float x = p[0];
+    float y = p[1];
+    float z = p[2];
+    applyCurrentViewRotation(x, y, z);
+    z -= CAMERA_DISTANCE;
+    float depth = (z < -0.0001f) ? -z : 0.0001f;
+    float ndcX = x / (depth * tanHalfFov * ((float)w / (float)h));
+    float ndcY = y / (depth * tanHalfFov);
+    screenX = (ndcX + 1.0f) * 0.5f * (float)w;
+    screenY = (1.0f - ndcY) * 0.5f * (float)h;
+}
+
+// Slab test against the cube's outer box; the entry slab gives the face, the hit
+// point snapped to the grid spacing gives the sticker. A few dozen flops, no GL calls.
+bool pickSticker(int mouseX, int mouseY, StickerPick& pick) {
+    const int n = g_rubikCube.state.n;
+    const float spacing = g_rubikCube.pieceSize + g_rubikCube.gapSize;
+    const float center = (float)(n - 1) * 0.5f;
+    const float extent = center * spacing + g_rubikCube.pieceSize * 0.5f;
+    float origin[3];
+    float dir[3];
+    computePickRay(mouseX, mouseY, origin, dir);
+    
+    float tEnter = -1.0e30f;
+    float tExit = 1.0e30f;
+    int enterAxis = -1;
+    int enterSign = 0;
+    for (int a = 0; a < 3; a++) {
+        if (fabs(dir[a]) < 1.0e-8f) {
+            if (origin[a] < -extent || origin[a] > extent) {
+                return false;
+            }
+            continue;
+        }
+        float t0 = (-extent - origin[a]) / dir[a];
+        float t1 = (extent - origin[a]) / dir[a];
+        int sign0 = -1;
+        if (t0 > t1) {
+            float tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+            sign0 = 1;
+        }
+        if (t0 > tEnter) {
+            tEnter = t0;
+            enterAxis = a;
+            enterSign = sign0;
+        }
+        if (t1 < tExit) {
+            tExit = t1;
+        }
+    }
+    if (enterAxis < 0 || tEnter > tExit || tExit < 0.0f) {
+        return false;
+    }
+    for (int a = 0; a < 3; a++) {
+        pick.point[a] = origin[a] + dir[a] * tEnter;
+        int cell = (int)floor(pick.point[a] / spacing + center + 0.5f);
+        pick.cell[a] = cell < 0 ? 0 : (cell > n - 1 ? n - 1 : cell);
+    }
+    pick.cell[enterAxis] = enterSign > 0 ? n - 1 : 0;
+    pick.face = faceFromAxis(enterAxis, enterSign);
+    return true;
+}
+
+// Turn implied by dragging a sticker: pick the in-face axis whose on-screen direction best
+// matches the drag, rotate about (face normal x drag axis), and map the layer to a Face.
+// Returns false for middle-layer drags, which have no outer-face move.
+bool resolveDragTurn(const StickerPick& pick, float dragX, float dragY, Face& face, bool& clockwise) {
+    int normalAxis = (pick.face == LEFT || pick.face == RIGHT) ? 0 : ((pick.face == UP || pick.face == DOWN) ? 1 : 2);
+    float normalSign = (pick.face == RIGHT || pick.face == UP || pick.face == FRONT) ? 1.0f : -1.0f;
+    float screenX0, screenY0;
+    projectCubePointToScreen(pick.point, screenX0, screenY0);
+    
+    int bestAxis = -1;
+    float bestDot = 0.0f;
+    float dragLen = (float)sqrt(dragX * dragX + dragY * dragY);
+    for (int a = 0; a < 3; a++) {
+        if (a == normalAxis) {
+            continue;
+        }
+        float moved[3] = {pick.point[0], pick.point[1], pick.point[2]};
+        moved[a] += 0.5f;
+        float screenX1, screenY1;
+        projectCubePointToScreen(moved, screenX1, screenY1);
+        float sx = screenX1 - screenX0;
+        float sy = screenY1 - screenY0;
+        float len = (float)sqrt(sx * sx + sy * sy);
+        if (len < 0.0001f || dragLen < 0.0001f) {
+            continue;
+        }
+        float dot = (sx * dragX + sy * dragY) / (len * dragLen);
+        if (fabs(dot) > fabs(bestDot)) {
+            bestDot = dot;
+            bestAxis = a;
+        }
+    }
+    if (bestAxis < 0) {
+        return false;
+    }
+    
+    // Rotation axis r = n x d, with n the face normal and d the signed drag axis
+    float n[3] = {0.0f, 0.0f, 0.0f};
+    float d[3] = {0.0f, 0.0f, 0.0f};
+    n[normalAxis] = normalSign;
+    d[bestAxis] = bestDot > 0.0f ? 1.0f : -1.0f;
+    float r[3] = {
+        n[1] * d[2] - n[2] * d[1],
+        n[2] * d[0] - n[0] * d[2],
+        n[0] * d[1] - n[1] * d[0]
+    };
+    int rotationAxis = 3 - normalAxis - bestAxis;
+    int layer = pick.cell[rotationAxis];
+    int last = g_rubikCube.state.n - 1;
+    if (layer != 0 && layer != last) {
+        return false;
+    }
+    int layerSign = (layer == last) ? 1 : -1;
+    face = faceFromAxis(rotationAxis, layerSign);
+    // Positive rotation about the outward normal of the turned face is counter-clockwise
+    clockwise = (r[rotationAxis] * (float)layerSign) < 0.0f;
+    return true;
+}
+
+// Issue the drag turn through the same relative-face path as the keyboard
+void performDragTurn(Face absoluteFace, bool clockwise) {
+    const ViewFaceMapping& mapping = currentViewMapping();
+    for (int rel = 0; rel < 6; rel++) {
+        if (mapping.relative[rel] == absoluteFace) {
+            performRelativeFaceTurn(rel, clockwise);
+            return;
+        }
+    }
+}
+
+// Handle mouse button press/release events
+void mouse(int button, int state, int x, int y) {
+    recordInputEvent(INPUT_MOUSE, button, state, x, y);
+    TraceScope traceScope("input:mouse", "input");
+    // DEBUG: Log all mouse button events to file
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "MOUSE EVENT: button=%d state=%d x=%d y=%d\n", button, state, x, y);
+        fflush(g_logFile);
+    }
+    
+    // Only handle left mouse button
+    if (button == GLUT_LEFT_BUTTON) {
+        if (state == GLUT_DOWN && g_dragTurn.enabled) {
+            double pickStartMs = getHighResTimeMs();
+            bool hit = pickSticker(x, y, g_dragTurn.pick);
+            double pickMs = getHighResTimeMs() - pickStartMs;
+            if (g_logFile != NULL) {
+                const char* faceNames[] = {"FRONT", "BACK", "LEFT", "RIGHT", "UP", "DOWN"};
+                if (hit) {
+                    fprintf(g_logFile, "PICK: %s cell=[%d,%d,%d] in %.4f ms\n", faceNames[g_dragTurn.pick.face],
+                            g_dragTurn.pick.cell[0], g_dragTurn.pick.cell[1], g_dragTurn.pick.cell[2], pickMs);
+                } else {
+                    fprintf(g_logFile, "PICK: miss in %.4f ms\n", pickMs);
+                }
+                fflush(g_logFile);
+            }
+            if (hit) {
+                g_dragTurn.active = true;
+                g_dragTurn.resolved = false;
+                g_dragTurn.startX = x;
+                g_dragTurn.startY = y;
+                return;
+            }
+        }
+        if (state == GLUT_UP && g_dragTurn.active) {
+            g_dragTurn.active = false;
+            return;
+        }
+        if (state == GLUT_DOWN) {
+            // Start dragging: save initial mouse position
+            if (g_logFile != NULL) {
+                fprintf(g_logFile, "*** DRAG START ***\n");
+                fflush(g_logFile);
+            }
+            isDragging = true;
+            lastMouseX = x;
+            lastMouseY = y;
+        } else if (state == GLUT_UP) {
+            // Stop dragging
+            if (g_logFile != NULL) {
+                fprintf(g_logFile, "*** DRAG END ***\n");
+                fflush(g_logFile);
+            }
+            isDragging = false;
+        }
+    }
+    requestRedisplay();
+}
+
+// Handle mouse motion while button is pressed (dragging)
+void motion(int x, int y) {
+    recordInputEvent(INPUT_MOTION, x, y);
+    TraceScope traceScope("input:motion", "input");
+    // Drag started on a sticker: one layer turn per drag once the direction is clear
+    if (g_dragTurn.active) {
+        float dragX = (float)(x - g_dragTurn.startX);
+        float dragY = (float)(y - g_dragTurn.startY);
+        if (!g_dragTurn.resolved && dragX * dragX + dragY * dragY >= DRAG_TURN_THRESHOLD_PX * DRAG_TURN_THRESHOLD_PX) {
+            Face face;
+            bool clockwise;
+            g_dragTurn.resolved = true;
+            if (resolveDragTurn(g_dragTurn.pick, dragX, dragY, face, clockwise)) {
+                performDragTurn(face, clockwise);
+            }
+        }
+        return;
+    }
+    
+    // Only process motion if we're currently dragging
+    if (!isDragging) {
+        return;
+    }
+    
+    // Calculate mouse movement delta
+    int dx = x - lastMouseX;
+    int dy = y - lastMouseY;
+    
+    // STANDARD ARC-BALL MATHEMATICS:
+    // Mouse coordinate: Y=0 at top, increases DOWNWARD
+    // OpenGL world: Y+ points UPWARD
+    // 
+    // For intuitive control:
+    // - Mouse RIGHT (dx > 0) → Yaw RIGHT (positive)
+    // - Mouse LEFT (dx < 0) → Yaw LEFT (negative)
+    // - Mouse UP (y decreases) → Camera looks UP (pitch DECREASES, negative)
+    // - Mouse DOWN (y increases) → Camera looks DOWN (pitch INCREASES, positive)
+    //
+    // Solution: Use (y - lastMouseY) directly for pitchDelta
+    // When mouse UP: y decreases → (y - lastMouseY) < 0 → pitchDelta negative → angleX decreases → look UP ✓
+    // When mouse DOWN: y increases → (y - lastMouseY) > 0 → pitchDelta positive → angleX increases → look DOWN ✓
+    
+    float yawDelta = (float)dx * ROTATION_SENSITIVITY;           // RIGHT = positive yaw
+    float pitchDelta = (float)(y - lastMouseY) * ROTATION_SENSITIVITY;  // FLIP Y LOGIC: UP = negative pitch (look up)
+    
+    // DEBUG: Log mouse movement and calculated deltas to file
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "MOUSE: x=%d y=%d | dx=%d dy=%d | yawDelta=%.1f pitchDelta=%.1f\n", 
+                x, y, dx, dy, yawDelta, pitchDelta);
+        fflush(g_logFile);
+    }
+    
+    // Arcball step: yaw about the screen's up axis, pitch about its right axis
+    // (no clamping, full rotation in every direction)
+    const float screenUp[3] = {0.0f, 1.0f, 0.0f};
+    const float screenRight[3] = {1.0f, 0.0f, 0.0f};
+    rotateCamera(screenUp, yawDelta);
+    rotateCamera(screenRight, pitchDelta);
+    
+    // DEBUG: Log orientation after update to file
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "  → Camera: (%.3f,%.3f,%.3f,%.3f)\n",
+                g_camera.orientation.w, g_camera.orientation.x, g_camera.orientation.y, g_camera.orientation.z);
+        fflush(g_logFile);
+    }
+    
+    // Update last mouse position for next frame
+    lastMouseX = x;
+    lastMouseY = y;
+    
+    // Request redraw to update camera view
+    requestRedisplay();
+}
+
+// Handle regular keyboard input (F/R/B/L/U/D for face selection)
+void keyboard(unsigned char key, int /* x */, int /* y */) {
+    InputArrivalScope inputArrival;
+    TraceScope traceScope("input:keyboard", "input");
+    int modifiers = getKeyModifiers();
+    recordInputEvent(INPUT_KEY_DOWN, key, modifiers);
+    bool shiftDown = (modifiers & GLUT_ACTIVE_SHIFT) != 0;
+    int keyUpper = toupper((unsigned char)key);
+    bool trackKey = false;
+    switch (keyUpper) {
+        case 'F':
+        case 'U':
+        case 'R':
+        case 'L':
+        case 'D':
+        case 'B':
+        case 'S':
+        case 'X':
+        case 'Y':
+        case 'Z':
+            trackKey = true;
+            break;
+        default:
+            break;
+    }
+    if (key == ' ') {
+        trackKey = true;
+        keyUpper = ' ';
+    }
+    if (trackKey) {
+        unsigned char idx = (unsigned char)keyUpper;
+        if (g_keyHeld[idx]) {
+            return;
+        }
+        g_keyHeld[idx] = true;
+    }
+    Face newFace = currentFrontFace;
+    bool faceChanged = false;
+    
+    switch (keyUpper) {
         case ' ': // Spacebar - Reset cube to solved state
             resetCube();
-            glutPostRedisplay();
+            requestRedisplay();
             return;
             
         case 'S': // Shuffle cube
             shuffleCube(20);
-            glutPostRedisplay();
+            requestRedisplay();
+            return;
+            
+        case 'P': // Toggle frame-time profiler HUD
+            g_profiler.overlayVisible = !g_profiler.overlayVisible;
+            requestRedisplay();
+            return;
+            
+        case '+': // Bigger / smaller cube (resets to solved)
+        case '=':
+            setCubeSize(g_cubeSize + 1);
+            requestRedisplay();
+            return;
+            
+        case '-':
+            setCubeSize(g_cubeSize - 1);
+            requestRedisplay();
+            return;
+            
+        case 'I': // Toggle instant scrambles / scripts (no animation, timer armed at once)
+            g_instantMoves = !g_instantMoves;
+            if (g_logFile != NULL) {
+                fprintf(g_logFile, "INSTANT MOVES: %s\n", g_instantMoves ? "ON" : "OFF");
+                fflush(g_logFile);
+            }
+            return;
+            
+        case 'M': // Toggle drag-to-turn (off: left drag always orbits the camera)
+            g_dragTurn.enabled = !g_dragTurn.enabled;
+            g_dragTurn.active = false;
+            if (g_logFile != NULL) {
+                fprintf(g_logFile, "DRAG TO TURN: %s\n", g_dragTurn.enabled ? "ON" : "OFF");
+                fflush(g_logFile);
+            }
+            return;
+            
+        case 'T': // Start/stop Chrome trace capture (written on stop)
+            if (g_trace.recording) {
+                stopTraceRecording();
+            } else {
+                startTraceRecording();
+            }
+            return;
+            
+        case '\t': // Phase split in the solve log (cross, F2L, ... as the solver sees them)
+            recordSolvePhase(++g_solvePhaseCount);
+            return;
+            
+        case 26: // Ctrl+Z / Ctrl+Y: undo / redo the last committed move
+            undoMove();
+            return;
+            
+        case 25:
+            redoMove();
+            return;
+            
+        case '[': // Scrub back / forward through the move history
+            scrubHistoryTo(g_history.cursor > (size_t)HISTORY_SCRUB_STEP ? g_history.cursor - HISTORY_SCRUB_STEP : 0);
+            return;
+            
+        case ']':
+            scrubHistoryTo(g_history.cursor + HISTORY_SCRUB_STEP);
+            return;
+            
+        case 'O': // Dump profiler statistics for offline comparison
+            if (dumpProfilerReport("rubik_profile.csv")) {
+                std::cout << "Profiler report written to rubik_profile.csv" << std::endl;
+            }
+            if (dumpLatencyReport("rubik_latency.csv")) {
+                std::cout << "Input latency histogram written to rubik_latency.csv" << std::endl;
+            }
+            if (g_logFile != NULL) {
+                fprintf(g_logFile, "PROFILER: dumped to rubik_profile.csv, rubik_latency.csv\n");
+                fflush(g_logFile);
+            }
             return;
             
         // Face rotation controls (relative to current front face)
@@ -1913,213 +6165,1568 @@ void keyboard(unsigned char key, int /* x */, int /* y */) {
             performRelativeFaceTurn(5, !shiftDown);
             return;
             
+        // Whole-cube rotations x/y/z (turning like the view's R/U/F), Shift => inverse
+        case 'X':
+            performRelativeMove(MOVE_ROTATION, 2, !shiftDown);
+            return;
+            
+        case 'Y':
+            performRelativeMove(MOVE_ROTATION, 1, !shiftDown);
+            return;
+            
+        case 'Z':
+            performRelativeMove(MOVE_ROTATION, 0, !shiftDown);
+            return;
+            
         // Camera face selection (lowercase)
         case 'f':
             newFace = FRONT;
             faceChanged = true;
             break;
-            
-        case 'r':
-            newFace = RIGHT;
-            faceChanged = true;
+            
+        case 'r':
+            newFace = RIGHT;
+            faceChanged = true;
+            break;
+            
+        case 'b':
+            newFace = BACK;
+            faceChanged = true;
+            break;
+            
+        case 'l':
+            newFace = LEFT;
+            faceChanged = true;
+            break;
+            
+        case 'u':
+            newFace = UP;
+            faceChanged = true;
+            break;
+            
+        case 'd':
+            newFace = DOWN;
+            faceChanged = true;
+            break;
+            
+        default:
+            // Ignore other keys
+            break;
+    }
+    
+    switch (key) {
+        case 'f':
+            newFace = FRONT;
+            faceChanged = true;
+            break;
+            
+        case 'r':
+            newFace = RIGHT;
+            faceChanged = true;
+            break;
+            
+        case 'b':
+            newFace = BACK;
+            faceChanged = true;
+            break;
+            
+        case 'l':
+            newFace = LEFT;
+            faceChanged = true;
+            break;
+            
+        case 'u':
+            newFace = UP;
+            faceChanged = true;
+            break;
+            
+        case 'd':
+            newFace = DOWN;
+            faceChanged = true;
+            break;
+        default:
+            break;
+    }
+    
+    if (faceChanged) {
+        currentFrontFace = newFace;
+        updateRotationAxes();
+        requestRedisplay();
+    }
+}
+
+void keyboardUp(unsigned char key, int /* x */, int /* y */) {
+    recordInputEvent(INPUT_KEY_UP, key);
+    TraceScope traceScope("input:keyboardUp", "input");
+    int keyUpper = toupper((unsigned char)key);
+    if (keyUpper < 0 || keyUpper >= 256) {
+        return;
+    }
+    g_keyHeld[(unsigned char)keyUpper] = false;
+    if (key == ' ') {
+        g_keyHeld[(unsigned char)' '] = false;
+    }
+}
+
+// Handle special keyboard input (arrow keys turn the camera about screen axes)
+void keyboardSpecial(int key, int /* x */, int /* y */) {
+    recordInputEvent(INPUT_SPECIAL, key);
+    TraceScope traceScope("input:keyboardSpecial", "input");
+    const float ROTATION_STEP = KEYBOARD_ROTATION_SPEED;
+    const float screenUp[3] = {0.0f, 1.0f, 0.0f};
+    const float screenRight[3] = {1.0f, 0.0f, 0.0f};
+    const char* keyName = "";
+    
+    switch (key) {
+        case GLUT_KEY_UP:
+            // Pitch about the screen's right axis (negative for up)
+            rotateCamera(screenRight, -ROTATION_STEP);
+            keyName = "UP";
+            break;
+            
+        case GLUT_KEY_DOWN:
+            // Pitch about the screen's right axis (positive for down)
+            rotateCamera(screenRight, ROTATION_STEP);
+            keyName = "DOWN";
+            break;
+            
+        case GLUT_KEY_LEFT:
+            // Yaw about the screen's up axis (negative for left)
+            rotateCamera(screenUp, -ROTATION_STEP);
+            keyName = "LEFT";
+            break;
+            
+        case GLUT_KEY_RIGHT:
+            // Yaw about the screen's up axis (positive for right)
+            rotateCamera(screenUp, ROTATION_STEP);
+            keyName = "RIGHT";
+            break;
+            
+        case GLUT_KEY_HOME:
+            // Jump to the start / end of the move history
+            scrubHistoryTo(0);
+            return;
+            
+        case GLUT_KEY_END:
+            scrubHistoryTo(g_history.moves.size());
+            return;
+            
+        default:
+            // Ignore other keys
+            return;
+    }
+    
+    // Log rotation
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "KEYBOARD: %s pressed | camera=(%.3f,%.3f,%.3f,%.3f)\n", keyName,
+                g_camera.orientation.w, g_camera.orientation.x, g_camera.orientation.y, g_camera.orientation.z);
+        fflush(g_logFile);
+    }
+    
+    // Request redraw to update camera view
+    requestRedisplay();
+}
+
+// Re-run a recorded session through the real input handlers and the fixed-step
+// simulation, as fast as possible and without a window; 0 if the final state key matches.
+// beginInputReplay() reads the header, replayNextInputEvent() steps to and feeds one
+// event, reportInputReplay() gives the verdict.
+struct InputReplay {
+    std::vector<unsigned char> data;
+    const unsigned char* p;
+    const unsigned char* end;
+    long events;
+    double sessionUs;
+    bool finished;                    // END record seen
+    unsigned long long expectedKey;   // cubeStateKey() from the END record
+};
+
+bool readWholeFile(const char* path, std::vector<unsigned char>& data) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    unsigned char chunk[65536];
+    size_t got;
+    data.clear();
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + got);
+    }
+    fclose(file);
+    return true;
+}
+
+// Validate the header and put the session in the recorded starting state
+bool beginInputReplay(const char* path, InputReplay& replay) {
+    if (!readWholeFile(path, replay.data)) {
+        std::cerr << "Error: cannot open " << path << std::endl;
+        return false;
+    }
+    const unsigned char* p = replay.data.empty() ? NULL : &replay.data[0];
+    const unsigned char* end = p + replay.data.size();
+    if (replay.data.size() < 6 || memcmp(p, INPUT_RECORD_MAGIC, 4) != 0) {
+        std::cerr << "Error: " << path << " is not an input recording" << std::endl;
+        return false;
+    }
+    if (p[4] != INPUT_RECORD_VERSION) {
+        std::cerr << "Error: " << path << " is a version " << (int)p[4] << " recording, this build replays version "
+                  << (int)INPUT_RECORD_VERSION << " only (version 1 drove the pre-quaternion camera, version 2 ended on a look hash)"
+                  << std::endl;
+        return false;
+    }
+    p += 5;
+    unsigned long long cubeSize = 0;
+    unsigned long long seed = 0;
+    if (!readVarint(p, end, cubeSize) || !readVarint(p, end, seed) || p >= end ||
+        cubeSize < (unsigned long long)MIN_CUBE_SIZE || cubeSize > (unsigned long long)MAX_CUBE_SIZE) {
+        std::cerr << "Error: bad recording header" << std::endl;
+        return false;
+    }
+    g_instantMoves = (*p++ & INPUT_FLAG_INSTANT) != 0;
+    g_headlessReplay = true;
+    g_cubeSize = (int)cubeSize;
+    g_randomSeed = (unsigned int)seed;
+    srand(g_randomSeed);
+    initRubikCube();
+    updateRotationAxes();
+    replay.p = p;
+    replay.end = end;
+    replay.events = 0;
+    replay.sessionUs = 0.0;
+    replay.finished = false;
+    replay.expectedKey = 0;
+    return true;
+}
+
+// Feed one event's payload to its input callback
+void dispatchInputEvent(InputReplay& replay, unsigned char type) {
+    const unsigned char*& p = replay.p;
+    const unsigned char* end = replay.end;
+    unsigned long long a = 0, b = 0;
+    switch (type) {
+        case INPUT_KEY_DOWN:
+            if (end - p < 2) {
+                p = end;
+                break;
+            }
+            g_replayModifiers = p[1];
+            keyboard(p[0], 0, 0);
+            p += 2;
+            break;
+        case INPUT_KEY_UP:
+            if (p < end) {
+                keyboardUp(*p++, 0, 0);
+            }
             break;
-            
-        case 'b':
-            newFace = BACK;
-            faceChanged = true;
+        case INPUT_SPECIAL:
+            if (readVarint(p, end, a)) {
+                keyboardSpecial((int)a, 0, 0);
+            }
             break;
-            
-        case 'l':
-            newFace = LEFT;
-            faceChanged = true;
+        case INPUT_MOUSE:
+            if (end - p >= 2) {
+                int button = p[0];
+                int state = p[1];
+                p += 2;
+                if (readVarint(p, end, a) && readVarint(p, end, b)) {
+                    mouse(button, state, (int)zigzagDecode(a), (int)zigzagDecode(b));
+                }
+            }
             break;
-            
-        case 'u':
-            newFace = UP;
-            faceChanged = true;
+        case INPUT_MOTION:
+            if (readVarint(p, end, a) && readVarint(p, end, b)) {
+                motion((int)zigzagDecode(a), (int)zigzagDecode(b));
+            }
             break;
-            
-        case 'd':
-            newFace = DOWN;
-            faceChanged = true;
+        case INPUT_RESHAPE:
+            if (readVarint(p, end, a) && readVarint(p, end, b)) {
+                reshape((int)a, (int)b);
+            }
             break;
-            
         default:
-            // Ignore other keys
+            p = end;
             break;
     }
-    
-    switch (key) {
-        case 'f':
-            newFace = FRONT;
-            faceChanged = true;
-            break;
-            
-        case 'r':
-            newFace = RIGHT;
-            faceChanged = true;
-            break;
-            
-        case 'b':
-            newFace = BACK;
-            faceChanged = true;
-            break;
-            
-        case 'l':
-            newFace = LEFT;
-            faceChanged = true;
-            break;
-            
-        case 'u':
-            newFace = UP;
-            faceChanged = true;
-            break;
-            
-        case 'd':
-            newFace = DOWN;
-            faceChanged = true;
-            break;
-        default:
-            break;
+}
+
+// Step the simulation up to the next event and play it; false once the recording ends
+bool replayNextInputEvent(InputReplay& replay) {
+    if (replay.p >= replay.end || replay.finished) {
+        return false;
+    }
+    unsigned char type = *replay.p++;
+    unsigned long long dtUs, steps;
+    if (!readVarint(replay.p, replay.end, dtUs) || !readVarint(replay.p, replay.end, steps)) {
+        return false;
+    }
+    replay.sessionUs += (double)dtUs;
+    const float stepSeconds = (float)SIMULATION_STEP_NS / 1000000000.0f;
+    for (unsigned long long i = 0; i < steps; i++) {
+        updateAnimation(stepSeconds);
+        g_simulationStep++;
+    }
+    if (type == INPUT_END) {
+        if (replay.end - replay.p >= 8) {
+            for (int i = 0; i < 8; i++) {
+                replay.expectedKey |= (unsigned long long)replay.p[i] << (8 * i);
+            }
+            replay.finished = true;
+        }
+        replay.p = replay.end;
+    } else {
+        dispatchInputEvent(replay, type);
+    }
+    replay.events++;
+    return true;
+}
+
+bool inputReplayMatches(const InputReplay& replay) {
+    return replay.finished && cubeStateKey(g_rubikCube.state) == replay.expectedKey &&
+           validateCubeState(g_rubikCube.state).error == CUBE_STATE_VALID;
+}
+
+int reportInputReplay(const InputReplay& replay, double replayMs) {
+    unsigned long long key = cubeStateKey(g_rubikCube.state);
+    CubeStateCheck check = validateCubeState(g_rubikCube.state);
+    bool match = inputReplayMatches(replay);
+    printf("Replayed %ld events, %lu steps (%.3f s of session) in %.3f ms\n",
+           replay.events, g_simulationStep, replay.sessionUs / 1000000.0, replayMs);
+    if (!replay.finished) {
+        printf("Recording has no END record (session crashed?): final state key %016llx\n", key);
+    } else if (check.error != CUBE_STATE_VALID) {
+        printf("Replayed state is unsolvable: %s\n", check.message.c_str());
+    } else if (match) {
+        printf("State key %016llx matches the recording\n", key);
+    } else {
+        printf("State key %016llx DIFFERS from the recorded %016llx\n", key, replay.expectedKey);
+    }
+    if (g_logFile != NULL) {
+        fprintf(g_logFile, "REPLAY: %ld events, %lu steps, %.3f s session in %.3f ms, key %016llx %s\n",
+                replay.events, g_simulationStep, replay.sessionUs / 1000000.0, replayMs, key,
+                match ? "MATCH" : "MISMATCH");
+        fflush(g_logFile);
+    }
+    return match ? 0 : 1;
+}
+
+int runInputReplay(const char* path) {
+    InputReplay replay;
+    if (!beginInputReplay(path, replay)) {
+        return 1;
+    }
+    double startMs = getHighResTimeMs();
+    while (replayNextInputEvent(replay)) {
+    }
+    int status = reportInputReplay(replay, getHighResTimeMs() - startMs);
+    g_headlessReplay = false;
+    return status;
+}
+
+// Shared by the tests: one step of their LCG, and a random move of any kind and depth
+unsigned int nextTestRandom(unsigned int& seed) {
+    seed = seed * 1103515245u + 12345u;
+    return seed;
+}
+
+MoveToken randomTestMove(unsigned int& seed, int n) {
+    static const MoveKind kinds[] = {MOVE_FACE, MOVE_FACE, MOVE_WIDE, MOVE_SLICE, MOVE_ROTATION};
+    nextTestRandom(seed);
+    return makeMove(kinds[(seed >> 8) % 5], static_cast<Face>((seed >> 16) % 6),
+                    ((seed >> 24) & 1) != 0, 1 + (int)((seed >> 4) % (n > 2 ? n - 1 : 1)));
+}
+
+// Slot-index labels for permutation checks. Stickers are bytes, so a CubeState carries
+// the index as byte planes (low byte first) that all go through the same moves
+void initSlotIndexPlanes(int n, std::vector<CubeState>& planes) {
+    const size_t slots = (size_t)6 * n * n;
+    int count = 1;
+    while (((slots - 1) >> (8 * count)) != 0) {
+        count++;
+    }
+    planes.resize(count);
+    for (int p = 0; p < count; p++) {
+        initCubeState(planes[p], n);
+        for (size_t i = 0; i < slots; i++) {
+            planes[p].stickers[i] = (unsigned char)(i >> (8 * p));
+        }
+    }
+}
+
+void slotIndexLabels(const std::vector<CubeState>& planes, std::vector<int>& labels) {
+    labels.assign(planes[0].stickers.size(), 0);
+    for (size_t p = 0; p < planes.size(); p++) {
+        for (size_t i = 0; i < labels.size(); i++) {
+            labels[i] |= (int)planes[p].stickers[i] << (8 * p);
+        }
+    }
+}
+
+void initSlotIndexReference(int n, std::vector<int>& reference) {
+    reference.resize((size_t)6 * n * n);
+    for (size_t i = 0; i < reference.size(); i++) {
+        reference[i] = (int)i;
+    }
+}
+
+// Test function: Verify face^4 = identity for all faces (4 CW turns return to original state)
+void testRotationIdentity() {
+    if (g_logFile == NULL) {
+        return;
+    }
+    
+    fprintf(g_logFile, "\n=== ROTATION IDENTITY TEST (N=%d) ===\n", g_rubikCube.state.n);
+    
+    // Backup entire cube state (stickers + lazy face offsets)
+    const CubeState originalState = g_rubikCube.state;
+    const std::vector<unsigned char>& originalStickers = originalState.stickers;
+    
+    const Face facesToTest[] = {FRONT, BACK, LEFT, RIGHT, UP, DOWN};
+    const char* faceNames[] = {"FRONT", "BACK", "LEFT", "RIGHT", "UP", "DOWN"};
+    const int entriesPerCube = (int)originalStickers.size();
+    
+    for (int faceIdx = 0; faceIdx < 6; faceIdx++) {
+        Face face = facesToTest[faceIdx];
+        // Restore baseline before each face test
+        g_rubikCube.state = originalState;
+        
+        fprintf(g_logFile, "Testing %s: performing 4 CW turns...\n", faceNames[faceIdx]);
+        for (int turn = 0; turn < 4; turn++) {
+            rotateFace(face, true);
+        }
+        
+        int matches = 0;
+        for (int i = 0; i < entriesPerCube; i++) {
+            if (g_rubikCube.state.stickers[i] == originalStickers[i]) {
+                matches++;
+            }
+        }
+        if (memcmp(g_rubikCube.state.faceRotation, originalState.faceRotation, sizeof(originalState.faceRotation)) != 0 ||
+            cubeStateKey(g_rubikCube.state) != cubeStateKey(originalState)) {
+            matches = 0;
+        }
+        
+        if (matches == entriesPerCube) {
+            fprintf(g_logFile, "  -> %s PASSED (%d/%d matches)\n", faceNames[faceIdx], matches, entriesPerCube);
+        } else {
+            fprintf(g_logFile, "  -> %s FAILED (%d/%d matches)\n", faceNames[faceIdx], matches, entriesPerCube);
+        }
+    }
+    
+    // Restore original solved state after tests
+    g_rubikCube.state = originalState;
+    
+    fprintf(g_logFile, "=== END ROTATION IDENTITY TEST ===\n\n");
+    fflush(g_logFile);
+}
+
+// Test function: specialized move tables (N=2..7) must match the dynamic kernel on every layer turn
+void testSpecializedMoveTables() {
+    if (g_logFile == NULL) {
+        return;
+    }
+    fprintf(g_logFile, "=== SPECIALIZED VS DYNAMIC MOVE TEST ===\n");
+    for (int n = MIN_CUBE_SIZE; n <= MAX_SPECIALIZED_CUBE_SIZE; n++) {
+        // Distinct label per sticker slot so any misplaced sticker is caught
+        std::vector<CubeState> specialized;
+        std::vector<int> dynamic;
+        std::vector<int> labels;
+        initSlotIndexPlanes(n, specialized);
+        initSlotIndexReference(n, dynamic);
+        int mismatches = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            for (int layer = 0; layer < n; layer++) {
+                for (int q = 1; q <= 3; q++) {
+                    for (size_t p = 0; p < specialized.size(); p++) {
+                        applyLayerTurn(specialized[p], axis, layer, q);
+                    }
+                    turnLayerGeneric(&dynamic[0], n, axis, layer, q);
+                    slotIndexLabels(specialized, labels);
+                    if (labels != dynamic) {
+                        mismatches++;
+                    }
+                }
+            }
+        }
+        fprintf(g_logFile, "  -> N=%d %s (%d mismatching turns)\n", n, mismatches == 0 ? "PASSED" : "FAILED", mismatches);
+    }
+    fprintf(g_logFile, "=== END SPECIALIZED VS DYNAMIC MOVE TEST ===\n\n");
+    fflush(g_logFile);
+}
+
+// Logical sticker colors of a whole cube, face by face (independent of storage orientation)
+void collectLogicalStickers(const CubeState& state, std::vector<unsigned char>& out) {
+    const int n = state.n;
+    out.clear();
+    for (int face = 0; face < 6; face++) {
+        int axis = (face == LEFT || face == RIGHT) ? 0 : ((face == UP || face == DOWN) ? 1 : 2);
+        int c[3];
+        c[axis] = (FACE_NORMALS[face][axis] > 0) ? n - 1 : 0;
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                c[(axis + 1) % 3] = i;
+                c[(axis + 2) % 3] = j;
+                out.push_back(state.stickers[logicalStickerIndex(state, face, c)]);
+            }
+        }
+    }
+}
+
+// Test function: x/y/z relabeling must match the equivalent layer turns (x = R M' L', ...)
+void testCubeRotationMoves() {
+    if (g_logFile == NULL) {
+        return;
+    }
+    fprintf(g_logFile, "=== CUBE ROTATION MOVE TEST ===\n");
+    const char* rotations[] = {"x", "y", "z", "x y' z2 R u M"};
+    const char* expansions[] = {"R M' L'", "U E' D'", "F S B'", "R M' L' U' E D F2 S2 B2 R u M"};
+    const int sizes[] = {3, 4, MAX_SPECIALIZED_CUBE_SIZE + 2};
+    for (int s = 0; s < 3; s++) {
+        for (int t = 0; t < 4; t++) {
+            CubeState relabeled;
+            CubeState turned;
+            initCubeState(relabeled, sizes[s]);
+            initCubeState(turned, sizes[s]);
+            std::vector<MoveToken> moves;
+            parseMoveSequence(rotations[t], moves);
+            for (size_t m = 0; m < moves.size(); m++) {
+                applyMove(relabeled, moves[m]);
+            }
+            moves.clear();
+            parseMoveSequence(expansions[t], moves);
+            for (size_t m = 0; m < moves.size(); m++) {
+                applyMove(turned, moves[m]);
+            }
+            std::vector<unsigned char> a, b;
+            collectLogicalStickers(relabeled, a);
+            collectLogicalStickers(turned, b);
+            fprintf(g_logFile, "  -> N=%d %s == %s %s\n", sizes[s], rotations[t], expansions[t], a == b ? "PASSED" : "FAILED");
+        }
+    }
+    fprintf(g_logFile, "=== END CUBE ROTATION MOVE TEST ===\n\n");
+    fflush(g_logFile);
+}
+
+// Test function: a parallel same-axis batch must match the serial layer-by-layer turns
+void testParallelLayerTurns() {
+    if (g_logFile == NULL) {
+        return;
+    }
+    fprintf(g_logFile, "=== PARALLEL LAYER TURN TEST ===\n");
+    const int n = MAX_CUBE_SIZE;
+    std::vector<CubeState> parallel;
+    initSlotIndexPlanes(n, parallel);
+    std::vector<CubeState> serial = parallel;
+    std::vector<LayerTurn> turns;
+    for (int axis = 0; axis < 3; axis++) {
+        turns.clear();
+        for (int layer = 0; layer < n; layer++) {
+            LayerTurn turn = {layer, 1 + (layer * 7 + axis) % 3};
+            turns.push_back(turn);
+        }
+        for (size_t p = 0; p < parallel.size(); p++) {
+            for (int layer = 0; layer < n; layer++) {
+                applyLayerTurn(serial[p], axis, layer, turns[layer].quarterTurns);
+            }
+            applyLayerTurns(parallel[p], axis, &turns[0], (int)turns.size());
+        }
+    }
+    std::vector<int> parallelLabels;
+    std::vector<int> serialLabels;
+    for (size_t p = 0; p < parallel.size(); p++) {
+        bakeFaceRotations(parallel[p]);
+        bakeFaceRotations(serial[p]);
+    }
+    slotIndexLabels(parallel, parallelLabels);
+    slotIndexLabels(serial, serialLabels);
+    fprintf(g_logFile, "  -> N=%d, %d threads: %s\n", n, g_workerPool.threadCount + 1,
+            parallelLabels == serialLabels ? "PASSED" : "FAILED");
+    fprintf(g_logFile, "=== END PARALLEL LAYER TURN TEST ===\n\n");
+    fflush(g_logFile);
+}
+
+// Test function: the batched instant path must match applying the same moves one by one
+void testBulkApplyMoves() {
+    if (g_logFile == NULL) {
+        return;
+    }
+    fprintf(g_logFile, "=== BULK APPLY TEST ===\n");
+    const char* sequence = "R L' r 3Rw M2 x U D2 E u' y F B S' z2 R2 L";
+    const int sizes[] = {3, 6, MAX_SPECIALIZED_CUBE_SIZE + 2};
+    std::vector<MoveToken> moves;
+    parseMoveSequence(sequence, moves);
+    for (int s = 0; s < 3; s++) {
+        CubeState bulk;
+        CubeState single;
+        initCubeState(bulk, sizes[s]);
+        initCubeState(single, sizes[s]);
+        bulkApplyMoves(bulk, moves);
+        for (size_t m = 0; m < moves.size(); m++) {
+            applyMove(single, moves[m]);
+        }
+        std::vector<unsigned char> a, b;
+        collectLogicalStickers(bulk, a);
+        collectLogicalStickers(single, b);
+        fprintf(g_logFile, "  -> N=%d %s\n", sizes[s], a == b ? "PASSED" : "FAILED");
+    }
+    fprintf(g_logFile, "=== END BULK APPLY TEST ===\n\n");
+    fflush(g_logFile);
+}
+
+// Test function: every sticker a move changes must lie in its block's dirty rectangle
+// (specialized, generic and parallel move paths), or the big-cube textures go stale
+void testStickerDirtyRects() {
+    if (g_logFile == NULL) {
+        return;
+    }
+    fprintf(g_logFile, "=== STICKER DIRTY RECT TEST ===\n");
+    const int sizes[] = {5, TEXTURE_RENDER_MIN_CUBE_SIZE + 1, 200};
+    for (int s = 0; s < 3; s++) {
+        const int n = sizes[s];
+        CubeState state;
+        initCubeState(state, n);
+        unsigned int seed = 99 + n;
+        int misses = 0;
+        for (int m = 0; m < 30; m++) {
+            const std::vector<unsigned char> before = state.stickers;
+            for (int f = 0; f < 6; f++) {
+                clearStickerDirty(state, f);
+            }
+            applyMove(state, m % 5 == 0 ? makeMove(MOVE_SLICE, RIGHT, true) : randomTestMove(seed, n));
+            for (size_t i = 0; i < before.size(); i++) {
+                if (state.stickers[i] == before[i]) {
+                    continue;
+                }
+                const StickerDirtyRect& rect = state.dirty[i / (n * n)];
+                const int u = (int)(i % n);
+                const int v = (int)((i / n) % n);
+                misses += v < rect.minRow || v > rect.maxRow || u < rect.minCol || u > rect.maxCol;
+            }
+        }
+        fprintf(g_logFile, "  -> N=%d: %d changed stickers outside their rectangle: %s\n",
+                n, misses, misses == 0 ? "PASSED" : "FAILED");
+    }
+    fprintf(g_logFile, "=== END STICKER DIRTY RECT TEST ===\n\n");
+    fflush(g_logFile);
+}
+
+// Test function: the per-move Zobrist key must equal a from-scratch recompute, lazy and
+// baked offsets must share a key, and a rotation must change it only until undone
+void testZobristStateKey() {
+    if (g_logFile == NULL) {
+        return;
+    }
+    fprintf(g_logFile, "=== ZOBRIST STATE KEY TEST ===\n");
+    const int sizes[] = {2, 3, MAX_SPECIALIZED_CUBE_SIZE + 2, 200};
+    const int moveCounts[] = {300, 300, 300, 24};
+    for (int s = 0; s < 4; s++) {
+        const int n = sizes[s];
+        CubeState state;
+        initCubeState(state, n);
+        const unsigned long long solvedKey = cubeStateKey(state);
+        std::vector<MoveToken> moves;
+        int mismatches = 0;
+        unsigned int seed = 777 + n;
+        for (int i = 0; i < moveCounts[s]; i++) {
+            MoveToken move = randomTestMove(seed, n);
+            applyMove(state, move);
+            moves.push_back(move);
+            CubeState recomputed = state;
+            recomputeZobristHash(recomputed);
+            mismatches += cubeStateKey(recomputed) != cubeStateKey(state);
+        }
+        const unsigned long long scrambledKey = cubeStateKey(state);
+        CubeState baked = state;
+        bakeFaceRotations(baked);
+        mismatches += cubeStateKey(baked) != scrambledKey;
+        for (size_t i = moves.size(); i > 0; i--) {
+            MoveToken inverse = moves[i - 1];
+            inverse.clockwise = !inverse.clockwise;
+            applyMove(state, inverse);
+        }
+        bool identity = cubeStateKey(state) == solvedKey && scrambledKey != solvedKey;
+        const unsigned long long beforeRotation = cubeStateKey(state);
+        const MoveToken x = makeMove(MOVE_ROTATION, RIGHT, true);
+        applyMove(state, x);
+        bool rotation = cubeStateKey(state) != beforeRotation;
+        for (int q = 0; q < 3; q++) {
+            applyMove(state, x);
+        }
+        rotation = rotation && cubeStateKey(state) == beforeRotation;
+        fprintf(g_logFile, "  -> N=%d incremental=%s identity=%s rotation=%s\n", n,
+                mismatches == 0 ? "PASSED" : "FAILED", identity ? "PASSED" : "FAILED",
+                rotation ? "PASSED" : "FAILED");
+    }
+    fprintf(g_logFile, "=== END ZOBRIST STATE KEY TEST ===\n\n");
+    fflush(g_logFile);
+}
+
+// Test function: undo, redo and checkpointed scrubbing must land on the exact state
+// the cube had at that history position
+void testMoveHistory() {
+    if (g_logFile == NULL) {
+        return;
+    }
+    fprintf(g_logFile, "=== MOVE HISTORY TEST ===\n");
+    const CubeState originalState = g_rubikCube.state;
+    resetMoveHistory();
+    const int moveCount = 1000;
+    std::vector<unsigned long long> keys;
+    keys.push_back(cubeStateKey(g_rubikCube.state));
+    unsigned int seed = 4242;
+    for (int i = 0; i < moveCount; i++) {
+        MoveToken move = randomTestMove(seed, g_rubikCube.state.n);
+        applyMove(g_rubikCube.state, move);
+        recordHistoryMove(move);
+        keys.push_back(cubeStateKey(g_rubikCube.state));
+    }
+    int failures = 0;
+    for (int i = 0; i < 5; i++) {
+        undoMove();
+    }
+    failures += cubeStateKey(g_rubikCube.state) != keys[moveCount - 5];
+    redoMove();
+    failures += cubeStateKey(g_rubikCube.state) != keys[moveCount - 4];
+    for (int probe = 0; probe < 40; probe++) {
+        nextTestRandom(seed);
+        size_t position = (seed >> 8) % (moveCount + 1);
+        scrubHistoryTo(position);
+        failures += cubeStateKey(g_rubikCube.state) != keys[position];
+    }
+    // A new move after scrubbing back replaces the redo tail
+    scrubHistoryTo(100);
+    MoveToken branch = makeMove(MOVE_FACE, UP, true);
+    applyMove(g_rubikCube.state, branch);
+    recordHistoryMove(branch);
+    failures += g_history.moves.size() != 101;
+    // No time travel inside a timed solve
+    const TimerState timerState = g_timer.state;
+    g_timer.state = TIMER_RUNNING;
+    undoMove();
+    failures += g_history.cursor != 101;
+    g_timer.state = timerState;
+    fprintf(g_logFile, "  -> %d moves, checkpoint every %d: %s\n",
+            moveCount, g_history.interval, failures == 0 ? "PASSED" : "FAILED");
+    g_rubikCube.state = originalState;
+    resetMoveHistory();
+    fprintf(g_logFile, "=== END MOVE HISTORY TEST ===\n\n");
+    fflush(g_logFile);
+}
+
+// Advance the fixed-step simulation until every queued and animating move has committed
+void stepTestSimulationUntilIdle() {
+    const float stepSeconds = (float)SIMULATION_STEP_NS / 1000000000.0f;
+    for (int i = 0; i < 100000 && (isAnimationActive() || getMoveQueueCount() > 0); i++) {
+        updateAnimation(stepSeconds);
+        g_simulationStep++;
+    }
+}
+
+void pressTestKey(unsigned char key, int modifiers) {
+    g_replayModifiers = modifiers;
+    keyboard(key, 0, 0);
+    keyboardUp(key, 0, 0);
+    g_replayModifiers = 0;
+    stepTestSimulationUntilIdle();
+}
+
+// Test function: record a scramble, a keyed solve and an undo after it, then replay the
+// recording; the solve must stop the timer on the same step both times or the undo diverges
+void testReplayAfterSolve() {
+    if (g_logFile == NULL) {
+        return;
+    }
+    fprintf(g_logFile, "=== RECORD/REPLAY SOLVE TEST ===\n");
+    const char* recordPath = "rubik_replay_test.rbki";
+    const std::string solveLogPath = g_solveLogPath;
+    const bool headless = g_headlessReplay;
+    const bool instant = g_instantMoves;
+    const unsigned int randomSeed = g_randomSeed;
+    g_solveLogPath = "rubik_replay_test.rbks";
+    g_headlessReplay = true;
+    g_instantMoves = false;
+    g_randomSeed = 777;
+    srand(g_randomSeed);
+    resetCube();
+    int failures = !startInputRecording(recordPath);
+    pressTestKey('S', 0);
+    failures += g_timer.state != TIMER_READY;
+    const std::vector<MoveToken> scramble = g_lastScramble;
+    static const char faceKeys[6] = {'F', 'U', 'R', 'L', 'D', 'B'};
+    for (size_t i = scramble.size(); i-- > 0;) {
+        for (int relative = 0; relative < 6; relative++) {
+            if (currentViewMapping().relative[relative] == scramble[i].face) {
+                pressTestKey(faceKeys[relative], scramble[i].clockwise ? GLUT_ACTIVE_SHIFT : 0);
+            }
+        }
+    }
+    failures += g_timer.state != TIMER_STOPPED;
+    pressTestKey(26, GLUT_ACTIVE_CTRL);
+    failures += isCubeSolved();
+    finishInputRecording();
+    InputReplay replay;
+    resetCube();
+    if (beginInputReplay(recordPath, replay)) {
+        while (replayNextInputEvent(replay)) {
+        }
+        failures += !inputReplayMatches(replay);
+    } else {
+        failures++;
+    }
+    fprintf(g_logFile, "  -> %d scramble moves, solve and undo replayed: %s\n",
+            (int)scramble.size(), failures == 0 ? "PASSED" : "FAILED");
+    remove(recordPath);
+    remove(g_solveLogPath.c_str());
+    g_solveLogPath = solveLogPath;
+    g_headlessReplay = headless;
+    g_instantMoves = instant;
+    g_randomSeed = randomSeed;
+    srand(g_randomSeed);
+    resetCube();
+    reloadSessionHistory();
+    fprintf(g_logFile, "=== END RECORD/REPLAY SOLVE TEST ===\n\n");
+    fflush(g_logFile);
+}
+
+// Test function: local and script moves come out in posting order, and a cancel drops
+// both the queued moves and anything the script producer posts after it
+void testMoveQueueOrder() {
+    if (g_logFile == NULL) {
+        return;
+    }
+    fprintf(g_logFile, "=== MOVE QUEUE ORDER TEST ===\n");
+    const Face order[6] = {FRONT, UP, RIGHT, LEFT, DOWN, BACK};
+    g_scriptMoveQueue.generation = g_queueGeneration;  // as startScriptThread() does
+    for (int i = 0; i < 6; i++) {
+        enqueueMove((i % 3 == 1) ? g_moveQueue : g_scriptMoveQueue, makeMove(MOVE_FACE, order[i], true), false);
+    }
+    int failures = 0;
+    MoveToken move;
+    bool isScrambleMove;
+    for (int i = 0; i < 6; i++) {
+        failures += !dequeueQueuedMove(move, isScrambleMove) || move.face != order[i];
+    }
+    failures += dequeueQueuedMove(move, isScrambleMove);
+    // A script still running on the old generation: its late post must not play
+    enqueueMove(g_scriptMoveQueue, makeMove(MOVE_FACE, UP, true), false);
+    cancelAnimationAndQueue();
+    enqueueMove(g_scriptMoveQueue, makeMove(MOVE_FACE, DOWN, true), false);
+    enqueueMove(g_moveQueue, makeMove(MOVE_FACE, RIGHT, true), false);
+    failures += !dequeueQueuedMove(move, isScrambleMove) || move.face != RIGHT;
+    failures += dequeueQueuedMove(move, isScrambleMove) || getMoveQueueCount() != 0;
+    g_scriptMoveQueue.generation = g_queueGeneration;
+    fprintf(g_logFile, "  -> %s\n", failures == 0 ? "PASSED" : "FAILED");
+    fprintf(g_logFile, "=== END MOVE QUEUE ORDER TEST ===\n\n");
+    fflush(g_logFile);
+}
+
+// Test function: samples past LATENCY_MAX_PENDING are counted as dropped, not lost silently,
+// and the next swap closes every one that was kept
+void testLatencyOverflow() {
+    if (g_logFile == NULL) {
+        return;
+    }
+    fprintf(g_logFile, "=== LATENCY OVERFLOW TEST ===\n");
+    const LatencyStats saved = g_latency;
+    g_latency.pending.clear();
+    const long dropped = g_latency.dropped;
+    const long closed = g_latency.metrics[LATENCY_TOTAL].count;
+    RotationAnimation animation;
+    resetAnimationSlot(animation);
+    animation.move = makeMove(MOVE_FACE, RIGHT, true);
+    animation.startNs = 2000000;
+    for (int i = 0; i < LATENCY_MAX_PENDING + 5; i++) {
+        animation.input.arrivalNs = 1000000;
+        markLatencyMotion(animation);
+    }
+    int failures = (int)g_latency.pending.size() != LATENCY_MAX_PENDING || g_latency.dropped != dropped + 5;
+    FILE* logFile = g_logFile;
+    g_logFile = NULL;  // one LATENCY line per sample otherwise
+    recordLatencyFrame(3000000);
+    g_logFile = logFile;
+    failures += !g_latency.pending.empty() || g_latency.metrics[LATENCY_TOTAL].count != closed + LATENCY_MAX_PENDING;
+    g_latency = saved;
+    fprintf(g_logFile, "  -> %d kept, 5 dropped: %s\n", LATENCY_MAX_PENDING, failures == 0 ? "PASSED" : "FAILED");
+    fprintf(g_logFile, "=== END LATENCY OVERFLOW TEST ===\n\n");
+    fflush(g_logFile);
+}
+
+// Test function: 2x2x2 ranks must round-trip through engine states and back
+void testPocketStateRank() {
+    if (g_logFile == NULL) {
+        return;
+    }
+    fprintf(g_logFile, "=== 2x2x2 STATE RANK TEST ===\n");
+    if (!g_pocketCornersBuilt) {
+        buildPocketCorners();
+    }
+    CubeState state;
+    initCubeState(state, 2);
+    int failures = encodePocketState(state) != 0;
+    const Face faces[3] = {RIGHT, UP, FRONT};
+    unsigned int seed = 2024;
+    CubeState decoded = state;
+    for (int i = 0; i < 200; i++) {
+        nextTestRandom(seed);
+        applyMove(state, makeMove(MOVE_FACE, faces[(seed >> 16) % 3], ((seed >> 24) & 1) != 0));
+        CubeState baked = state;
+        bakeFaceRotations(baked);
+        int rank = encodePocketState(state);
+        decodePocketState(rank, decoded);
+        failures += rank < 0 || rank >= POCKET_STATES || decoded.stickers != baked.stickers;
+    }
+    for (int probe = 0; probe < 1000; probe++) {
+        nextTestRandom(seed);
+        int rank = (int)((seed >> 4) % POCKET_STATES);
+        decodePocketState(rank, decoded);
+        failures += encodePocketState(decoded) != rank;
     }
-    
-    if (faceChanged) {
-        currentFrontFace = newFace;
-        updateRotationAxes();
-        glutPostRedisplay();
+    fprintf(g_logFile, "  -> %s\n", failures == 0 ? "PASSED" : "FAILED");
+    fprintf(g_logFile, "=== END 2x2x2 STATE RANK TEST ===\n\n");
+    fflush(g_logFile);
+}
+
+// Test function: scrambles must validate at every size; tampered states must be caught
+void testStateValidation() {
+    if (g_logFile == NULL) {
+        return;
+    }
+    fprintf(g_logFile, "=== STATE VALIDATION TEST ===\n");
+    const int sizes[] = {2, 3, 4, 5, MAX_SPECIALIZED_CUBE_SIZE + 2};
+    for (int s = 0; s < 5; s++) {
+        const int n = sizes[s];
+        const int last = n - 1;
+        const int mid = n / 2;
+        CubeState state;
+        initCubeState(state, n);
+        int failures = 0;
+        unsigned int seed = 4242 + n;
+        for (int i = 0; i < 300; i++) {
+            applyMove(state, randomTestMove(seed, n));
+            failures += validateCubeState(state).error != CUBE_STATE_VALID;
+        }
+        // Corner 7 (up-right-front) and corner 0 slots, clockwise
+        int cornerSlots[2][3];
+        for (int k = 0; k < 2; k++) {
+            int corner = k ? 0 : 7;
+            int c[3] = {(corner & 1) ? last : 0, (corner & 2) ? last : 0, (corner & 4) ? last : 0};
+            Face order[3];
+            cornerFaceOrder(corner, order);
+            for (int j = 0; j < 3; j++) {
+                cornerSlots[k][j] = logicalStickerIndex(state, order[j], c);
+            }
+        }
+        CubeState twisted = state;
+        for (int j = 0; j < 3; j++) {
+            twisted.stickers[cornerSlots[0][(j + 1) % 3]] = state.stickers[cornerSlots[0][j]];
+        }
+        failures += validateCubeState(twisted).error != CUBE_STATE_CORNER_TWIST;
+        CubeState mirrored = state;
+        std::swap(mirrored.stickers[cornerSlots[0][1]], mirrored.stickers[cornerSlots[0][2]]);
+        failures += validateCubeState(mirrored).error != CUBE_STATE_BAD_CORNER;
+        CubeState swapped = state;
+        for (int j = 0; j < 3; j++) {
+            std::swap(swapped.stickers[cornerSlots[0][j]], swapped.stickers[cornerSlots[1][j]]);
+        }
+        // Even cubes can swap two corners (the parity goes to wings and centers)
+        failures += validateCubeState(swapped).error != ((n & 1) ? CUBE_STATE_PERMUTATION_PARITY : CUBE_STATE_VALID);
+        if (n & 1) {
+            int edgeSlots[2][2];
+            for (int k = 0; k < 2; k++) {
+                Face order[2];
+                edgeFaceOrder(k * 5, order);
+                int c[3] = {mid, mid, mid};
+                for (int j = 0; j < 2; j++) {
+                    c[colorAxis(order[j])] = colorSide(order[j]) ? last : 0;
+                }
+                for (int j = 0; j < 2; j++) {
+                    edgeSlots[k][j] = logicalStickerIndex(state, order[j], c);
+                }
+            }
+            CubeState flipped = state;
+            std::swap(flipped.stickers[edgeSlots[0][0]], flipped.stickers[edgeSlots[0][1]]);
+            failures += validateCubeState(flipped).error != CUBE_STATE_EDGE_FLIP;
+            CubeState edgeSwap = state;
+            for (int j = 0; j < 2; j++) {
+                std::swap(edgeSwap.stickers[edgeSlots[0][j]], edgeSwap.stickers[edgeSlots[1][j]]);
+            }
+            failures += validateCubeState(edgeSwap).error != CUBE_STATE_PERMUTATION_PARITY;
+            CubeState duplicate = state;
+            for (int j = 0; j < 2; j++) {
+                duplicate.stickers[edgeSlots[0][j]] = state.stickers[edgeSlots[1][j]];
+            }
+            failures += validateCubeState(duplicate).error != CUBE_STATE_DUPLICATE_PIECE;
+        }
+        if (n >= 4) {
+            // Innermost wing orbit: the low-half wings of edges 0 and 5
+            int wingSlots[2][2];
+            for (int k = 0; k < 2; k++) {
+                Face order[2];
+                edgeFaceOrder(k * 5, order);
+                int c[3];
+                c[k * 5 / 4] = (n - 2) / 2;
+                for (int j = 0; j < 2; j++) {
+                    c[colorAxis(order[j])] = colorSide(order[j]) ? last : 0;
+                }
+                for (int j = 0; j < 2; j++) {
+                    wingSlots[k][j] = logicalStickerIndex(state, order[j], c);
+                }
+            }
+            CubeState wingFlip = state;
+            std::swap(wingFlip.stickers[wingSlots[0][0]], wingFlip.stickers[wingSlots[0][1]]);
+            failures += validateCubeState(wingFlip).error != CUBE_STATE_WING_FLIP;
+            CubeState wingCopy = state;
+            for (int j = 0; j < 2; j++) {
+                wingCopy.stickers[wingSlots[0][j]] = state.stickers[wingSlots[1][j]];
+            }
+            CubeStateError copyError = validateCubeState(wingCopy).error;
+            failures += copyError != CUBE_STATE_DUPLICATE_PIECE && copyError != CUBE_STATE_WING_FLIP;
+        }
+        fprintf(g_logFile, "  -> N=%d %s\n", n, failures == 0 ? "PASSED" : "FAILED");
+        if (failures != 0) {
+            fprintf(g_logFile, "     (%d wrong verdicts, e.g. twisted: %s)\n", failures, validateCubeState(twisted).message.c_str());
+        }
     }
+    fprintf(g_logFile, "=== END STATE VALIDATION TEST ===\n\n");
+    fflush(g_logFile);
 }
 
-void keyboardUp(unsigned char key, int /* x */, int /* y */) {
-    int keyUpper = toupper((unsigned char)key);
-    if (keyUpper < 0 || keyUpper >= 256) {
+// Test function: lazy face offsets (big cubes) must match eager N x N face copies
+void testLazyFaceRotation() {
+    if (g_logFile == NULL) {
         return;
     }
-    g_keyHeld[(unsigned char)keyUpper] = false;
-    if (key == ' ') {
-        g_keyHeld[(unsigned char)' '] = false;
+    fprintf(g_logFile, "=== LAZY FACE ROTATION TEST ===\n");
+    const int sizes[] = {MAX_SPECIALIZED_CUBE_SIZE + 1, MAX_SPECIALIZED_CUBE_SIZE + 2, 17};
+    for (int s = 0; s < 3; s++) {
+        const int n = sizes[s];
+        std::vector<CubeState> lazy;
+        std::vector<int> eager;
+        initSlotIndexPlanes(n, lazy);
+        initSlotIndexReference(n, eager);
+        unsigned int seed = 12345;
+        for (int move = 0; move < 200; move++) {
+            nextTestRandom(seed);
+            int axis = (int)((seed >> 16) % 3);
+            // Mostly outer layers (the lazy path), some inner slices
+            int pick = (int)((seed >> 8) & 3);
+            int layer = (pick == 0) ? (int)((seed >> 4) % n) : (pick == 1 ? 0 : n - 1);
+            int q = 1 + (int)((seed >> 24) % 3);
+            for (size_t p = 0; p < lazy.size(); p++) {
+                applyLayerTurn(lazy[p], axis, layer, q);
+            }
+            turnLayerGeneric(&eager[0], n, axis, layer, q);
+        }
+        std::vector<int> labels;
+        for (size_t p = 0; p < lazy.size(); p++) {
+            bakeFaceRotations(lazy[p]);
+        }
+        slotIndexLabels(lazy, labels);
+        bool passed = (labels == eager);
+        fprintf(g_logFile, "  -> N=%d %s\n", n, passed ? "PASSED" : "FAILED");
     }
+    fprintf(g_logFile, "=== END LAZY FACE ROTATION TEST ===\n\n");
+    fflush(g_logFile);
 }
 
-// Handle special keyboard input (arrow keys for rotation around dynamic axes)
-void keyboardSpecial(int key, int /* x */, int /* y */) {
-    const float ROTATION_STEP = KEYBOARD_ROTATION_SPEED;
-    const char* keyName = "";
-    
-    switch (key) {
-        case GLUT_KEY_UP:
-            // Rotate around vertical axis (negative for up)
-            cameraAngleX -= ROTATION_STEP;
-            keyName = "UP";
-            break;
-            
-        case GLUT_KEY_DOWN:
-            // Rotate around vertical axis (positive for down)
-            cameraAngleX += ROTATION_STEP;
-            keyName = "DOWN";
-            break;
-            
-        case GLUT_KEY_LEFT:
-            // Rotate around horizontal axis (negative for left)
-            cameraAngleY -= ROTATION_STEP;
-            keyName = "LEFT";
-            break;
-            
-        case GLUT_KEY_RIGHT:
-            // Rotate around horizontal axis (positive for right)
-            cameraAngleY += ROTATION_STEP;
-            keyName = "RIGHT";
-            break;
-            
-        default:
-            // Ignore other keys
-            return;
+// ========================================================================
+// Headless offscreen rendering (batch thumbnails without a window)
+// ========================================================================
+
+const int HEADLESS_DEFAULT_SIZE = 256;
+
+// One thumbnail: cube state + camera view + output file (.png or .ppm)
+struct RenderJob {
+    RubikCube state;
+    float cameraAngleX;
+    float cameraAngleY;
+    Face frontFace;
+    std::string outputPath;
+};
+
+// Offscreen GL context backed by a software rasterizer
+struct HeadlessContext {
+    int width;
+    int height;
+#if defined(RUBIK_ENABLE_OSMESA)
+    OSMesaContext context;
+    std::vector<unsigned char> colorBuffer;
+#elif defined(RUBIK_ENABLE_EGL)
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext context;
+#endif
+};
+
+#if defined(RUBIK_ENABLE_EGL) && !defined(RUBIK_ENABLE_OSMESA)
+// Prefer Mesa's surfaceless platform so no X/Wayland server is needed
+EGLDisplay getHeadlessEglDisplay() {
+#if defined(EGL_EXT_platform_base) && defined(EGL_PLATFORM_SURFACELESS_MESA)
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != NULL) {
+        EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display != EGL_NO_DISPLAY) {
+            return display;
+        }
+    }
+#endif
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+#endif
+
+bool createHeadlessContext(HeadlessContext& ctx, int width, int height) {
+    ctx.width = width;
+    ctx.height = height;
+#if defined(RUBIK_ENABLE_OSMESA)
+    ctx.context = OSMesaCreateContextExt(OSMESA_RGBA, 24, 0, 0, NULL);
+    if (ctx.context == NULL) {
+        std::cerr << "Error: OSMesaCreateContextExt failed" << std::endl;
+        return false;
+    }
+    ctx.colorBuffer.resize((size_t)width * (size_t)height * 4);
+    if (!OSMesaMakeCurrent(ctx.context, &ctx.colorBuffer[0], GL_UNSIGNED_BYTE, width, height)) {
+        std::cerr << "Error: OSMesaMakeCurrent failed" << std::endl;
+        OSMesaDestroyContext(ctx.context);
+        return false;
+    }
+    // OSMesa stores rows bottom-up like glReadPixels, keep the default orientation
+    OSMesaPixelStore(OSMESA_Y_UP, 1);
+    return true;
+#elif defined(RUBIK_ENABLE_EGL)
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_NONE
+    };
+    const EGLint pbufferAttribs[] = {
+        EGL_WIDTH, width,
+        EGL_HEIGHT, height,
+        EGL_NONE
+    };
+    EGLint major = 0;
+    EGLint minor = 0;
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    ctx.display = getHeadlessEglDisplay();
+    if (ctx.display == EGL_NO_DISPLAY || !eglInitialize(ctx.display, &major, &minor)) {
+        std::cerr << "Error: eglInitialize failed" << std::endl;
+        return false;
+    }
+    if (!eglChooseConfig(ctx.display, configAttribs, &config, 1, &numConfigs) || numConfigs < 1) {
+        std::cerr << "Error: no EGL config with pbuffer + desktop GL support" << std::endl;
+        eglTerminate(ctx.display);
+        return false;
+    }
+    ctx.surface = eglCreatePbufferSurface(ctx.display, config, pbufferAttribs);
+    if (ctx.surface == EGL_NO_SURFACE) {
+        std::cerr << "Error: eglCreatePbufferSurface failed" << std::endl;
+        eglTerminate(ctx.display);
+        return false;
+    }
+    // Legacy desktop GL (compatibility profile) so glBegin/glEnd keep working
+    eglBindAPI(EGL_OPENGL_API);
+    ctx.context = eglCreateContext(ctx.display, config, EGL_NO_CONTEXT, NULL);
+    if (ctx.context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(ctx.display, ctx.surface, ctx.surface, ctx.context)) {
+        std::cerr << "Error: eglCreateContext/eglMakeCurrent failed" << std::endl;
+        eglDestroySurface(ctx.display, ctx.surface);
+        eglTerminate(ctx.display);
+        return false;
     }
-    
-    // Log rotation
     if (g_logFile != NULL) {
-        fprintf(g_logFile, "KEYBOARD: %s pressed | angleX=%.1f angleY=%.1f\n", keyName, cameraAngleX, cameraAngleY);
+        fprintf(g_logFile, "HEADLESS: EGL %d.%d renderer=%s\n", major, minor,
+                (const char*)glGetString(GL_RENDERER));
         fflush(g_logFile);
     }
-    
-    // Request redraw to update camera view
-    glutPostRedisplay();
+    return true;
+#else
+    std::cerr << "Error: headless rendering not compiled in "
+              << "(rebuild with -DRUBIK_ENABLE_OSMESA -lOSMesa or -DRUBIK_ENABLE_EGL -lEGL)" << std::endl;
+    return false;
+#endif
 }
 
-// Test function: Verify face^4 = identity for all faces (4 CW turns return to original state)
-void testRotationIdentity() {
-    if (g_logFile == NULL) {
-        return;
+void destroyHeadlessContext(HeadlessContext& ctx) {
+#if defined(RUBIK_ENABLE_OSMESA)
+    OSMesaDestroyContext(ctx.context);
+    ctx.colorBuffer.clear();
+#elif defined(RUBIK_ENABLE_EGL)
+    eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(ctx.display, ctx.context);
+    eglDestroySurface(ctx.display, ctx.surface);
+    eglTerminate(ctx.display);
+#else
+    (void)ctx;
+#endif
+}
+
+// Binary PPM (P6), rows top-down
+bool writePpmFile(const char* path, const unsigned char* rgb, int width, int height) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    size_t bytes = (size_t)width * (size_t)height * 3;
+    bool ok = fwrite(rgb, 1, bytes, file) == bytes;
+    fclose(file);
+    return ok;
+}
+
+unsigned long updatePngCrc(unsigned long crc, const unsigned char* data, size_t length) {
+    static unsigned long table[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (unsigned long n = 0; n < 256; n++) {
+            unsigned long c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (0xEDB88320UL ^ (c >> 1)) : (c >> 1);
+            }
+            table[n] = c;
+        }
+        tableReady = true;
+    }
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+void appendBigEndian32(std::vector<unsigned char>& out, unsigned long value) {
+    out.push_back((unsigned char)((value >> 24) & 0xFF));
+    out.push_back((unsigned char)((value >> 16) & 0xFF));
+    out.push_back((unsigned char)((value >> 8) & 0xFF));
+    out.push_back((unsigned char)(value & 0xFF));
+}
+
+void appendPngChunk(std::vector<unsigned char>& out, const char* type,
+                    const std::vector<unsigned char>& data) {
+    appendBigEndian32(out, (unsigned long)data.size());
+    size_t typeStart = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    unsigned long crc = updatePngCrc(0xFFFFFFFFUL, &out[typeStart], out.size() - typeStart);
+    appendBigEndian32(out, crc ^ 0xFFFFFFFFUL);
+}
+
+// PNG (RGB8) with uncompressed "stored" deflate blocks - no zlib dependency
+bool writePngFile(const char* path, const unsigned char* rgb, int width, int height) {
+    const size_t rowBytes = (size_t)width * 3;
+    const size_t maxStoredBlock = 65535;
+    std::vector<unsigned char> raw;
+    raw.reserve((rowBytes + 1) * (size_t)height);
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0); // filter type: None
+        raw.insert(raw.end(), rgb + (size_t)y * rowBytes, rgb + (size_t)(y + 1) * rowBytes);
+    }
+    
+    std::vector<unsigned char> zdata;
+    zdata.push_back(0x78); // zlib header: deflate, 32K window
+    zdata.push_back(0x01);
+    size_t offset = 0;
+    do {
+        size_t blockLen = raw.size() - offset;
+        if (blockLen > maxStoredBlock) {
+            blockLen = maxStoredBlock;
+        }
+        bool finalBlock = (offset + blockLen == raw.size());
+        zdata.push_back(finalBlock ? 1 : 0);
+        zdata.push_back((unsigned char)(blockLen & 0xFF));
+        zdata.push_back((unsigned char)((blockLen >> 8) & 0xFF));
+        zdata.push_back((unsigned char)(~blockLen & 0xFF));
+        zdata.push_back((unsigned char)((~blockLen >> 8) & 0xFF));
+        zdata.insert(zdata.end(), raw.begin() + offset, raw.begin() + offset + blockLen);
+        offset += blockLen;
+    } while (offset < raw.size());
+    unsigned long adlerA = 1;
+    unsigned long adlerB = 0;
+    for (size_t i = 0; i < raw.size(); i++) {
+        adlerA = (adlerA + raw[i]) % 65521UL;
+        adlerB = (adlerB + adlerA) % 65521UL;
     }
+    appendBigEndian32(zdata, (adlerB << 16) | adlerA);
     
-    fprintf(g_logFile, "\n=== ROTATION IDENTITY TEST ===\n");
+    std::vector<unsigned char> header;
+    appendBigEndian32(header, (unsigned long)width);
+    appendBigEndian32(header, (unsigned long)height);
+    header.push_back(8); // bit depth
+    header.push_back(2); // color type: RGB
+    header.push_back(0); // compression
+    header.push_back(0); // filter
+    header.push_back(0); // interlace
     
-    // Backup entire cube colors
-    float originalColors[27][6][3];
-    for (int p = 0; p < 27; p++) {
-        for (int f = 0; f < 6; f++) {
-            for (int c = 0; c < 3; c++) {
-                originalColors[p][f][c] = g_rubikCube.pieces[p].colors[f][c];
-            }
+    const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    std::vector<unsigned char> file(signature, signature + 8);
+    appendPngChunk(file, "IHDR", header);
+    appendPngChunk(file, "IDAT", zdata);
+    appendPngChunk(file, "IEND", std::vector<unsigned char>());
+    
+    FILE* out = fopen(path, "wb");
+    if (out == NULL) {
+        return false;
+    }
+    bool ok = fwrite(&file[0], 1, file.size(), out) == file.size();
+    fclose(out);
+    return ok;
+}
+
+bool hasFileExtension(const std::string& path, const char* ext) {
+    size_t extLen = strlen(ext);
+    if (path.size() < extLen) {
+        return false;
+    }
+    for (size_t i = 0; i < extLen; i++) {
+        if (tolower((unsigned char)path[path.size() - extLen + i]) != tolower((unsigned char)ext[i])) {
+            return false;
         }
     }
+    return true;
+}
+
+// Render every job into the current (offscreen) context and write one image per job
+// Reuses drawRubikCube(), applyCameraTransform() and applyProjection() so thumbnails
+// match the interactive window exactly. Returns the number of images written.
+int renderBatch(const std::vector<RenderJob>& jobs, int width, int height) {
+    // Save interactive state so a batch can run inside a live session too
+    RubikCube savedCube = g_rubikCube;
+    CameraState savedCamera = g_camera;
+    Face savedFrontFace = currentFrontFace;
+    int savedAnimationCount = g_activeAnimationCount;
+    RotationAnimation savedAnimations[MAX_CONCURRENT_ANIMATIONS];
+    memcpy(savedAnimations, g_animations, sizeof(g_animations));
     
-    const Face facesToTest[] = {FRONT, BACK, LEFT, RIGHT, UP, DOWN};
-    const char* faceNames[] = {"FRONT", "BACK", "LEFT", "RIGHT", "UP", "DOWN"};
-    const int entriesPerCube = 27 * 6 * 3;
+    std::vector<unsigned char> pixels((size_t)width * (size_t)height * 3);
+    std::vector<unsigned char> flipped(pixels.size());
+    const size_t rowBytes = (size_t)width * 3;
+    int written = 0;
     
-    for (int faceIdx = 0; faceIdx < 6; faceIdx++) {
-        Face face = facesToTest[faceIdx];
-        // Restore baseline before each face test
-        for (int p = 0; p < 27; p++) {
-            for (int f = 0; f < 6; f++) {
-                for (int c = 0; c < 3; c++) {
-                    g_rubikCube.pieces[p].colors[f][c] = originalColors[p][f][c];
-                }
-            }
+    initOpenGL();
+    initLayerShader();
+    applyProjection(width, height);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int slot = 0; slot < MAX_CONCURRENT_ANIMATIONS; slot++) {
+        g_animations[slot].isActive = false;
+    }
+    g_activeAnimationCount = 0;
+    
+    for (size_t j = 0; j < jobs.size(); j++) {
+        const RenderJob& job = jobs[j];
+        g_rubikCube = job.state;
+        if (currentFrontFace != job.frontFace || j == 0) {
+            currentFrontFace = job.frontFace;
+            updateRotationAxes();
         }
+        setCameraFromAngles(job.cameraAngleX, job.cameraAngleY);
         
-        fprintf(g_logFile, "Testing %s: performing 4 CW turns...\n", faceNames[faceIdx]);
-        for (int turn = 0; turn < 4; turn++) {
-            rotateFace(face, true);
-        }
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glLoadIdentity();
+        applyCameraTransform();
+        drawRubikCube();
+        glFinish();
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
         
-        int matches = 0;
-        for (int p = 0; p < 27; p++) {
-            for (int f = 0; f < 6; f++) {
-                for (int c = 0; c < 3; c++) {
-                    float diff = fabs(g_rubikCube.pieces[p].colors[f][c] - originalColors[p][f][c]);
-                    if (diff < 0.001f) {
-                        matches++;
-                    }
-                }
-            }
+        // GL rows are bottom-up, image files are top-down
+        for (int y = 0; y < height; y++) {
+            memcpy(&flipped[(size_t)y * rowBytes], &pixels[(size_t)(height - 1 - y) * rowBytes], rowBytes);
         }
-        
-        if (matches == entriesPerCube) {
-            fprintf(g_logFile, "  -> %s PASSED (%d/%d matches)\n", faceNames[faceIdx], matches, entriesPerCube);
+        bool ok = hasFileExtension(job.outputPath, ".ppm")
+            ? writePpmFile(job.outputPath.c_str(), &flipped[0], width, height)
+            : writePngFile(job.outputPath.c_str(), &flipped[0], width, height);
+        if (ok) {
+            written++;
         } else {
-            fprintf(g_logFile, "  -> %s FAILED (%d/%d matches)\n", faceNames[faceIdx], matches, entriesPerCube);
+            std::cerr << "Error: cannot write " << job.outputPath << std::endl;
+        }
+        if (g_logFile != NULL) {
+            fprintf(g_logFile, "HEADLESS: job %d -> %s %s\n", (int)j, job.outputPath.c_str(), ok ? "OK" : "FAILED");
         }
     }
     
-    // Restore original solved state after tests
-    for (int p = 0; p < 27; p++) {
-        for (int f = 0; f < 6; f++) {
-            for (int c = 0; c < 3; c++) {
-                g_rubikCube.pieces[p].colors[f][c] = originalColors[p][f][c];
-            }
+    g_rubikCube = savedCube;
+    currentFrontFace = savedFrontFace;
+    updateRotationAxes();
+    g_camera = savedCamera;
+    g_camera.revision++;
+    memcpy(g_animations, savedAnimations, sizeof(g_animations));
+    g_activeAnimationCount = savedAnimationCount;
+    if (g_logFile != NULL) {
+        fflush(g_logFile);
+    }
+    return written;
+}
+
+bool parseFaceLetter(char letter, Face& face) {
+    switch (toupper((unsigned char)letter)) {
+        case 'F': face = FRONT; return true;
+        case 'B': face = BACK; return true;
+        case 'L': face = LEFT; return true;
+        case 'R': face = RIGHT; return true;
+        case 'U': face = UP; return true;
+        case 'D': face = DOWN; return true;
+        default: return false;
+    }
+}
+
+// Job file: one thumbnail per line, '#' starts a comment
+//   <output.png|output.ppm> <cameraAngleX> <cameraAngleY> <front F|B|L|R|U|D> [moves from solved...]
+// e.g. "thumbs/0001.png 30 -45 F R U R' U'"
+bool loadRenderJobs(const char* path, std::vector<RenderJob>& jobs) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        std::cerr << "Error: cannot open job file " << path << std::endl;
+        return false;
+    }
+    char line[4096];
+    int lineNumber = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        char outPath[1024];
+        char frontLetter[8];
+        float angleX = 0.0f;
+        float angleY = 0.0f;
+        int consumed = 0;
+        if (line[0] == '#' || sscanf(line, " %1023s", outPath) != 1) {
+            continue;
+        }
+        if (sscanf(line, " %1023s %f %f %7s %n", outPath, &angleX, &angleY, frontLetter, &consumed) < 4) {
+            std::cerr << "Error: " << path << ":" << lineNumber << ": expected <out> <angleX> <angleY> <front> [moves]" << std::endl;
+            ok = false;
+            continue;
+        }
+        RenderJob job;
+        std::vector<MoveToken> moves;
+        if (!parseFaceLetter(frontLetter[0], job.frontFace) || !parseMoveSequence(line + consumed, moves)) {
+            std::cerr << "Error: " << path << ":" << lineNumber << ": bad face or move sequence" << std::endl;
+            ok = false;
+            continue;
+        }
+        initRubikCube();
+        for (size_t m = 0; m < moves.size(); m++) {
+            performMove(moves[m]);
+        }
+        CubeStateCheck check = validateCubeState(g_rubikCube.state);
+        if (check.error != CUBE_STATE_VALID) {
+            std::cerr << "Error: " << path << ":" << lineNumber << ": unsolvable state, " << check.message << std::endl;
+            ok = false;
+            continue;
         }
+        job.state = g_rubikCube;
+        job.cameraAngleX = angleX;
+        job.cameraAngleY = angleY;
+        job.outputPath = outPath;
+        jobs.push_back(job);
     }
-    
-    fprintf(g_logFile, "=== END ROTATION IDENTITY TEST ===\n\n");
-    fflush(g_logFile);
+    fclose(file);
+    return ok;
+}
+
+// Entry point for "--render-batch <jobs.txt> [--size WxH]": no GLUT window is ever created
+int runHeadlessBatch(const char* jobPath, int width, int height) {
+    std::vector<RenderJob> jobs;
+    if (!loadRenderJobs(jobPath, jobs)) {
+        return 1;
+    }
+    HeadlessContext ctx;
+    if (!createHeadlessContext(ctx, width, height)) {
+        return 1;
+    }
+    g_headlessActive = true;
+    int written = renderBatch(jobs, width, height);
+    g_headlessActive = false;
+    destroyHeadlessContext(ctx);
+    std::cout << "Rendered " << written << "/" << jobs.size() << " images ("
+              << width << "x" << height << ")" << std::endl;
+    return written == (int)jobs.size() ? 0 : 1;
 }
 
 // Main entry point
 int main(int argc, char** argv) {
     // Initialize debug log file
     initLogFile();
+    initMoveTables();
+    
+    // "--cube N": NxNxN cube (default 3x3x3), applies to the window and headless batches
+    for (int a = 1; a + 1 < argc; a++) {
+        if (strcmp(argv[a], "--cube") == 0) {
+            int n = atoi(argv[a + 1]);
+            if (n < MIN_CUBE_SIZE || n > MAX_CUBE_SIZE) {
+                std::cerr << "Error: --cube expects " << MIN_CUBE_SIZE << ".." << MAX_CUBE_SIZE << std::endl;
+                closeLogFile();
+                return 1;
+            }
+            g_cubeSize = n;
+        } else if (strcmp(argv[a], "--threads") == 0) {
+            g_workerThreadRequest = atoi(argv[a + 1]);
+        }
+    }
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--instant") == 0) {
+            g_instantMoves = true;
+        }
+    }
+    
+    // "--solve-stats solves.rbks": summarize a solve log and exit
+    for (int a = 1; a + 1 < argc; a++) {
+        if (strcmp(argv[a], "--solve-stats") == 0) {
+            int status = printSolveLogStats(argv[a + 1]);
+            closeLogFile();
+            return status;
+        }
+    }
+    
+    // "--enumerate-2x2 [table.bin]": exhaustive 2x2x2 search, distance table to disk
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--enumerate-2x2") == 0) {
+            const char* path = (a + 1 < argc && argv[a + 1][0] != '-') ? argv[a + 1] : "rubik_2x2_distances.bin";
+            int status = enumeratePocketCube(path);
+            closeLogFile();
+            return status;
+        }
+    }
+    
+    // "--replay session.rbki": re-run a recorded session headless and check its final state
+    for (int a = 1; a + 1 < argc; a++) {
+        if (strcmp(argv[a], "--replay") == 0) {
+            int status = runInputReplay(argv[a + 1]);
+            closeLogFile();
+            return status;
+        }
+    }
+    
+    // Headless batch mode: render thumbnails offscreen and exit without creating a window
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--render-batch") == 0 && a + 1 < argc) {
+            int width = HEADLESS_DEFAULT_SIZE;
+            int height = HEADLESS_DEFAULT_SIZE;
+            for (int b = 1; b + 1 < argc; b++) {
+                if (strcmp(argv[b], "--size") == 0 &&
+                    (sscanf(argv[b + 1], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)) {
+                    std::cerr << "Error: --size expects WxH" << std::endl;
+                    closeLogFile();
+                    return 1;
+                }
+            }
+            int status = runHeadlessBatch(argv[a + 1], width, height);
+            closeLogFile();
+            return status;
+        }
+    }
+    
+    // "--trace [file.json]": record Chrome trace events from startup until 'T' or exit
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--trace") == 0) {
+            if (a + 1 < argc && argv[a + 1][0] != '-') {
+                g_trace.outputPath = argv[a + 1];
+            }
+            startTraceRecording();
+        }
+    }
+    atexit(flushTraceAtExit);
     
     // Initialize GLUT
     glutInit(&argc, argv);
@@ -2141,17 +7748,46 @@ int main(int argc, char** argv) {
     // Initialize OpenGL settings
     initOpenGL();
     
-    // Initialize Rubik's Cube (27 pieces)
+    // Layer-rotation shader and frame-time profiler (both need the context created above)
+    initLayerShader();
+    resetProfiler();
+    initGpuTimerQueries();
+    
+    // Initialize Rubik's Cube (N^3 pieces)
     initRubikCube();
     
     // Test rotation identity: F^4 = identity (verify fix works correctly)
     testRotationIdentity();
+    testSpecializedMoveTables();
+    testLazyFaceRotation();
+    testCubeRotationMoves();
+    testParallelLayerTurns();
+    testBulkApplyMoves();
+    testStickerDirtyRects();
+    testZobristStateKey();
+    testMoveHistory();
+    testPocketStateRank();
+    testStateValidation();
+    testReplayAfterSolve();
+    testMoveQueueOrder();
+    testLatencyOverflow();
     
     // Initialize rotation axes for default FRONT face
     updateRotationAxes();
     
-    // Initialize random seed for shuffle
-    srand((unsigned int)time(NULL));
+    // Solve history for best / mean / aoN
+    reloadSessionHistory();
+    
+    // Initialize random seed for shuffle (kept for --record)
+    g_randomSeed = (unsigned int)time(NULL);
+    srand(g_randomSeed);
+    
+    // "--record session.rbki": log every input event for a deterministic --replay
+    for (int a = 1; a + 1 < argc; a++) {
+        if (strcmp(argv[a], "--record") == 0 && !startInputRecording(argv[a + 1])) {
+            std::cerr << "Error: cannot write " << argv[a + 1] << std::endl;
+        }
+    }
     
     // Register callback functions
     glutDisplayFunc(display);
@@ -2163,7 +7799,14 @@ int main(int argc, char** argv) {
     glutSpecialFunc(keyboardSpecial); // Register keyboard handler for special keys (arrow keys)
     glutIdleFunc(idle);
     glutIgnoreKeyRepeat(1);           // Disable key auto-repeat so each press logs once
-    g_lastTimeMs = glutGet(GLUT_ELAPSED_TIME);
+    g_lastFrameNs = getMonotonicTimeNs();
+    
+    // "--play moves.txt": animate a move script fed from its own producer thread
+    for (int a = 1; a + 1 < argc; a++) {
+        if (strcmp(argv[a], "--play") == 0 && !startScriptThread(argv[a + 1])) {
+            std::cerr << "Error: cannot start script thread" << std::endl;
+        }
+    }
     
     // Log initialization complete
     if (g_logFile != NULL) {